@@ -219,39 +219,181 @@ void mp_gr_toss_objects_extended(mp_edge_object* hh) {
   }
   mp_gr_toss_objects(hh);
 }
+/*
+  Index of the shipped out edges by charcode and by charname.
+  Buckets are chained through mp_edge_object::nextcode and mp_edge_object::nextname. Charcodes are unique since a shipout
+  replaces the edge having the same code.
+*/
+typedef struct mp_edge_index {
+  size_t size;
+  size_t count;
+  mp_edge_object** codes;
+  mp_edge_object** names;
+  mp_edge_object* tail;
+} mp_edge_index;
+
+#define MP_EDGE_INDEX_SIZE 1024
+
+static size_t mp_edge_code_hash(int charcode) {
+  return (size_t)((unsigned int)charcode * 2654435761u);
+}
+static size_t mp_edge_name_hash(const char* charname) {
+  size_t hash = 2166136261u;
+  while (*charname) {
+    hash = (hash ^ (unsigned char)*charname++) * 16777619u;
+  }
+  return hash;
+}
+static void mp_edge_index_link(mp_edge_index* index, mp_edge_object* hh) {
+  size_t mask = index->size - 1;
+
+  mp_edge_object** slot = &index->codes[mp_edge_code_hash(hh->charcode) & mask];
+  hh->nextcode = *slot;
+  *slot = hh;
+
+  hh->nextname = NULL;
+  hh->namehash = 0;
+  if (hh->charname) {
+    hh->namehash = mp_edge_name_hash(hh->charname);
+    slot = &index->names[hh->namehash & mask];
+    while (*slot) {
+      slot = &(*slot)->nextname;
+    }
+    *slot = hh;
+  }
+
+  index->count++;
+}
+static void mp_edge_index_unlink(mp_edge_index* index, mp_edge_object* hh) {
+  size_t mask = index->size - 1;
+
+  mp_edge_object** slot = &index->codes[mp_edge_code_hash(hh->charcode) & mask];
+  while (*slot && *slot != hh) {
+    slot = &(*slot)->nextcode;
+  }
+  if (*slot) {
+    *slot = hh->nextcode;
+  }
+
+  // the stored hash is used since charname points to a MetaPost string
+  if (hh->charname) {
+    slot = &index->names[hh->namehash & mask];
+    while (*slot && *slot != hh) {
+      slot = &(*slot)->nextname;
+    }
+    if (*slot) {
+      *slot = hh->nextname;
+    }
+  }
+
+  index->count--;
+}
+static void mp_edge_index_rebuild(MP mp, mp_edge_index* index, size_t size) {
+  mp_run_data* run = mp_rundata(mp);
+
+  xfree(index->codes);
+  xfree(index->names);
+
+  index->size = size;
+  index->count = 0;
+  index->codes = xmalloc(size, sizeof(mp_edge_object*));
+  index->names = xmalloc(size, sizeof(mp_edge_object*));
+  memset(index->codes, 0, size * sizeof(mp_edge_object*));
+  memset(index->names, 0, size * sizeof(mp_edge_object*));
+  index->tail = NULL;
+
+  for (mp_edge_object* p = run->edges; p != NULL; p = p->next) {
+    mp_edge_index_link(index, p);
+    index->tail = p;
+  }
+}
+static mp_edge_index* mp_get_edge_index(MP mp) {
+  mp_run_data* run = mp_rundata(mp);
+
+  if (run->edge_index == NULL) {
+    run->edge_index = xmalloc(1, sizeof(mp_edge_index));
+    memset(run->edge_index, 0, sizeof(mp_edge_index));
+    mp_edge_index_rebuild(mp, run->edge_index, MP_EDGE_INDEX_SIZE);
+  }
+
+  return run->edge_index;
+}
+static void mp_free_edge_index(MP mp) {
+  mp_run_data* run = mp_rundata(mp);
+
+  if (run->edge_index) {
+    xfree(run->edge_index->codes);
+    xfree(run->edge_index->names);
+    xfree(run->edge_index);
+  }
+}
+mp_edge_object* mp_find_edge(MP mp, int charcode) {
+  mp_edge_index* index = mp_get_edge_index(mp);
+
+  mp_edge_object* p = index->codes[mp_edge_code_hash(charcode) & (index->size - 1)];
+  while (p && p->charcode != charcode) {
+    p = p->nextcode;
+  }
+
+  return p;
+}
+mp_edge_object* mp_find_edge_by_name(MP mp, const char* charname) {
+  mp_edge_index* index = mp_get_edge_index(mp);
+
+  size_t hash = mp_edge_name_hash(charname);
+
+  mp_edge_object* p = index->names[hash & (index->size - 1)];
+  while (p && (p->namehash != hash || strcmp(p->charname, charname) != 0)) {
+    p = p->nextname;
+  }
+
+  return p;
+}
 void mymplib_shipout_backend(MP mp, void* voidh) {
   mp_edge_header_node h = (mp_edge_header_node)voidh;
   mp_edge_object* hh = mp_gr_export(mp, h);
   if (hh) {
     setParameters(mp, hh);
-    mp_run_data* run = mp_rundata(mp);
-    if (run->edges == NULL) {
+    mp_add_edge(mp, hh);
+  }
+}
+void mp_add_edge(MP mp, mp_edge_object* hh) {
+  mp_run_data* run = mp_rundata(mp);
+  mp_edge_index* index = mp_get_edge_index(mp);
+
+  mp_edge_object* p = mp_find_edge(mp, hh->charcode);
+
+  if (p) {
+    // The new edge takes the place of the old one in the list
+    mp_edge_object* next = p->next;
+    mp_edge_index_unlink(index, p);
+    mp_graphic_object* q = p->body;
+    while (q != NULL) {
+      mp_graphic_object* r = q->next;
+      mp_gr_toss_object(q);
+      q = r;
+    }
+    for (int i = 0; i < p->numAnchors; i++) {
+      mp_xfree(p->anchors[i].anchorName);
+    }
+    mp_xfree(p->filename);
+    *p = *hh;
+    p->next = next;
+    mp_xfree(hh);
+    mp_edge_index_link(index, p);
+  }
+  else {
+    hh->next = NULL;
+    if (index->tail == NULL) {
       run->edges = hh;
     }
     else {
-      mp_edge_object* p = run->edges;
-      mp_edge_object* prev = NULL;
-      bool exist = false;
-      do {
-        if (p->charcode == hh->charcode) {
-          if (prev) {
-            prev->next = hh;
-          }
-          else {
-            run->edges = hh;
-          }
-          hh->next = p->next;
-          mp_gr_toss_objects_extended(p);
-          exist = true;
-          break;
-        }
-        prev = p;
-        p = p->next;
-      } while (p);
-
-      if (!exist) {
-        prev->next = hh;
-      }
+      index->tail->next = hh;
+    }
+    index->tail = hh;
+    mp_edge_index_link(index, hh);
+    if (index->count > index->size) {
+      mp_edge_index_rebuild(mp, index, index->size * 2);
     }
   }
 }
@@ -43,3 +43,11 @@ bool getMPPairVariable(MP mp, char* varName, double* x, double* y);
 bool getMPNumVariable(MP mp, const char* varName, double* x);
 bool getMPStringVariable(MP mp, const char* varName, char** x);
 double mp_get_numeric_internal(MP mp, char* n);
+
+// Lookups in the edge index maintained by the shipout backend instead of walking mp_run_data::edges.
+// By name the first shipped out edge having the name is returned.
+mp_edge_object* mp_find_edge(MP mp, int charcode);
+mp_edge_object* mp_find_edge_by_name(MP mp, const char* charname);
+// Adds an edge as if it was shipped out, replacing the edge having the same charcode. The instance takes ownership of
+// the edge : its objects, knots and anchor names must be allocated with mp_xmalloc.
+void mp_add_edge(MP mp, mp_edge_object* hh);
@@ -1956,6 +1956,7 @@ static int mplib_eof_file(MP mp, void* ff);
 static void mplib_flush_file(MP mp, void* ff);
 static void mplib_shipout_backend(MP mp, void* h);
 static void mymplib_shipout_backend(MP mp, void* h);
+static void mp_free_edge_index(MP mp); //VMF
 
 /*:1063*//*1088:*/
 // #line 31182 "../../../source/texk/web2c/mplibdir/mp.w"
@@ -2864,6 +2865,7 @@ static void mp_free(MP mp) {
   mp_free_stream(&(mp->run_data.log_out));
   mp_free_stream(&(mp->run_data.error_out));
   mp_free_stream(&(mp->run_data.ship_out));
+  mp_free_edge_index(mp); //VMF
 
   /*:1068*//*1097:*/
   // #line 31348 "../../../source/texk/web2c/mplibdir/mp.w"
@@ -380,6 +380,7 @@ mp_stream log_out;
 mp_stream ship_out;
 mp_stream term_in;
 struct mp_edge_object*edges;
+struct mp_edge_index*edge_index; //VMF
 }mp_run_data;
 
 /*:1058*//*1274:*/
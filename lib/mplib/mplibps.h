@@ -128,6 +128,10 @@ double xpart;
 double ypart;
 int numAnchors;
 AnchorPoint anchors[10];
+// Chains of the edge index buckets (see newmp.c)
+struct mp_edge_object* nextcode;
+struct mp_edge_object* nextname;
+size_t namehash;
 }mp_edge_object;
 
 /*:188*//*235:*/
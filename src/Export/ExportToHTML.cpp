@@ -430,46 +430,30 @@ void ExportToHTML::generateQuranPagesOld(QList<QList<LineLayoutInfo>> pages, int
   file.close();
 }
 
-void ExportToHTML::edgetoHTML5Path(mp_graphic_object* body, QTextStream& out)
+void ExportToHTML::edgetoHTML5Path(const FlatOutline& outline, QTextStream& out)
 {
 
 
-  if (body) {
+  if (!outline.isEmpty()) {
 
     out << "\tctx.beginPath();\n";
-    do {
-      switch (body->type)
-      {
-      case mp_fill_code: {
-        filltoHTML5Path(((mp_fill_object*)body)->path_p, out);
-
-
-        break;
-      }
-      default:
-        break;
-      }
-
-    } while (body = body->next);
+    for (auto& contour : outline.contours) {
+      filltoHTML5Path(outline, contour, out);
+    }
 
     out << "\tctx.fill();\n";
   }
 
 }
 
-void ExportToHTML::filltoHTML5Path(mp_gr_knot h, QTextStream& out)
+void ExportToHTML::filltoHTML5Path(const FlatOutline& outline, const FlatOutline::Contour& contour, QTextStream& out)
 {
-  mp_gr_knot p, q;
-
-  out << "\tctx.moveTo(" << h->x_coord << "," << h->y_coord << ");\n";
-  p = h;
-  do {
-    q = p->next;
-    out << "\tctx.bezierCurveTo(" << p->right_x << "," << p->right_y << "," << q->left_x << "," << q->left_y << "," << q->x_coord << "," << q->y_coord << ");\n";
-
-    p = q;
-  } while (p != h);
-  if (h->data.types.left_type != mp_endpoint)
+  out << "\tctx.moveTo(" << outline.x[contour.begin] << "," << outline.y[contour.begin] << ");\n";
+  for (uint32_t p = contour.begin; p < contour.end; p++) {
+    uint32_t q = outline.next(contour, p);
+    out << "\tctx.bezierCurveTo(" << outline.rightX[p] << "," << outline.rightY[p] << "," << outline.leftX[q] << "," << outline.leftY[q] << "," << outline.x[q] << "," << outline.y[q] << ");\n";
+  }
+  if (contour.closed)
     out << "\tctx.closePath()\n";
 
 
@@ -542,36 +526,23 @@ void ExportToHTML::generateGlyph(GlyphVis& glyph, QTextStream& out) {
     out << "\tctx.restore();\n";
   }
   else {
-    edgetoHTML5Path(glyph.copiedPath, out);
+    edgetoHTML5Path(glyph.outline(), out);
   }
 }
 void ExportToHTML::getImageStream(GlyphVis& glyph, QTextStream& out) {
 
   if (glyph.m_edge) {
-    mp_graphic_object* body = glyph.m_edge->body;
-    if (body) {
-      do {
-        switch (body->type)
-        {
-        case mp_fill_code: {
-          auto fillobject = (mp_fill_object*)body;
-          out << "\tctx.beginPath();\n";
-          filltoHTML5Path(fillobject->path_p, out);
-          if (fillobject->color_model == mp_rgb_model) {
-            //painter.setBrush(QColor(fillobject->color.a_val, fillobject->color.b_val, fillobject->color.c_val));
-            out << "\tctx.fillStyle = 'rgb(" << fillobject->color.a_val * 255 << "," << fillobject->color.b_val * 255 << "," << fillobject->color.c_val * 255 << ")';\n";
-
-          }
-          out << "\tctx.fill();\n";
-          out << "\tctx.fillStyle = 'rgb(0,0,0)';\n";
+    auto& outline = glyph.outline();
+    for (auto& contour : outline.contours) {
+      out << "\tctx.beginPath();\n";
+      filltoHTML5Path(outline, contour, out);
+      if (contour.hasColor) {
+        //painter.setBrush(QColor(fillobject->color.a_val, fillobject->color.b_val, fillobject->color.c_val));
+        out << "\tctx.fillStyle = 'rgb(" << contour.color[0] * 255 << "," << contour.color[1] * 255 << "," << contour.color[2] * 255 << ")';\n";
 
-          break;
-        }
-        default:
-          break;
-        }
-
-      } while (body = body->next);
+      }
+      out << "\tctx.fill();\n";
+      out << "\tctx.fillStyle = 'rgb(0,0,0)';\n";
     }
   }
 
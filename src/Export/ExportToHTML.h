@@ -21,6 +21,7 @@
 #define EXPORTTOHTML_H
 
 #include "OtLayout.h"
+#include "FlatOutline.h"
 #include "qtextstream.h"
 
 struct mp_graphic_object;
@@ -34,8 +35,8 @@ public:
 	void generateQuranPages(QList<QList<LineLayoutInfo>> pages, int lineWidth, QList<QStringList> originalText, int scale);
   void generateQuranPagesOld(QList<QList<LineLayoutInfo>> pages, int lineWidth, QList<QStringList> originalText, int scale);
   
-	void edgetoHTML5Path(mp_graphic_object* body, QTextStream& out);
-	void filltoHTML5Path(mp_gr_knot h, QTextStream& out);
+	void edgetoHTML5Path(const FlatOutline& outline, QTextStream& out);
+	void filltoHTML5Path(const FlatOutline& outline, const FlatOutline::Contour& contour, QTextStream& out);
 	void generateGlyph(GlyphVis& glyph, QTextStream & out);
 	void getImageStream(GlyphVis& glyph, QTextStream & out);
 
@@ -70,7 +70,7 @@ void GenerateLayout::generateGlyphs(QJsonObject& glyphsObject) {
 
     QJsonArray pathArray;
 
-    edgetoHTML5Path(glyph.copiedPath, pathArray);
+    edgetoHTML5Path(glyph.outline(), pathArray);
 
     glyphObject["default"] = pathArray;
 
@@ -99,7 +99,7 @@ void GenerateLayout::generateGlyphs(QJsonObject& glyphsObject) {
 
         QJsonArray pathArray;
 
-        edgetoHTML5Path(alternate->copiedPath, pathArray);
+        edgetoHTML5Path(alternate->outline(), pathArray);
         glyphObject["minLeft"] = pathArray;
       }
 
@@ -113,7 +113,7 @@ void GenerateLayout::generateGlyphs(QJsonObject& glyphsObject) {
 
         QJsonArray pathArray;
 
-        edgetoHTML5Path(alternate->copiedPath, pathArray);
+        edgetoHTML5Path(alternate->outline(), pathArray);
         glyphObject["maxLeft"] = pathArray;
       }
 
@@ -127,7 +127,7 @@ void GenerateLayout::generateGlyphs(QJsonObject& glyphsObject) {
 
         QJsonArray pathArray;
 
-        edgetoHTML5Path(alternate->copiedPath, pathArray);
+        edgetoHTML5Path(alternate->outline(), pathArray);
         glyphObject["minRight"] = pathArray;
       }
 
@@ -141,7 +141,7 @@ void GenerateLayout::generateGlyphs(QJsonObject& glyphsObject) {
 
         QJsonArray pathArray;
 
-        edgetoHTML5Path(alternate->copiedPath, pathArray);
+        edgetoHTML5Path(alternate->outline(), pathArray);
         glyphObject["maxRight"] = pathArray;
       }
 
@@ -289,79 +289,55 @@ void GenerateLayout::generateSuraLocations(QJsonArray& surasArray) {
   }
 }
 
-void GenerateLayout::filltoHTML5Path(mp_gr_knot h, QJsonArray& pathArray)
+void GenerateLayout::filltoHTML5Path(const FlatOutline& outline, const FlatOutline::Contour& contour, QJsonArray& pathArray)
 {
 
-  if (!h) return;
-  mp_gr_knot p, q;
-
   QJsonArray start;
 
-  start.append(h->x_coord);
-  start.append(h->y_coord);
+  start.append(outline.x[contour.begin]);
+  start.append(outline.y[contour.begin]);
 
   pathArray.append(start);
 
-  p = h;
-  do {
-    q = p->next;
+  for (uint32_t p = contour.begin; p < contour.end; p++) {
+    uint32_t q = outline.next(contour, p);
     QJsonArray cubic;
 
-    cubic.append(p->right_x);
-    cubic.append(p->right_y);
-    cubic.append(q->left_x);
-    cubic.append(q->left_y);
-    cubic.append(q->x_coord);
-    cubic.append(q->y_coord);
+    cubic.append(outline.rightX[p]);
+    cubic.append(outline.rightY[p]);
+    cubic.append(outline.leftX[q]);
+    cubic.append(outline.leftY[q]);
+    cubic.append(outline.x[q]);
+    cubic.append(outline.y[q]);
 
     pathArray.append(cubic);
-
-    p = q;
-  } while (p != h);
+  }
 
 }
-void GenerateLayout::edgetoHTML5Path(mp_graphic_object* body, QJsonArray& pathsArray) {
-
-
-  if (body) {
-    do {
-      switch (body->type)
-      {
-      case mp_fill_code: {
-
-        QJsonObject pathObject;
-
-        auto fillobject = (mp_fill_object*)body;
-
-        QJsonArray pathArray;
-
-        filltoHTML5Path(fillobject->path_p, pathArray);
+void GenerateLayout::edgetoHTML5Path(const FlatOutline& outline, QJsonArray& pathsArray) {
 
-        pathObject["path"] = pathArray;
+  for (auto& contour : outline.contours) {
 
+    QJsonObject pathObject;
 
+    QJsonArray pathArray;
 
-        if (fillobject->color_model == mp_rgb_model) {
-
-          QJsonArray rgbArray;
+    filltoHTML5Path(outline, contour, pathArray);
 
-          rgbArray.append(fillobject->color.a_val * 255);
-          rgbArray.append(fillobject->color.b_val * 255);
-          rgbArray.append(fillobject->color.c_val * 255);
+    pathObject["path"] = pathArray;
 
-          pathObject["color"] = rgbArray;
+    if (contour.hasColor) {
 
-        }
+      QJsonArray rgbArray;
 
-        pathsArray.append(pathObject);
+      rgbArray.append(contour.color[0] * 255);
+      rgbArray.append(contour.color[1] * 255);
+      rgbArray.append(contour.color[2] * 255);
 
+      pathObject["color"] = rgbArray;
 
-        break;
-      }
-      default:
-        break;
-      }
+    }
 
-    } while (body = body->next);
+    pathsArray.append(pathObject);
   }
 }
@@ -21,6 +21,7 @@
 #define GENERATELAYOUT_H
 
 #include "OtLayout.h"
+#include "FlatOutline.h"
 #include "qtextstream.h"
 
 struct mp_graphic_object;
@@ -38,8 +39,8 @@ public:
   void generateGlyphs(QJsonObject& glyphsObject);
   void generateSuraLocations(QJsonArray& surasArray);
 
-  void edgetoHTML5Path(mp_graphic_object* body, QJsonArray& pathsArray);
-  void filltoHTML5Path(mp_gr_knot h, QJsonArray& pathArray);
+  void edgetoHTML5Path(const FlatOutline& outline, QJsonArray& pathsArray);
+  void filltoHTML5Path(const FlatOutline& outline, const FlatOutline::Contour& contour, QJsonArray& pathArray);
 
 private:
   OtLayout* m_otlayout;
@@ -24,43 +24,32 @@ extern "C"
 
 using namespace protobuf;
 
-static protobuf::PathElem* filltoHTML5Path(mp_gr_knot h, protobuf::Path& pathStream)
+static protobuf::PathElem* filltoHTML5Path(const FlatOutline& outline, const FlatOutline::Contour& contour, protobuf::Path& pathStream)
 {
 
-  if (!h) return nullptr;
-  mp_gr_knot p, q;
-
-
-
-  QJsonArray start;
-
   auto elem = pathStream.add_elems();
 
-  elem->add_points(h->x_coord);
-  elem->add_points(h->y_coord);
-
-  p = h;
-  do {
-    q = p->next;
+  elem->add_points(outline.x[contour.begin]);
+  elem->add_points(outline.y[contour.begin]);
 
+  for (uint32_t p = contour.begin; p < contour.end; p++) {
+    uint32_t q = outline.next(contour, p);
 
     elem = pathStream.add_elems();
 
-    elem->add_points(p->right_x);
-    elem->add_points(p->right_y);
-    elem->add_points(q->left_x);
-    elem->add_points(q->left_y);
-    elem->add_points(q->x_coord);
-    elem->add_points(q->y_coord);
-
-    p = q;
-  } while (p != h);
+    elem->add_points(outline.rightX[p]);
+    elem->add_points(outline.rightY[p]);
+    elem->add_points(outline.leftX[q]);
+    elem->add_points(outline.leftY[q]);
+    elem->add_points(outline.x[q]);
+    elem->add_points(outline.y[q]);
+  }
 
   return elem;
 
 }
 
-static void edgetoHTML5Path(mp_graphic_object* body, protobuf::Glyph& glyph, decltype  (&protobuf::Glyph::add_default_) func, bool isColored) {
+static void edgetoHTML5Path(const FlatOutline& outline, protobuf::Glyph& glyph, decltype  (&protobuf::Glyph::add_default_) func, bool isColored) {
 
 
   protobuf::Path* pathStream = nullptr;  
@@ -69,35 +58,19 @@ static void edgetoHTML5Path(mp_graphic_object* body, protobuf::Glyph& glyph, dec
     pathStream = (glyph.*func)();
   }
 
-  if (body) {
-    do {
-      switch (body->type)
-      {
-      case mp_fill_code: {
-
-        QJsonObject pathObject;
+  for (auto& contour : outline.contours) {
 
-        auto fillobject = (mp_fill_object*)body;
-
-        if (isColored) {
-          pathStream = (glyph.*func)();
-        }
+    if (isColored) {
+      pathStream = (glyph.*func)();
+    }
 
-        auto pathElem = filltoHTML5Path(fillobject->path_p, *pathStream);
+    auto pathElem = filltoHTML5Path(outline, contour, *pathStream);
 
-        if (isColored) {
-          pathStream->add_color(fillobject->color.a_val * 255);
-          pathStream->add_color(fillobject->color.b_val * 255);
-          pathStream->add_color(fillobject->color.c_val * 255);
-        }
-
-        break;
-      }
-      default:
-        break;
-      }
-
-    } while (body = body->next);
+    if (isColored) {
+      pathStream->add_color(contour.color[0] * 255);
+      pathStream->add_color(contour.color[1] * 255);
+      pathStream->add_color(contour.color[2] * 255);
+    }
   }
 }
 
@@ -123,7 +96,7 @@ void GenerateLayout::generateLayoutProtoBuf(int lineWidth, int scale) {
     glyphProto.add_bbox(glyph.bbox.urx);
     glyphProto.add_bbox(glyph.bbox.ury);
 
-    ::edgetoHTML5Path(glyph.copiedPath, glyphProto, &protobuf::Glyph::add_default_, isColored);
+    ::edgetoHTML5Path(glyph.outline(), glyphProto, &protobuf::Glyph::add_default_, isColored);
 
     const auto& ff = m_otlayout->expandableGlyphs.find(glyph.name);
 
@@ -145,7 +118,7 @@ void GenerateLayout::generateLayoutProtoBuf(int lineWidth, int scale) {
 
         auto alternate = glyph.getAlternate(parameters);
 
-        ::edgetoHTML5Path(alternate->copiedPath, glyphProto, &protobuf::Glyph::add_minleft, isColored);
+        ::edgetoHTML5Path(alternate->outline(), glyphProto, &protobuf::Glyph::add_minleft, isColored);
       }
 
       if (jj.maxLeft != 0) {
@@ -156,7 +129,7 @@ void GenerateLayout::generateLayoutProtoBuf(int lineWidth, int scale) {
 
         auto alternate = glyph.getAlternate(parameters);
 
-        ::edgetoHTML5Path(alternate->copiedPath, glyphProto, &protobuf::Glyph::add_maxleft, isColored);
+        ::edgetoHTML5Path(alternate->outline(), glyphProto, &protobuf::Glyph::add_maxleft, isColored);
       }
 
       if (jj.minRight != 0) {
@@ -167,7 +140,7 @@ void GenerateLayout::generateLayoutProtoBuf(int lineWidth, int scale) {
 
         auto alternate = glyph.getAlternate(parameters);
 
-        ::edgetoHTML5Path(alternate->copiedPath, glyphProto, &protobuf::Glyph::add_minright, isColored);
+        ::edgetoHTML5Path(alternate->outline(), glyphProto, &protobuf::Glyph::add_minright, isColored);
       }
 
       if (jj.maxRight != 0) {
@@ -178,7 +151,7 @@ void GenerateLayout::generateLayoutProtoBuf(int lineWidth, int scale) {
 
         auto alternate = glyph.getAlternate(parameters);        
 
-        ::edgetoHTML5Path(alternate->copiedPath, glyphProto, &protobuf::Glyph::add_maxright, isColored);
+        ::edgetoHTML5Path(alternate->outline(), glyphProto, &protobuf::Glyph::add_maxright, isColored);
       }
 
 
@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#include "AlternateCache.h"
+#include "GlyphVis.h"
+
+extern "C"
+{
+#include "mplibps.h"
+}
+
+AlternateCache::AlternateCache(size_t budget) : m_budget{ budget } {
+}
+
+AlternateCache::~AlternateCache() {
+  clear();
+}
+
+GlyphVis* AlternateCache::find(int glyphCode, const GlyphParameters& parameters) {
+
+  auto find = index.find({ glyphCode, parameters });
+
+  if (find == index.end()) {
+    return nullptr;
+  }
+
+  hits++;
+
+  auto entry = find->second;
+  if (entry != entries.begin()) {
+    entries.splice(entries.begin(), entries, entry);
+  }
+
+  return entry->glyph;
+}
+
+GlyphVis* AlternateCache::peek(int glyphCode, const GlyphParameters& parameters) const {
+
+  auto find = index.find({ glyphCode, parameters });
+
+  return find != index.end() ? find->second->glyph : nullptr;
+}
+
+bool AlternateCache::contains(int glyphCode, const GlyphParameters& parameters) const {
+  return index.find({ glyphCode, parameters }) != index.end();
+}
+
+std::pair<GlyphVis*, bool> AlternateCache::insert(int glyphCode, const GlyphParameters& parameters, GlyphVis* glyph, bool prefetched) {
+
+  Key key{ glyphCode, parameters };
+
+  auto find = index.find(key);
+
+  if (find != index.end()) {
+    return { find->second->glyph, false };
+  }
+
+  size_t size = estimateSize(glyph);
+
+  entries.push_front({ key, glyph, size });
+  index.insert({ key, entries.begin() });
+
+  m_bytes += size;
+
+  if (prefetched) {
+    this->prefetched++;
+  }
+  else {
+    misses++;
+  }
+
+  return { glyph, true };
+}
+
+size_t AlternateCache::trim() {
+
+  if (m_budget == 0) return 0;
+
+  size_t evicted = 0;
+
+  while (m_bytes > m_budget && !entries.empty()) {
+    auto& entry = entries.back();
+    m_bytes -= entry.size;
+    index.erase(entry.key);
+    delete entry.glyph;
+    entries.pop_back();
+    evicted++;
+  }
+
+  evictions += evicted;
+
+  return evicted;
+}
+
+void AlternateCache::clear() {
+  for (auto& entry : entries) {
+    delete entry.glyph;
+  }
+  entries.clear();
+  index.clear();
+  m_bytes = 0;
+}
+
+AlternateCache::Stats AlternateCache::stats() const {
+  Stats stats;
+  stats.hits = hits;
+  stats.misses = misses;
+  stats.prefetched = prefetched;
+  stats.evictions = evictions;
+  stats.entries = entries.size();
+  stats.bytes = m_bytes;
+  stats.budget = m_budget;
+  return stats;
+}
+
+void AlternateCache::resetStats() {
+  hits = 0;
+  misses = 0;
+  prefetched = 0;
+  evictions = 0;
+}
+
+void AlternateCache::forEach(const std::function<void(int glyphCode, const GlyphParameters& parameters, GlyphVis* glyph)>& function) const {
+  for (auto& entry : entries) {
+    function(entry.key.glyphCode, entry.key.parameters, entry.glyph);
+  }
+}
+
+void AlternateCache::remapGlyphCodes(const std::function<int(int)>& newCode) {
+  index.clear();
+  for (auto it = entries.begin(); it != entries.end(); ++it) {
+    it->key.glyphCode = newCode(it->key.glyphCode);
+    index.insert({ it->key, it });
+  }
+}
+
+size_t AlternateCache::estimateSize(const GlyphVis* glyph) {
+
+  if (glyph == nullptr) return 0;
+
+  // The estimate covers the glyph, its copied knots and fills, its flat outline and its painter path. Outlines shared with
+  // the alternate store are counted as well since the store keeps them for the glyphs in use.
+  auto& outline = glyph->outline();
+
+  size_t knots = outline.x.size();
+  size_t contours = outline.contours.size();
+
+  size_t size = sizeof(GlyphVis);
+  size += knots * sizeof(mp_gr_knot_data) + contours * sizeof(mp_fill_object);
+  size += knots * 6 * sizeof(double) + contours * sizeof(FlatOutline::Contour);
+#ifndef DIGITALKHATT_WEBLIB
+  size += glyph->path.elementCount() * sizeof(QPainterPath::Element);
+#endif
+  size += glyph->anchors.size() * (sizeof(GlyphVis::AnchorKey) + sizeof(GlyphVisAnchor));
+
+  return size;
+}
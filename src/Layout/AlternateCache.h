@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#pragma once
+
+#include <unordered_map>
+#include <list>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+#include "commontypes.h"
+
+class GlyphVis;
+
+/*
+  Cache of the temporary alternates (OtLayout::tempGlyphs) keyed by glyph code and parameters.
+
+  The cache owns its glyphs. Entries are kept in least recently used order with an estimate of their memory and trim
+  evicts the oldest ones until the estimate fits the budget, a budget of 0 disables eviction.
+  Eviction never happens on insert since callers hold the returned pointers while shaping : trim must only be called
+  when no alternate is in use, typically between two pages of a batch.
+  A lookup is only counted when it hits since a request is probed again once normalized (see OtLayout::getAlternate), a miss
+  is counted when the alternate built for it is inserted. Alternates inserted by prefetchAlternates are counted apart.
+  The cache is not synchronized, OtLayout guards it with alternateMutex. find promotes the entry and counts the hit so it
+  must be called with the lock held, peek does not change the cache and can run concurrently with other peeks, as
+  getAlternate does in the overlapping threads once the alternates are prefetched.
+*/
+class AlternateCache {
+public:
+
+  struct Stats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t prefetched = 0;
+    uint64_t evictions = 0;
+    size_t entries = 0;
+    size_t bytes = 0;
+    size_t budget = 0;
+  };
+
+  AlternateCache(size_t budget = 0);
+  ~AlternateCache();
+
+  AlternateCache(const AlternateCache&) = delete;
+  AlternateCache& operator=(const AlternateCache&) = delete;
+
+  GlyphVis* find(int glyphCode, const GlyphParameters& parameters);
+  GlyphVis* peek(int glyphCode, const GlyphParameters& parameters) const;
+  bool contains(int glyphCode, const GlyphParameters& parameters) const;
+  std::pair<GlyphVis*, bool> insert(int glyphCode, const GlyphParameters& parameters, GlyphVis* glyph, bool prefetched = false);
+
+  size_t trim();
+  void clear();
+
+  void setBudget(size_t budget) { m_budget = budget; }
+  size_t budget() const { return m_budget; }
+  size_t bytes() const { return m_bytes; }
+  size_t size() const { return entries.size(); }
+
+  Stats stats() const;
+  void resetStats();
+
+  void forEach(const std::function<void(int glyphCode, const GlyphParameters& parameters, GlyphVis* glyph)>& function) const;
+  void remapGlyphCodes(const std::function<int(int)>& newCode);
+
+  static size_t estimateSize(const GlyphVis* glyph);
+
+private:
+
+  struct Key {
+    int glyphCode;
+    GlyphParameters parameters;
+
+    bool operator==(const Key& r) const {
+      return glyphCode == r.glyphCode && parameters == r.parameters;
+    }
+  };
+
+  struct KeyHash {
+    size_t operator()(const Key& key) const {
+      return std::hash<GlyphParameters>::mix(std::hash<GlyphParameters>{}(key.parameters) ^ (uint64_t)(uint32_t)key.glyphCode);
+    }
+  };
+
+  struct Entry {
+    Key key;
+    GlyphVis* glyph;
+    size_t size;
+  };
+
+  using EntryList = std::list<Entry>;
+
+  // Most recently used first
+  EntryList entries;
+  std::unordered_map<Key, EntryList::iterator, KeyHash> index;
+
+  size_t m_budget;
+  size_t m_bytes = 0;
+
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t prefetched = 0;
+  uint64_t evictions = 0;
+};
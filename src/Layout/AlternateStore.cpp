@@ -0,0 +1,464 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#include "AlternateStore.h"
+#include "qcryptographichash.h"
+#include "qdatastream.h"
+#include "metafont.h"
+#include <cstring>
+#include <cmath>
+
+static const char storeMagic[8] = { 'V','M','F','A','L','T','0','1' };
+static const int digestSize = 20;
+static const qint64 headerSize = sizeof(storeMagic) + digestSize;
+// record = payload size + key digest + payload
+static const qint64 recordHeaderSize = sizeof(quint32) + digestSize;
+
+AlternateStore::AlternateStore(MP mp) : mp{ mp } {
+}
+
+AlternateStore::~AlternateStore() {
+  close();
+}
+
+QString AlternateStore::key(QString glyphName, GlyphParameters parameters, QString sourceCode, const QByteArray& glyphDigest) {
+  // Same formatting as Font::generateAlternate so the key reflects exactly what MetaPost sees
+  QString key = QString("%1|%2|%3|%4|%5|%6|%7")
+    .arg(glyphName)
+    .arg(parameters.lefttatweel)
+    .arg(parameters.righttatweel)
+    .arg(parameters.third)
+    .arg(parameters.fourth)
+    .arg(parameters.fifth)
+    .arg(parameters.scalex);
+
+  if (!sourceCode.isEmpty()) {
+    key += "|" + QCryptographicHash::hash(sourceCode.toUtf8(), QCryptographicHash::Sha1).toHex();
+  }
+
+  if (!glyphDigest.isEmpty()) {
+    key += "|" + glyphDigest.toHex();
+  }
+
+  return key;
+}
+
+QByteArray AlternateStore::digest(const QString& key) {
+  return QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1);
+}
+
+bool AlternateStore::open(QString fileName, QByteArray fingerprint) {
+
+  close();
+
+  std::lock_guard<std::mutex> guard(storeMutex);
+
+  lockFile = new QLockFile(fileName + ".lock");
+
+  if (!lockFile->tryLock(0)) {
+    delete lockFile;
+    lockFile = nullptr;
+    return false;
+  }
+
+  file.setFileName(fileName);
+
+  if (!file.open(QIODevice::ReadWrite)) {
+    delete lockFile;
+    lockFile = nullptr;
+    return false;
+  }
+
+  fileSize = file.size();
+
+  bool valid = fileSize >= headerSize;
+
+  if (valid) {
+    QByteArray header = file.read(headerSize);
+    valid = memcmp(header.constData(), storeMagic, sizeof(storeMagic)) == 0 && header.mid(sizeof(storeMagic)) == fingerprint;
+  }
+
+  if (!valid) {
+    // New file or font sources changed : start from an empty store
+    file.resize(0);
+    file.seek(0);
+    file.write(storeMagic, sizeof(storeMagic));
+    file.write(fingerprint.leftJustified(digestSize, '\0', true));
+    file.flush();
+    fileSize = headerSize;
+    return true;
+  }
+
+  if (!mapFile()) {
+    file.close();
+    delete lockFile;
+    lockFile = nullptr;
+    return false;
+  }
+
+  qint64 offset = headerSize;
+
+  while (offset + recordHeaderSize <= fileSize) {
+    quint32 payloadSize;
+    memcpy(&payloadSize, mapped + offset, sizeof(quint32));
+    if (offset + recordHeaderSize + payloadSize > fileSize) break;
+
+    QByteArray keyDigest((const char*)mapped + offset + sizeof(quint32), digestSize);
+    index.insert(keyDigest, offset);
+
+    offset += recordHeaderSize + payloadSize;
+  }
+
+  if (offset != fileSize) {
+    // Partially written record from an interrupted run
+    unmapFile();
+    file.resize(offset);
+    fileSize = offset;
+  }
+
+  return true;
+}
+
+void AlternateStore::close() {
+  std::lock_guard<std::mutex> guard(storeMutex);
+
+  for (auto alternate : loaded) {
+    freeAlternate(alternate);
+  }
+  loaded.clear();
+  index.clear();
+
+  unmapFile();
+
+  if (file.isOpen()) {
+    file.close();
+  }
+
+  delete lockFile;
+  lockFile = nullptr;
+
+  fileSize = 0;
+}
+
+bool AlternateStore::mapFile() {
+  if (mapped != nullptr && mappedSize == fileSize) return true;
+
+  unmapFile();
+
+  mapped = file.map(0, fileSize);
+
+  if (mapped == nullptr) return false;
+
+  mappedSize = fileSize;
+
+  return true;
+}
+
+void AlternateStore::unmapFile() {
+  if (mapped != nullptr) {
+    file.unmap(mapped);
+    mapped = nullptr;
+    mappedSize = 0;
+  }
+}
+
+mp_edge_object* AlternateStore::find(const QString& key) {
+
+  std::lock_guard<std::mutex> guard(storeMutex);
+
+  if (!file.isOpen()) return nullptr;
+
+  auto keyDigest = digest(key);
+
+  auto alternate = loaded.value(keyDigest);
+  if (alternate != nullptr) {
+    return alternate->edge;
+  }
+
+  auto offset = index.find(keyDigest);
+  if (offset == index.end()) {
+    return nullptr;
+  }
+
+  if (!mapFile()) {
+    return nullptr;
+  }
+
+  quint32 payloadSize;
+  memcpy(&payloadSize, mapped + offset.value(), sizeof(quint32));
+
+  if (offset.value() + recordHeaderSize + payloadSize > mappedSize) {
+    return nullptr;
+  }
+
+  alternate = deserialize(key, (const char*)mapped + offset.value() + recordHeaderSize, payloadSize);
+
+  if (alternate == nullptr) {
+    return nullptr;
+  }
+
+  loaded.insert(keyDigest, alternate);
+
+  return alternate->edge;
+}
+
+mp_edge_object* AlternateStore::insert(const QString& key, mp_edge_object* edge) {
+
+  std::lock_guard<std::mutex> guard(storeMutex);
+
+  if (!file.isOpen()) return nullptr;
+
+  auto keyDigest = digest(key);
+
+  if (loaded.contains(keyDigest)) {
+    return loaded.value(keyDigest)->edge;
+  }
+
+  QByteArray payload = serialize(key, edge);
+
+  auto alternate = deserialize(key, payload.constData(), payload.size());
+
+  if (alternate == nullptr) {
+    return nullptr;
+  }
+
+  loaded.insert(keyDigest, alternate);
+
+  if (!index.contains(keyDigest)) {
+    // Some platforms do not allow growing a mapped file
+    unmapFile();
+
+    quint32 payloadSize = payload.size();
+
+    file.seek(fileSize);
+    file.write((const char*)&payloadSize, sizeof(quint32));
+    file.write(keyDigest);
+    file.write(payload);
+    file.flush();
+
+    index.insert(keyDigest, fileSize);
+
+    fileSize += recordHeaderSize + payloadSize;
+  }
+
+  return alternate->edge;
+}
+
+QByteArray AlternateStore::serialize(const QString& key, mp_edge_object* edge) {
+
+  QByteArray payload;
+  QDataStream out(&payload, QIODevice::WriteOnly);
+
+  out.setFloatingPointPrecision(QDataStream::DoublePrecision);
+
+  out << key;
+  out << QByteArray(edge->charname) << QByteArray(edge->originalglyph) << QByteArray(edge->coloredglyph);
+  out << (qint32)edge->charcode << (qint32)edge->glyphtype;
+  out << edge->minx << edge->miny << edge->maxx << edge->maxy;
+  out << edge->width << edge->height << edge->depth << edge->ital_corr;
+  out << edge->lefttatweel << edge->charlt << edge->charrt;
+  out << edge->xleftanchor << edge->yleftanchor << edge->xrightanchor << edge->yrightanchor;
+  out << edge->xpart << edge->ypart;
+
+  out << (qint32)edge->numAnchors;
+  for (int i = 0; i < edge->numAnchors; i++) {
+    auto& anchor = edge->anchors[i];
+    out << QByteArray(anchor.anchorName) << (qint32)anchor.type << (qint32)anchor.x << (qint32)anchor.y;
+  }
+
+  // Only filled outlines are kept, the same way Font::copyEdgeBody does
+  qint32 nbObjects = 0;
+  for (auto body = edge->body; body; body = body->next) {
+    if (body->type == mp_fill_code || body->type == mp_stroked_code) nbObjects++;
+  }
+
+  out << nbObjects;
+
+  for (auto body = edge->body; body; body = body->next) {
+    mp_gr_knot path;
+    mp_color color;
+    unsigned char color_model;
+    if (body->type == mp_fill_code) {
+      auto object = (mp_fill_object*)body;
+      path = object->path_p;
+      color = object->color;
+      color_model = object->color_model;
+    }
+    else if (body->type == mp_stroked_code) {
+      auto object = (mp_stroked_object*)body;
+      path = object->path_p;
+      color = object->color;
+      color_model = object->color_model;
+    }
+    else {
+      continue;
+    }
+
+    out << (quint8)(color_model == mp_rgb_model ? mp_rgb_model : mp_no_model);
+    out << color.a_val << color.b_val << color.c_val << color.d_val;
+
+    qint32 nbKnots = 0;
+    if (path) {
+      auto p = path;
+      do {
+        nbKnots++;
+        p = p->next;
+      } while (p != path);
+    }
+
+    out << nbKnots;
+
+    if (path) {
+      auto p = path;
+      do {
+        out << p->x_coord << p->y_coord << p->left_x << p->left_y << p->right_x << p->right_y << (quint16)p->data.types.left_type;
+        p = p->next;
+      } while (p != path);
+    }
+  }
+
+  return payload;
+}
+
+AlternateStore::StoredAlternate* AlternateStore::deserialize(const QString& key, const char* data, qint64 size) {
+
+  QByteArray payload = QByteArray::fromRawData(data, size);
+  QDataStream in(payload);
+
+  in.setFloatingPointPrecision(QDataStream::DoublePrecision);
+
+  QString storedKey;
+
+  in >> storedKey;
+
+  if (storedKey != key) {
+    // digest collision
+    return nullptr;
+  }
+
+  auto alternate = new StoredAlternate();
+
+  mp_edge_object* edge = (mp_edge_object*)mp_xmalloc(mp, 1, sizeof(mp_edge_object));
+  memset(edge, 0, sizeof(mp_edge_object));
+
+  alternate->edge = edge;
+
+  qint32 charcode, glyphtype, numAnchors, nbObjects;
+
+  in >> alternate->charname >> alternate->originalglyph >> alternate->coloredglyph;
+  in >> charcode >> glyphtype;
+  in >> edge->minx >> edge->miny >> edge->maxx >> edge->maxy;
+  in >> edge->width >> edge->height >> edge->depth >> edge->ital_corr;
+  in >> edge->lefttatweel >> edge->charlt >> edge->charrt;
+  in >> edge->xleftanchor >> edge->yleftanchor >> edge->xrightanchor >> edge->yrightanchor;
+  in >> edge->xpart >> edge->ypart;
+
+  edge->charcode = charcode;
+  edge->glyphtype = glyphtype;
+  edge->charname = alternate->charname.data();
+  edge->originalglyph = alternate->originalglyph.data();
+  edge->coloredglyph = alternate->coloredglyph.isEmpty() ? nullptr : alternate->coloredglyph.data();
+
+  in >> numAnchors;
+
+  if (numAnchors < 0 || numAnchors > (qint32)(sizeof(edge->anchors) / sizeof(edge->anchors[0]))) {
+    mp_xfree(edge);
+    delete alternate;
+    return nullptr;
+  }
+
+  alternate->anchorNames.resize(numAnchors);
+
+  edge->numAnchors = numAnchors;
+  for (int i = 0; i < numAnchors; i++) {
+    qint32 type, x, y;
+    in >> alternate->anchorNames[i] >> type >> x >> y;
+    edge->anchors[i] = { alternate->anchorNames[i].data(), type, x, y };
+  }
+
+  in >> nbObjects;
+
+  mp_graphic_object* last = nullptr;
+
+  for (int i = 0; i < nbObjects; i++) {
+    quint8 color_model;
+    qint32 nbKnots;
+
+    mp_fill_object* object = (mp_fill_object*)mp_new_graphic_object(mp, mp_fill_code);
+
+    in >> color_model;
+    in >> object->color.a_val >> object->color.b_val >> object->color.c_val >> object->color.d_val;
+    object->color_model = color_model;
+
+    in >> nbKnots;
+
+    mp_gr_knot first = nullptr;
+    mp_gr_knot current = nullptr;
+
+    for (int k = 0; k < nbKnots; k++) {
+      mp_gr_knot knot = (mp_gr_knot)mp_xmalloc(mp, 1, sizeof(struct mp_gr_knot_data));
+      memset(knot, 0, sizeof(struct mp_gr_knot_data));
+      quint16 left_type;
+      in >> knot->x_coord >> knot->y_coord >> knot->left_x >> knot->left_y >> knot->right_x >> knot->right_y >> left_type;
+      knot->data.types.left_type = left_type;
+
+      if (current == nullptr) {
+        first = knot;
+      }
+      else {
+        current->next = knot;
+      }
+      current = knot;
+    }
+
+    if (current != nullptr) {
+      current->next = first;
+    }
+
+    object->path_p = first;
+
+    if (last == nullptr) {
+      edge->body = (mp_graphic_object*)object;
+    }
+    else {
+      last->next = (mp_graphic_object*)object;
+    }
+    last = (mp_graphic_object*)object;
+  }
+
+  if (in.status() != QDataStream::Ok) {
+    freeAlternate(alternate);
+    return nullptr;
+  }
+
+  return alternate;
+}
+
+void AlternateStore::freeAlternate(StoredAlternate* alternate) {
+  if (alternate->edge != nullptr) {
+    mp_graphic_object* p = alternate->edge->body;
+    while (p != nullptr) {
+      mp_graphic_object* q = p->next;
+      mp_gr_toss_object(p);
+      p = q;
+    }
+    mp_xfree(alternate->edge);
+  }
+  delete alternate;
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <QHash>
+#include <QFile>
+#include <QLockFile>
+#include <vector>
+#include <mutex>
+
+#include "commontypes.h"
+
+typedef struct MP_instance* MP;
+struct mp_edge_object;
+
+/*
+  Persistent store of the alternates generated by MetaPost.
+
+  Records are content addressed : the key is built from the glyph name, the parameters as they are passed to MetaPost, the
+  source of auto-generated glyphs and the digest of the glyph source executed by MetaPost, so that a glyph edited in
+  memory gets new records. The whole store is invalidated when the fingerprint of the font sources changes.
+  The file is memory mapped and an alternate is rebuilt from its record as an mp_edge_object without running MetaPost.
+  Rebuilt edges are owned by the store and stay valid until it is closed so GlyphVis can share their body.
+  The file is locked while the store is open : another store of the same file, such as the one of a layout built for an
+  export, fails to open and the layout generates its alternates without storing them.
+*/
+class AlternateStore {
+public:
+
+  AlternateStore(MP mp);
+  ~AlternateStore();
+
+  bool open(QString fileName, QByteArray fingerprint);
+  void close();
+  bool isOpen() const { return file.isOpen(); }
+
+  static QString key(QString glyphName, GlyphParameters parameters, QString sourceCode, const QByteArray& glyphDigest);
+
+  mp_edge_object* find(const QString& key);
+  mp_edge_object* insert(const QString& key, mp_edge_object* edge);
+
+private:
+
+  struct StoredAlternate {
+    mp_edge_object* edge = nullptr;
+    QByteArray charname;
+    QByteArray originalglyph;
+    QByteArray coloredglyph;
+    std::vector<QByteArray> anchorNames;
+  };
+
+  static QByteArray digest(const QString& key);
+  static QByteArray serialize(const QString& key, mp_edge_object* edge);
+  StoredAlternate* deserialize(const QString& key, const char* data, qint64 size);
+  void freeAlternate(StoredAlternate* alternate);
+  bool mapFile();
+  void unmapFile();
+
+  MP mp;
+  QFile file;
+  QLockFile* lockFile = nullptr;
+  uchar* mapped = nullptr;
+  qint64 mappedSize = 0;
+  qint64 fileSize = 0;
+
+  QHash<QByteArray, qint64> index;
+  QHash<QByteArray, StoredAlternate*> loaded;
+
+  std::mutex storeMutex;
+};
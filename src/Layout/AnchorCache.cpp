@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#include "AnchorCache.h"
+
+#include <mutex>
+
+bool AnchorCache::find(int glyphCode, int kind, const GlyphParameters& parameters, uint64_t generation, std::optional<QPoint>& anchor) const {
+
+  std::shared_lock<std::shared_mutex> lock(mutex);
+
+  if (generation != this->generation) {
+    return false;
+  }
+
+  auto find = anchors.find({ glyphCode, kind, parameters });
+
+  if (find == anchors.end()) {
+    return false;
+  }
+
+  anchor = find->second;
+
+  return true;
+}
+
+void AnchorCache::insert(int glyphCode, int kind, const GlyphParameters& parameters, uint64_t generation, const std::optional<QPoint>& anchor) {
+
+  std::unique_lock<std::shared_mutex> lock(mutex);
+
+  if (generation != this->generation) {
+    anchors.clear();
+    this->generation = generation;
+  }
+
+  anchors.insert({ { glyphCode, kind, parameters }, anchor });
+}
+
+void AnchorCache::clear() {
+  std::unique_lock<std::shared_mutex> lock(mutex);
+  anchors.clear();
+}
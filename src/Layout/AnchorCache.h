@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#pragma once
+
+#include <unordered_map>
+#include <optional>
+#include <shared_mutex>
+#include <cstdint>
+
+#include <QPoint>
+
+#include "commontypes.h"
+
+/*
+  Anchors computed by a cursive or mark to base subtable for the GPOS callbacks, keyed by the glyph code, the kind of
+  anchor (entry, exit or the mark class) and the parameters of the glyph, so that the alternate and its anchors are only
+  looked up once by name.
+
+  The anchors depend on the parameters of the subtable, the owner clears the cache when they change. They also depend on
+  the outlines of the alternates : an entry of a previous generation (see OtLayout::clearAlternates) is never returned.
+  The cache is shared by the sessions of concurrent threads. A copied subtable starts with an empty cache.
+*/
+class AnchorCache {
+public:
+
+  AnchorCache() = default;
+  AnchorCache(const AnchorCache&) {}
+  AnchorCache& operator=(const AnchorCache&) {
+    clear();
+    return *this;
+  }
+
+  bool find(int glyphCode, int kind, const GlyphParameters& parameters, uint64_t generation, std::optional<QPoint>& anchor) const;
+  void insert(int glyphCode, int kind, const GlyphParameters& parameters, uint64_t generation, const std::optional<QPoint>& anchor);
+
+  void clear();
+
+private:
+
+  struct Key {
+    int glyphCode;
+    int kind;
+    GlyphParameters parameters;
+
+    bool operator==(const Key& r) const {
+      return glyphCode == r.glyphCode && kind == r.kind && parameters == r.parameters;
+    }
+  };
+
+  struct KeyHash {
+    size_t operator()(const Key& key) const {
+      uint64_t code = (uint64_t)(uint32_t)key.glyphCode | (uint64_t)(uint32_t)key.kind << 32;
+      return std::hash<GlyphParameters>::mix(std::hash<GlyphParameters>{}(key.parameters) ^ code);
+    }
+  };
+
+  std::unordered_map<Key, std::optional<QPoint>, KeyHash> anchors;
+  uint64_t generation = 0;
+  mutable std::shared_mutex mutex;
+};
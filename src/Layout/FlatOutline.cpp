@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#include "FlatOutline.h"
+
+extern "C"
+{
+#include "mplibps.h"
+}
+
+#include <algorithm>
+
+FlatOutline FlatOutline::fromBody(mp_graphic_object* body) {
+
+  FlatOutline outline;
+
+  for (auto object = body; object != nullptr; object = object->next) {
+    if (object->type != mp_fill_code) continue;
+
+    auto fillobject = (mp_fill_object*)object;
+    mp_gr_knot h = fillobject->path_p;
+
+    if (h == nullptr) continue;
+
+    Contour contour;
+    contour.begin = (uint32_t)outline.x.size();
+    contour.closed = h->data.types.left_type != mp_endpoint;
+    contour.hasColor = fillobject->color_model == mp_rgb_model;
+    contour.color[0] = contour.hasColor ? fillobject->color.a_val : 0;
+    contour.color[1] = contour.hasColor ? fillobject->color.b_val : 0;
+    contour.color[2] = contour.hasColor ? fillobject->color.c_val : 0;
+
+    mp_gr_knot p = h;
+    do {
+      outline.x.push_back(p->x_coord);
+      outline.y.push_back(p->y_coord);
+      outline.leftX.push_back(p->left_x);
+      outline.leftY.push_back(p->left_y);
+      outline.rightX.push_back(p->right_x);
+      outline.rightY.push_back(p->right_y);
+      p = p->next;
+    } while (p != h);
+
+    contour.end = (uint32_t)outline.x.size();
+
+    outline.contours.push_back(contour);
+  }
+
+  outline.computeBounds();
+
+  return outline;
+}
+
+void FlatOutline::transform(double xx, double xy, double yx, double yy, double dx, double dy) {
+
+  auto apply = [&](std::vector<double>& xs, std::vector<double>& ys) {
+    double* px = xs.data();
+    double* py = ys.data();
+    size_t size = xs.size();
+    for (size_t i = 0; i < size; i++) {
+      double tx = px[i];
+      double ty = py[i];
+      px[i] = xx * tx + xy * ty + dx;
+      py[i] = yx * tx + yy * ty + dy;
+    }
+  };
+
+  apply(x, y);
+  apply(leftX, leftY);
+  apply(rightX, rightY);
+
+  computeBounds();
+}
+
+void FlatOutline::computeBounds() {
+
+  bounds = Bounds{};
+
+  if (x.empty()) return;
+
+  auto minmax = [](const std::vector<double>& values, double& min, double& max) {
+    auto result = std::minmax_element(values.begin(), values.end());
+    min = std::min(min, *result.first);
+    max = std::max(max, *result.second);
+  };
+
+  bounds.minX = bounds.maxX = x[0];
+  bounds.minY = bounds.maxY = y[0];
+
+  minmax(x, bounds.minX, bounds.maxX);
+  minmax(leftX, bounds.minX, bounds.maxX);
+  minmax(rightX, bounds.minX, bounds.maxX);
+  minmax(y, bounds.minY, bounds.maxY);
+  minmax(leftY, bounds.minY, bounds.maxY);
+  minmax(rightY, bounds.minY, bounds.maxY);
+}
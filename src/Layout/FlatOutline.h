@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+struct mp_graphic_object;
+
+/*
+  Immutable flat copy of the filled contours of a glyph, built once per GlyphVis.
+  Knots are stored as separate contiguous arrays so exporters and collision code do not walk the circular mp_gr_knot
+  lists and transforms can be vectorized. Coordinates stay in double since they are written as is in the exported
+  files.
+*/
+class FlatOutline {
+public:
+
+  struct Bounds {
+    double minX = 0;
+    double minY = 0;
+    double maxX = 0;
+    double maxY = 0;
+  };
+
+  struct Contour {
+    uint32_t begin;
+    uint32_t end;
+    bool closed;
+    bool hasColor;
+    double color[3];
+  };
+
+  static FlatOutline fromBody(mp_graphic_object* body);
+
+  // Knot i has the on-curve point (x, y), the control point (leftX, leftY) of the incoming segment and the control point (rightX, rightY)
+  // of the outgoing segment. The knots of a contour are in [begin, end) and the last one connects to the first.
+  std::vector<double> x;
+  std::vector<double> y;
+  std::vector<double> leftX;
+  std::vector<double> leftY;
+  std::vector<double> rightX;
+  std::vector<double> rightY;
+
+  std::vector<Contour> contours;
+
+  // Bounding box of all the on-curve and control points, empty outlines have a zero box
+  Bounds bounds;
+
+  bool isEmpty() const {
+    return contours.empty();
+  }
+
+  uint32_t next(const Contour& contour, uint32_t knot) const {
+    return knot + 1 == contour.end ? contour.begin : knot + 1;
+  }
+
+  // Maps (x, y) to (xx * x + xy * y + dx, yx * x + yy * y + dy)
+  void transform(double xx, double xy, double yx, double yy, double dx, double dy);
+
+private:
+  void computeBounds();
+};
@@ -27,6 +27,7 @@
 #endif
 
 #include "automedina/automedina.h"
+#include "ShapingSession.h"
 #include <cmath>
 #include "metafont.h";
 
@@ -40,7 +41,11 @@ GlyphVis::GlyphVis() {
 
 GlyphVis::~GlyphVis()
 {
-  if (copiedPath && isCopiedPath) {
+  releaseCopiedPath();
+}
+void GlyphVis::releaseCopiedPath() {
+  // Paths allocated from an arena are released with it
+  if (copiedPath && isCopiedPath && !outlineArena) {
     mp_graphic_object* p, * q;
 
     p = copiedPath;
@@ -52,6 +57,8 @@ GlyphVis::~GlyphVis()
 
   }
 
+  copiedPath = nullptr;
+  outlineArena.reset();
 }
 GlyphVis::GlyphVis(const GlyphVis& other) {
   name = other.name;
@@ -81,8 +88,10 @@ GlyphVis::GlyphVis(const GlyphVis& other) {
 
   copiedPath = other.copiedPath;
   isCopiedPath = other.isCopiedPath;
+  outlineArena = other.outlineArena;
+  flatOutline = other.flatOutline;
 
-  if (other.copiedPath && isCopiedPath) {
+  if (other.copiedPath && isCopiedPath && !outlineArena) {
     copiedPath = m_otLayout->font->copyEdgeBody(other.copiedPath);
   }
 
@@ -117,6 +126,9 @@ GlyphType GlyphVis::getGlypfType() {
 
 GlyphVis* GlyphVis::getAlternate(GlyphParameters parameters) {
   if (m_otLayout != nullptr && (parameters.lefttatweel != 0.0 || parameters.righttatweel != 0.0 || parameters.scalex != 0)) {
+    if (auto session = ShapingSession::current()) {
+      return session->getAlternate(charcode, parameters);
+    }
     return m_otLayout->getAlternate(charcode, parameters);
   }
   else {
@@ -149,6 +161,8 @@ GlyphVis::GlyphVis(GlyphVis&& other)
 
   copiedPath = other.copiedPath;
   isCopiedPath = other.isCopiedPath;
+  outlineArena = std::move(other.outlineArena);
+  flatOutline = std::move(other.flatOutline);
 
   isdirty = other.isdirty;
   m_edge = other.m_edge;
@@ -165,6 +179,8 @@ GlyphVis::GlyphVis(GlyphVis&& other)
 GlyphVis& GlyphVis::operator=(const GlyphVis& other) {
   if (this == &other) return *this;
 
+  releaseCopiedPath();
+
   name = other.name;
   originalglyph = other.originalglyph;
   coloredglyph = other.coloredglyph;
@@ -192,8 +208,10 @@ GlyphVis& GlyphVis::operator=(const GlyphVis& other) {
 
   copiedPath = other.copiedPath;
   isCopiedPath = other.isCopiedPath;
+  outlineArena = other.outlineArena;
+  flatOutline = other.flatOutline;
 
-  if (other.copiedPath && isCopiedPath) {
+  if (other.copiedPath && isCopiedPath && !outlineArena) {
     copiedPath = m_otLayout->font->copyEdgeBody(other.copiedPath);
   }
 
@@ -267,13 +285,16 @@ GlyphVis::GlyphVis(OtLayout* otLayout, mp_edge_object* edge, bool copyPath) {
   auto body = m_edge != nullptr ? m_edge->body : nullptr;
   if (copyPath) {
     isCopiedPath = true;
-    copiedPath = m_otLayout->font->copyEdgeBody(body);
+    outlineArena = m_otLayout->outlineArena;
+    copiedPath = m_otLayout->font->copyEdgeBody(body, outlineArena.get());
   }
   else {
     isCopiedPath = false;
     this->copiedPath = body;
   }
 
+  flatOutline = std::make_shared<const FlatOutline>(FlatOutline::fromBody(copiedPath));
+
 
   for (int i = 0; i < m_edge->numAnchors; i++) {
     AnchorPoint anchor = m_edge->anchors[i];
@@ -284,6 +305,11 @@ GlyphVis::GlyphVis(OtLayout* otLayout, mp_edge_object* edge, bool copyPath) {
 
 }
 
+const FlatOutline& GlyphVis::outline() const {
+  static const FlatOutline empty;
+  return flatOutline ? *flatOutline : empty;
+}
+
 bool GlyphVis::conatinsAnchor(QString name, AnchorType type) {
   return anchors.contains({ name,type });
 }
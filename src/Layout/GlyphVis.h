@@ -30,7 +30,9 @@
 #endif
 #include "qmap.h"
 #include <unordered_map>
+#include <memory>
 #include "OtLayout.h"
+#include "FlatOutline.h"
 
 extern "C"
 {
@@ -39,6 +41,7 @@ extern "C"
 
 
 class OtLayout;
+class OutlineArena;
 struct mp_edge_object;
 typedef struct mp_gr_knot_data* mp_gr_knot;
 class QPainterPath;
@@ -62,6 +65,8 @@ enum class  GlyphType {
 class  GlyphVis {
   friend class MyQPdfEnginePrivate;
   friend class ExportToHTML;
+  friend class OutlineInterpolator;
+  friend class OtLayout;
 public:
   struct BBox {
     double llx = 0;
@@ -124,6 +129,9 @@ public:
     return m_edge;
   }
 
+  // Flat copy of the filled contours of copiedPath, shared by the copies of the glyph
+  const FlatOutline& outline() const;
+
   GlyphType getGlypfType();
 
   bool isColored();
@@ -145,6 +153,11 @@ private:
   mp_edge_object* m_edge = nullptr;
   OtLayout* m_otLayout = nullptr;
   bool isCopiedPath = false;
+  // When set the copied path lives in the arena and is shared by the copies of the glyph
+  std::shared_ptr<OutlineArena> outlineArena;
+  std::shared_ptr<const FlatOutline> flatOutline;
+
+  void releaseCopiedPath();
 
 
 
@@ -0,0 +1,367 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#include "JustificationStore.h"
+#include "OtLayout.h"
+#include "GlyphVis.h"
+#include "font.hpp"
+#include "qcryptographichash.h"
+#include "qdatastream.h"
+#include "qsavefile.h"
+#include <algorithm>
+#include <cstring>
+
+static const char storeMagic[8] = { 'V','M','F','J','S','T','0','1' };
+static const qint64 headerSize = sizeof(storeMagic);
+
+using Hash = std::hash<GlyphParameters>;
+
+JustificationStore::~JustificationStore() {
+  close();
+}
+
+QString JustificationStore::key(const QString& text, double desiredWidth, double spaceWidth, int justType, int justStyle) {
+  return QString("%1|%2|%3|%4|%5")
+    .arg(text)
+    .arg(QString::number(desiredWidth, 'g', 17))
+    .arg(QString::number(spaceWidth, 'g', 17))
+    .arg(justType)
+    .arg(justStyle);
+}
+
+bool JustificationStore::open(QString fileName) {
+
+  close();
+
+  std::lock_guard<std::mutex> guard(storeMutex);
+
+  lockFile = new QLockFile(fileName + ".lock");
+
+  if (!lockFile->tryLock(0)) {
+    delete lockFile;
+    lockFile = nullptr;
+    return false;
+  }
+
+  file.setFileName(fileName);
+
+  if (!file.open(QIODevice::ReadWrite)) {
+    delete lockFile;
+    lockFile = nullptr;
+    return false;
+  }
+
+  QByteArray data = file.readAll();
+
+  if (data.size() < headerSize || memcmp(data.constData(), storeMagic, sizeof(storeMagic)) != 0) {
+    // New file or other format : start from an empty store
+    file.resize(0);
+    file.seek(0);
+    file.write(storeMagic, sizeof(storeMagic));
+    file.flush();
+    return true;
+  }
+
+  qint64 offset = headerSize;
+
+  while (offset + (qint64)sizeof(quint32) <= data.size()) {
+    quint32 payloadSize;
+    memcpy(&payloadSize, data.constData() + offset, sizeof(quint32));
+    if (offset + (qint64)sizeof(quint32) + payloadSize > data.size()) break;
+
+    QString key;
+    Record record;
+
+    if (!deserialize(QByteArray::fromRawData(data.constData() + offset + sizeof(quint32), payloadSize), key, record)) break;
+
+    if (records.contains(key)) {
+      replaced++;
+    }
+
+    records.insert(key, record);
+
+    offset += sizeof(quint32) + payloadSize;
+  }
+
+  if (offset != data.size()) {
+    // Partially written record from an interrupted run
+    file.resize(offset);
+  }
+
+  if (replaced > records.size()) {
+    compact();
+  }
+
+  if (!file.isOpen()) {
+    records.clear();
+    delete lockFile;
+    lockFile = nullptr;
+    return false;
+  }
+
+  file.seek(file.size());
+
+  return true;
+}
+
+void JustificationStore::close() {
+  std::lock_guard<std::mutex> guard(storeMutex);
+
+  records.clear();
+  replaced = 0;
+
+  if (file.isOpen()) {
+    file.close();
+  }
+
+  delete lockFile;
+  lockFile = nullptr;
+}
+
+bool JustificationStore::compact() {
+
+  QSaveFile saveFile(file.fileName());
+
+  if (!saveFile.open(QIODevice::WriteOnly)) {
+    return false;
+  }
+
+  saveFile.write(storeMagic, sizeof(storeMagic));
+
+  for (auto it = records.cbegin(); it != records.cend(); ++it) {
+    QByteArray payload = serialize(it.key(), it.value());
+    quint32 payloadSize = payload.size();
+    saveFile.write((const char*)&payloadSize, sizeof(quint32));
+    saveFile.write(payload);
+  }
+
+  file.close();
+
+  bool saved = saveFile.commit();
+
+  replaced = 0;
+
+  return file.open(QIODevice::ReadWrite) && saved;
+}
+
+void JustificationStore::validate(const QVector<QByteArray>& tables) {
+
+  std::lock_guard<std::mutex> guard(storeMutex);
+
+  bool same = tables.size() == this->tables.size();
+
+  for (int i = 0; same && i < tables.size(); i++) {
+    // The tables rebuilt without change share their data with the previous ones
+    same = tables[i].constData() == this->tables[i].constData() || tables[i] == this->tables[i];
+  }
+
+  if (same) return;
+
+  this->tables = tables;
+
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+  for (auto& table : tables) {
+    hash.addData(table);
+  }
+
+  auto digest = hash.result();
+
+  memcpy(&tablesDigest, digest.constData(), sizeof(tablesDigest));
+}
+
+quint64 JustificationStore::sourceDigest(const OtLayout& layout, const QString& name) const {
+
+  if (layout.font == nullptr) {
+    return 0;
+  }
+
+  // The digest of the source executed by MetaPost, Glyph::source cannot be called from the shaping threads
+  auto digest = layout.font->glyphSourceDigest(name);
+
+  quint64 ret = 0;
+  memcpy(&ret, digest.constData(), std::min((size_t)digest.size(), sizeof(ret)));
+
+  return ret;
+}
+
+quint64 JustificationStore::fingerprint(const OtLayout& layout, const QVector<quint16>& glyphs) const {
+
+  uint64_t h = Hash::mix(tablesDigest ^ (layout.applyJustification | layout.useNormAxisValues << 1));
+
+  for (auto code : glyphs) {
+
+    h = Hash::mix(h ^ code);
+
+    const GlyphVis* glyph = nullptr;
+    const ValueLimits* limits = nullptr;
+
+    if (auto info = layout.glyphInfo(code)) {
+      glyph = info->glyph;
+      limits = info->limits;
+    }
+    else {
+      auto name = layout.glyphNamePerCode.value(code);
+      auto find = layout.glyphs.find(name);
+      if (find != layout.glyphs.end()) {
+        glyph = &find.value();
+      }
+      auto expandable = layout.expandableGlyphs.find(name);
+      if (expandable != layout.expandableGlyphs.end()) {
+        limits = &expandable->second;
+      }
+    }
+
+    if (glyph == nullptr) {
+      // Removed glyph
+      h = Hash::mix(h ^ 1);
+      continue;
+    }
+
+    h = Hash::mix(h ^ sourceDigest(layout, glyph->originalglyph.isEmpty() ? glyph->name : glyph->originalglyph));
+
+    for (double value : { glyph->width, glyph->height, glyph->depth, glyph->charlt, glyph->charrt,
+      glyph->bbox.llx, glyph->bbox.lly, glyph->bbox.urx, glyph->bbox.ury }) {
+      h = Hash::mix(h ^ Hash::quantize(value));
+    }
+
+    for (auto anchor = glyph->anchors.cbegin(); anchor != glyph->anchors.cend(); ++anchor) {
+      h = Hash::mix(h ^ qHash(anchor.key().name) ^ ((uint64_t)anchor.key().type << 32));
+      h = Hash::mix(h ^ (uint32_t)anchor.value().anchor.x() ^ ((uint64_t)(uint32_t)anchor.value().anchor.y() << 32));
+    }
+
+    if (limits != nullptr) {
+      for (double value : { limits->minLeft, limits->maxLeft, limits->minRight, limits->maxRight }) {
+        h = Hash::mix(h ^ Hash::quantize(value));
+      }
+    }
+  }
+
+  return h;
+}
+
+bool JustificationStore::find(const QString& key, const OtLayout& layout, JustResultByLine& result) {
+
+  std::lock_guard<std::mutex> guard(storeMutex);
+
+  if (!file.isOpen()) return false;
+
+  auto find = records.find(key);
+
+  if (find == records.end() || find->fingerprint != fingerprint(layout, find->glyphs)) {
+    return false;
+  }
+
+  result = find->result;
+
+  return true;
+}
+
+void JustificationStore::insert(const QString& key, const OtLayout& layout, const JustResultByLine& result, QVector<quint16> glyphs) {
+
+  std::sort(glyphs.begin(), glyphs.end());
+  glyphs.erase(std::unique(glyphs.begin(), glyphs.end()), glyphs.end());
+
+  std::lock_guard<std::mutex> guard(storeMutex);
+
+  if (!file.isOpen()) return;
+
+  Record record{ fingerprint(layout, glyphs), glyphs, result };
+
+  if (records.contains(key)) {
+    replaced++;
+  }
+
+  records.insert(key, record);
+
+  QByteArray payload = serialize(key, record);
+  quint32 payloadSize = payload.size();
+
+  file.write((const char*)&payloadSize, sizeof(quint32));
+  file.write(payload);
+  file.flush();
+}
+
+static void writeFeatures(QDataStream& out, const std::vector<TextFontFeatures>& features) {
+  out << (qint32)features.size();
+  for (auto& feature : features) {
+    out << feature.name << (qint32)feature.value;
+  }
+}
+
+static void readFeatures(QDataStream& in, std::vector<TextFontFeatures>& features) {
+  qint32 count;
+  in >> count;
+  for (int i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+    QString name;
+    qint32 value;
+    in >> name >> value;
+    features.push_back({ name, value });
+  }
+}
+
+QByteArray JustificationStore::serialize(const QString& key, const Record& record) {
+
+  QByteArray payload;
+  QDataStream out(&payload, QIODevice::WriteOnly);
+
+  out.setFloatingPointPrecision(QDataStream::DoublePrecision);
+
+  auto& result = record.result;
+
+  out << key << record.fingerprint << record.glyphs;
+  out << (double)result.sclxAxis << result.simpleSpacing << result.ayaSpacing << result.xScale;
+
+  writeFeatures(out, result.globalFeatures);
+
+  out << (qint32)result.fontFeatures.size();
+  for (auto& charFeatures : result.fontFeatures) {
+    out << (qint32)charFeatures.first;
+    writeFeatures(out, charFeatures.second);
+  }
+
+  return payload;
+}
+
+bool JustificationStore::deserialize(const QByteArray& payload, QString& key, Record& record) {
+
+  QDataStream in(payload);
+
+  in.setFloatingPointPrecision(QDataStream::DoublePrecision);
+
+  auto& result = record.result;
+
+  double sclxAxis;
+
+  in >> key >> record.fingerprint >> record.glyphs;
+  in >> sclxAxis >> result.simpleSpacing >> result.ayaSpacing >> result.xScale;
+
+  result.sclxAxis = sclxAxis;
+
+  readFeatures(in, result.globalFeatures);
+
+  qint32 count;
+  in >> count;
+  for (int i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+    qint32 index;
+    in >> index;
+    readFeatures(in, result.fontFeatures[index]);
+  }
+
+  return in.status() == QDataStream::Ok;
+}
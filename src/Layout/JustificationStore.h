@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <QHash>
+#include <QVector>
+#include <QFile>
+#include <QLockFile>
+#include <vector>
+#include <map>
+#include <mutex>
+
+class OtLayout;
+
+struct TextFontFeatures {
+  QString name;
+  int value;
+};
+
+struct JustResultByLine {
+  float sclxAxis = 0;
+  std::vector<TextFontFeatures> globalFeatures = {};
+  std::map<int, std::vector<TextFontFeatures>> fontFeatures = {}; /* FontFeatures by character index in the line */
+  double simpleSpacing;
+  double ayaSpacing;
+  double xScale;
+};
+
+/*
+  Persistent store of the lines justified by the feature based justification (just_features.cpp), so that the lines of
+  the mushaf are not justified again by the next runs.
+
+  A line is keyed by its text, its desired width, the width of the space and the justification type and style. Each
+  record keeps the glyphs of the line, shaped without and with its justification, and a fingerprint of their sources,
+  metrics, anchors and expansion limits combined with the digest of the GSUB, GDEF and JTST tables and the shaping
+  settings of OtLayout : after a change of the font only the lines whose glyphs changed are justified again. GPOS is
+  left out since it is built from the anchors of the glyphs, an anchor edit only invalidates the lines of the glyph.
+  Records are appended to the file as lines are justified, a later record of a key replacing the previous one, and the
+  file is rewritten without the replaced records when they outnumber the others.
+  The store is shared by the sessions of concurrent threads. The file is locked while the store is open, another store of
+  the same file fails to open and its layout justifies its lines without storing them.
+*/
+class JustificationStore {
+public:
+
+  ~JustificationStore();
+
+  bool open(QString fileName);
+  void close();
+  bool isOpen() const { return file.isOpen(); }
+
+  static QString key(const QString& text, double desiredWidth, double spaceWidth, int justType, int justStyle);
+
+  // The tables the lines are justified with, the digest is computed again only when one of them changed
+  void validate(const QVector<QByteArray>& tables);
+
+  bool find(const QString& key, const OtLayout& layout, JustResultByLine& result);
+  void insert(const QString& key, const OtLayout& layout, const JustResultByLine& result, QVector<quint16> glyphs);
+
+private:
+
+  friend class JustificationStoreTest;
+
+  struct Record {
+    quint64 fingerprint;
+    // Sorted glyph codes of the line shaped without and with its justification
+    QVector<quint16> glyphs;
+    JustResultByLine result;
+  };
+
+  quint64 fingerprint(const OtLayout& layout, const QVector<quint16>& glyphs) const;
+  // Digest of the MetaPost source of the glyph and of the glyphs it calls, which decides its stretched forms
+  quint64 sourceDigest(const OtLayout& layout, const QString& name) const;
+  static QByteArray serialize(const QString& key, const Record& record);
+  static bool deserialize(const QByteArray& payload, QString& key, Record& record);
+  bool compact();
+
+  QFile file;
+  QLockFile* lockFile = nullptr;
+  QHash<QString, Record> records;
+  // Records of the file replaced by a later one
+  int replaced = 0;
+
+  QVector<QByteArray> tables;
+  quint64 tablesDigest = 0;
+
+  std::mutex storeMutex;
+};
@@ -54,6 +54,9 @@
 #include "automedina/automedina.h"
 
 #include <vector>
+#include <atomic>
+#include <exception>
+#include <mutex>
 
 #if defined(ENABLE_PDF_GENERATION)
 #include "Pdf/quranpdfwriter.h"
@@ -1205,12 +1208,19 @@ LayoutPages LayoutWindow::shapeMushaf(double scale, int pageWidth, OtLayout* lay
 
   QRegularExpression surabism(surapattern, QRegularExpression::MultilineOption);
 
-  for (int pagenum = 0; pagenum < currentQuranText.size(); pagenum++) {
+  auto justStyle = justStyleCombo->currentData().value<JustStyle>();
+  auto justType = justCombo->currentData().value<JustType>();
+
+  int nbPages = currentQuranText.size();
+
+  std::vector<QVector<LineToJustify>> pageLines(nbPages);
+
+  for (int pagenum = 0; pagenum < nbPages; pagenum++) {
 
     auto& pageText = currentQuranText[pagenum];
 
     auto lines = pageText.split(char(10), Qt::SkipEmptyParts);
-    QVector<LineToJustify> newLines;
+    QVector<LineToJustify>& newLines = pageLines[pagenum];
 
     for (int lineIndex = 0; lineIndex < lines.size(); lineIndex++) {
       auto newJustification = justification;
@@ -1249,13 +1259,61 @@ LayoutPages LayoutWindow::shapeMushaf(double scale, int pageWidth, OtLayout* lay
       newLines.append({ lines[lineIndex] ,lineWidth ,newJustification,lineType });
     }
 
+    result.originalPages.append(lines);
+  }
 
+  std::vector<QList<LineLayoutInfo>> shapedPages(nbPages);
 
-    auto shapedPage = layout->justifyPage(scale, pageWidth, newLines, newface, true, justStyleCombo->currentData().value<JustStyle>(), cluster_level, justCombo->currentData().value<JustType>());
+  // The first page creates the face and loads its tables, the other pages share them and are shaped in parallel
+  // in their own ShapingSession. Each thread takes the next page to shape so that the load is balanced and each page
+  // is stored at its index so that the result does not depend on the scheduling.
+  if (nbPages != 0) {
+    shapedPages[0] = layout->justifyPage(scale, pageWidth, pageLines[0], newface, true, justStyle, cluster_level, justType);
     newface = false;
-    result.pages.append(shapedPage);
-    result.originalPages.append(lines);
+  }
+
+  if (m_font->metaPostPoolSize() == 0) {
+    m_font->initMetaPostPool(std::max(1, QThread::idealThreadCount()));
+  }
+
+  std::atomic<int> nextPage{ 1 };
+  int nbThreads = std::max(1, std::min(QThread::idealThreadCount(), nbPages - 1));
+  std::vector<QThread*> threads;
+
+  // An exception escaping a thread terminates the application so the first one is rethrown here
+  std::exception_ptr error;
+  std::mutex errorMutex;
+
+  for (int t = 0; t < nbThreads; t++) {
+    QThread* thread = QThread::create([&] {
+      try {
+        for (int pagenum = nextPage++; pagenum < nbPages; pagenum = nextPage++) {
+          shapedPages[pagenum] = layout->justifyPage(scale, pageWidth, pageLines[pagenum], false, true, justStyle, cluster_level, justType);
+        }
+      }
+      catch (...) {
+        std::lock_guard<std::mutex> guard(errorMutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+        nextPage = nbPages;
+      }
+      });
+    threads.push_back(thread);
+    thread->start();
+  }
+
+  for (auto t : threads) {
+    t->wait();
+    delete t;
+  }
 
+  if (error) {
+    std::rethrow_exception(error);
+  }
+
+  for (auto& shapedPage : shapedPages) {
+    result.pages.append(shapedPage);
   }
 
   return result;
@@ -2261,6 +2319,8 @@ bool LayoutWindow::generateAllQuranTexBreaking() {
 
       pages.pages.append(page);
 
+      m_otlayout->trimAlternates();
+
       /*
       for (int lineIndex = 0; lineIndex < page.length(); lineIndex++) {
         if (result.pages[pagenum][lineIndex].type == LineType::Line) {
@@ -3223,6 +3283,7 @@ void LayoutWindow::calculateMinimumSize() {
 
       auto page = m_otlayout->justifyPage(emScale, lineWidth, lineWidth, lines, LineJustification::Distribute, false, true);
 
+      m_otlayout->trimAlternates();
 
       for (int linenum = 0; linenum < lines.length(); linenum++) {
 
@@ -3660,13 +3721,53 @@ void LayoutWindow::adjustOverlapping(QList<QList<LineLayoutInfo>>& pages, int li
 
   std::vector<QVector<OverlapResult>*> overlapResults;
 
-  // fetch all gryph initially otherwise mpost is not thread safe when executing getAlternate
-  for (auto& page : pages) {
-    for (auto& line : page) {
-      for (auto& glyph : line.glyphs) {
-        //GlyphVis* currentGlyph = 
-        m_otlayout->getGlyph(glyph.codepoint, { .lefttatweel = glyph.lefttatweel, .righttatweel = glyph.righttatweel });
-      }
+  // fetch all gryph initially since the overlapping threads call the non thread safe getAlternate.
+  // The alternates are generated in parallel using a pool of MetaPost instances.
+  if (m_font->metaPostPoolSize() == 0) {
+    m_font->initMetaPostPool(std::max(1, QThread::idealThreadCount()));
+  }
+
+  {
+    int nbPrefetchThreads = std::max(1, m_font->metaPostPoolSize());
+    std::vector<QThread*> prefetchThreads;
+
+    std::exception_ptr error;
+    std::mutex errorMutex;
+
+    for (int t = 0; t < nbPrefetchThreads; t++) {
+      QThread* thread = QThread::create([this, &pages, &error, &errorMutex, t, nbPrefetchThreads] {
+        try {
+          // The alternates of a page are generated with one MetaPost execution
+          for (int p = t; p < pages.size(); p += nbPrefetchThreads) {
+            std::vector<std::pair<int, GlyphParameters>> requests;
+            for (auto& line : pages[p]) {
+              for (auto& glyph : line.glyphs) {
+                if (glyph.lefttatweel != 0.0 || glyph.righttatweel != 0.0) {
+                  requests.push_back({ glyph.codepoint, { .lefttatweel = glyph.lefttatweel, .righttatweel = glyph.righttatweel } });
+                }
+              }
+            }
+            m_otlayout->prefetchAlternates(requests);
+          }
+        }
+        catch (...) {
+          std::lock_guard<std::mutex> guard(errorMutex);
+          if (!error) {
+            error = std::current_exception();
+          }
+        }
+        });
+      prefetchThreads.push_back(thread);
+      thread->start();
+    }
+
+    for (auto t : prefetchThreads) {
+      t->wait();
+      delete t;
+    }
+
+    if (error) {
+      std::rethrow_exception(error);
     }
   }
 
@@ -3701,6 +3802,8 @@ void LayoutWindow::adjustOverlapping(QList<QList<LineLayoutInfo>>& pages, int li
     delete t;
   }
 
+  m_otlayout->trimAlternates();
+
   QVector<OverlapResult> overlapResult;
 
   QMap<QVector<int>, OverlapResult> sequences;
@@ -3829,6 +3932,14 @@ static QPainterPath qt_graphicsItem_shapeFromPath(const QPainterPath& path, cons
   return p;
 }
 
+// Conservative bounds of a glyph placed on the page computed from its flat outline. margin is in glyph units.
+static QRectF outlineRect(const GlyphVis& glyph, const QTransform& transform, QPointF pos, qreal margin)
+{
+  auto& bounds = glyph.outline().bounds;
+  QRectF rect(QPointF(bounds.minX, bounds.minY), QPointF(bounds.maxX, bounds.maxY));
+  return transform.mapRect(rect.adjusted(-margin, -margin, margin, margin)).translated(pos);
+}
+
 
 void LayoutWindow::adjustOverlapping(QList<QList<LineLayoutInfo>>& pages, int lineWidth, int beginPage, int nbPages, QVector<int>& set, double emScale, QVector<OverlapResult>& result, bool onlySameLine) {
 
@@ -3881,6 +3992,8 @@ void LayoutWindow::adjustOverlapping(QList<QList<LineLayoutInfo>>& pages, int li
       LineLayoutInfo suraName;
 
       QVector<QPainterPath> paths;
+      // Bounds of the paths used to skip the exact intersection test of distant glyphs
+      QVector<QRectF> rects;
 
       for (int g = 0; g < line.glyphs.size(); g++) {
 
@@ -3891,16 +4004,19 @@ void LayoutWindow::adjustOverlapping(QList<QList<LineLayoutInfo>>& pages, int li
         GlyphVis& currentGlyph = *m_otlayout->getGlyph(glyphName, { .lefttatweel = glyphLayout.lefttatweel, .righttatweel = glyphLayout.righttatweel, .scalex = line.xscaleparameter });
         QPoint pos = linePositions[g];
         QPainterPath path;
+        QRectF rect;
         if (!glyphName.contains("space") && !glyphName.contains("cgj")) {
           auto gg = qt_graphicsItem_shapeFromPath(currentGlyph.path, pen);
           path = pathtransform.map(gg);
           path.translate(pos);
+          rect = outlineRect(currentGlyph, pathtransform, pos, pen.widthF());
 
           paths.append(path);
         }
         else {
           paths.append(path);
         }
+        rects.append(rect);
 
 
 
@@ -3941,6 +4057,8 @@ void LayoutWindow::adjustOverlapping(QList<QList<LineLayoutInfo>>& pages, int li
 
               QPoint otherpos = prev_linePositions[prev_g];
 
+              if (!rect.intersects(outlineRect(otherGlyph, pathtransform, otherpos, 0))) continue;
+
               QPainterPath otherpath = pathtransform.map(otherGlyph.path);
               otherpath.translate(otherpos);
               if (path.intersects(otherpath)) {
@@ -3986,7 +4104,7 @@ void LayoutWindow::adjustOverlapping(QList<QList<LineLayoutInfo>>& pages, int li
 
           QPainterPath& otherpath = paths[gg];
 
-          if (path.intersects(otherpath)) {
+          if (rect.intersects(rects[gg]) && path.intersects(otherpath)) {
 
             glyphLayout.color = 0xFF000000;
 
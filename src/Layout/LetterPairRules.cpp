@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#include "LetterPairRules.h"
+
+using namespace std;
+
+static const QString rightNoJoinLetters = "آاٱأإدذرزوؤءة";
+static const QString dualJoinLetters = "بتثجحخسشصضطظعغفقكلمنهيئى";
+
+const LetterClass rightNoJoinClass(rightNoJoinLetters);
+static const LetterClass dualJoinClass(dualJoinLetters);
+const LetterClass baseLetters = dualJoinClass | rightNoJoinClass;
+const LetterClass jhkLetters("جحخ");
+const LetterClass rehLetters("رز");
+const LetterClass hehLetters("هة");
+
+static QString rightKashExp = QString("بتثنيئ") + "جحخ" + "سش" + "صض" + "طظ" + "عغ" + "فق" + "م" + "ه";
+static QString leftKash = QString("ئبتثني") + "جحخ" + "طظ" + "عغ" + "فق" + "ةلم" + "رز";
+static QString mediLeftAsendant = "ل";
+static const QString finalAscendant = "آادذٱأإكلهة";
+const LetterClass finalAscendantLetters(finalAscendant);
+static const LetterClass rightKashLetters(rightKashExp);
+static const LetterClass leftKashLetters = LetterClass(mediLeftAsendant) | (LetterClass(leftKash) - rehLetters);
+
+static const LetterPairRule behKashidaRule{ LetterClass("بتثنيسشصض"), LetterClass("بتثنيم"), LetterPairRule::Position::Inside };
+static const LetterPairRule finaAscendantKashidaRule{ rightKashLetters, finalAscendantLetters, LetterPairRule::Position::End };
+static const LetterPairRule rehKashidaRule{ rightKashLetters, rehLetters, LetterPairRule::Position::Anywhere };
+static const LetterPairRule leftKashidaRule{ rightKashLetters, leftKashLetters, LetterPairRule::Position::Anywhere };
+
+const vector<LetterPairRule> behRules{ behKashidaRule };
+const vector<LetterPairRule> finaAscendantRules{ finaAscendantKashidaRule };
+const vector<LetterPairRule> otherKashidasRules{ rehKashidaRule, leftKashidaRule };
+const vector<LetterPairRule> kafRules{ { LetterClass("ك"), baseLetters, LetterPairRule::Position::Anywhere } };
+const vector<LetterPairRule> secondKashidaNotSameSubWordRules{ behKashidaRule, finaAscendantKashidaRule, rehKashidaRule, leftKashidaRule };
+// Every kashida of the subword can be tried again next to the kashida already applied
+const vector<LetterPairRule> secondKashidaSameSubWordRules{ behKashidaRule, finaAscendantKashidaRule,
+  { rightKashLetters, rehLetters, LetterPairRule::Position::Each },
+  { rightKashLetters, leftKashLetters, LetterPairRule::Position::Each },
+};
+
+static const LetterClass rightKash = dualJoinClass - LetterClass("لك");
+static const LetterClass leftKashidaFina = (dualJoinClass | rightNoJoinClass) - LetterClass("ءوهصضطظ");
+static const LetterClass leftKashidaMedi = leftKashidaFina - LetterClass("ه");
+static const LetterClass altFinaLetters("بتثفكنصضسشقيئى");
+static const LetterClass anyLetter = baseLetters;
+
+// Alternate of the final letter
+const vector<LetterPairRule> altFinaRules{
+  { altFinaLetters, {}, LetterPairRule::Position::End },
+};
+
+// Kashida after a hah or before a final ascendant
+const vector<LetterPairRule> hahFinaAscenKashidaRules{
+  { jhkLetters, leftKashidaMedi, LetterPairRule::Position::Anywhere },
+  { jhkLetters, hehLetters, LetterPairRule::Position::End },
+  { rightKash, LetterClass("آاٱأإملهة"), LetterPairRule::Position::End },
+};
+
+// The rule 1 is an alternate and the rule 8 a kaf, the others are kashidas
+const vector<LetterPairRule> simpleJustRules{
+  { altFinaLetters, {}, LetterPairRule::Position::End },
+  { jhkLetters, leftKashidaMedi, LetterPairRule::Position::Anywhere },
+  { jhkLetters, hehLetters, LetterPairRule::Position::End },
+  { rightKash, LetterClass("دذآاٱأإملهة"), LetterPairRule::Position::End },
+  { LetterClass("بتثنيسشصض"), LetterClass("بتثنيم"), LetterPairRule::Position::Inside },
+  { rightKash, rehLetters, LetterPairRule::Position::Anywhere },
+  { rightKash, LetterClass(mediLeftAsendant) | leftKashidaMedi, LetterPairRule::Position::Anywhere },
+  { LetterClass("ك"), anyLetter, LetterPairRule::Position::Anywhere },
+};
+
+// Appends the positions of the first letters matched by the rule
+static void matchLetterPair(const QString& baseText, const LetterPairRule& rule, vector<int>& positions) {
+
+  int size = baseText.size();
+
+  int length = rule.second.bits == 0 ? 1 : 2;
+  int first;
+  int last = size - length;
+
+  auto matches = [&](int i) {
+    return rule.first.contains(baseText[i]) && (length == 1 || rule.second.contains(baseText[i + 1]));
+  };
+
+  switch (rule.position) {
+  case LetterPairRule::Position::Anywhere:
+    first = 0;
+    break;
+  case LetterPairRule::Position::Inside:
+    first = 1;
+    last--;
+    break;
+  case LetterPairRule::Position::Each:
+    for (int i = 0; i <= last; i++) {
+      if (matches(i)) {
+        positions.push_back(i);
+        i += length - 1;
+      }
+    }
+    return;
+  default:
+    first = last;
+    break;
+  }
+
+  if (last < 0) return;
+
+  for (int i = last; i >= first; i--) {
+    if (matches(i)) {
+      positions.push_back(i);
+      return;
+    }
+  }
+}
+
+LetterPairMatch matchLetterPairs(const QString& baseText, const vector<LetterPairRule>& rules) {
+
+  vector<int> positions;
+
+  for (int ruleIndex = 0; ruleIndex < rules.size(); ruleIndex++) {
+    matchLetterPair(baseText, rules[ruleIndex], positions);
+    if (!positions.empty()) {
+      return { ruleIndex + 1, positions[0] };
+    }
+  }
+
+  return {};
+}
+
+vector<LetterPairMatch> matchAllLetterPairs(const QString& baseText, const vector<LetterPairRule>& rules) {
+
+  vector<LetterPairMatch> matches;
+  vector<int> positions;
+
+  for (int ruleIndex = 0; ruleIndex < rules.size(); ruleIndex++) {
+    positions.clear();
+    matchLetterPair(baseText, rules[ruleIndex], positions);
+    for (auto position : positions) {
+      matches.push_back({ ruleIndex + 1, position });
+    }
+  }
+
+  return matches;
+}
+
@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#pragma once
+
+#include <QString>
+#include <vector>
+#include <cstdint>
+
+/*
+  Set of Arabic letters, a bit per letter from hamza (U+0621) to yeh (U+064A) followed by alef wasla (U+0671), so that
+  the justification rules test the letters of a line without searching strings.
+*/
+struct LetterClass {
+  uint64_t bits = 0;
+
+  LetterClass() = default;
+
+  LetterClass(const QString& letters) {
+    for (auto letter : letters) {
+      bits |= bit(letter);
+    }
+  }
+
+  static uint64_t bit(QChar letter) {
+    auto code = letter.unicode();
+    if (code >= 0x0621 && code <= 0x064A) {
+      return (uint64_t)1 << (code - 0x0621);
+    }
+    else if (code == 0x0671) {
+      return (uint64_t)1 << 42;
+    }
+    return 0;
+  }
+
+  bool contains(QChar letter) const {
+    return bits & bit(letter);
+  }
+
+  LetterClass operator|(const LetterClass& r) const {
+    LetterClass result;
+    result.bits = bits | r.bits;
+    return result;
+  }
+
+  LetterClass operator-(const LetterClass& r) const {
+    LetterClass result;
+    result.bits = bits & ~r.bits;
+    return result;
+  }
+};
+
+/*
+  A rule of the justification : a letter, or a pair of letters, of a subword at the given position. A rule matches at
+  its last position in the subword, which is the match of the greedy regular expression it replaces, except the Each
+  rules which match at each of their non-overlapping positions from the start of the subword.
+*/
+struct LetterPairRule {
+  enum class Position {
+    // ^.*(XY).*$
+    Anywhere,
+    // ^.+(XY).+$
+    Inside,
+    // ^.*(XY)$ or ^.*(X)$ when the rule has no second letter
+    End,
+    // (XY) matched globally
+    Each,
+  };
+
+  LetterClass first;
+  LetterClass second;
+  Position position;
+};
+
+struct LetterPairMatch {
+  // The index, from 1, of the rule matching the subword, 0 when no rule matches
+  int rule = 0;
+  // The index in the base text of the subword of the first letter matched by the rule
+  int position = -1;
+};
+
+// Matches the rules in their order, as the alternatives of a regular expression
+LetterPairMatch matchLetterPairs(const QString& baseText, const std::vector<LetterPairRule>& rules);
+// All the matches of the rules in their order, as the matches of a list of regular expressions
+std::vector<LetterPairMatch> matchAllLetterPairs(const QString& baseText, const std::vector<LetterPairRule>& rules);
+
+extern const LetterClass rightNoJoinClass;
+// The letters kept in the base text of a subword
+extern const LetterClass baseLetters;
+extern const LetterClass jhkLetters;
+extern const LetterClass rehLetters;
+extern const LetterClass hehLetters;
+extern const LetterClass finalAscendantLetters;
+
+// Rules of the experimental kashidas (applyKashidasSubWords), one table by StretchType
+extern const std::vector<LetterPairRule> behRules;
+extern const std::vector<LetterPairRule> finaAscendantRules;
+extern const std::vector<LetterPairRule> otherKashidasRules;
+extern const std::vector<LetterPairRule> kafRules;
+extern const std::vector<LetterPairRule> secondKashidaNotSameSubWordRules;
+extern const std::vector<LetterPairRule> secondKashidaSameSubWordRules;
+
+// Rules of the simple justification (applySimpleJust), tried in this order on the last subwords of a word
+extern const std::vector<LetterPairRule> altFinaRules;
+extern const std::vector<LetterPairRule> hahFinaAscenKashidaRules;
+extern const std::vector<LetterPairRule> simpleJustRules;
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#include "LineLayoutCache.h"
+
+LineLayoutCache::Key LineLayoutCache::key(const OtLayout& layout, const LineToJustify& line, int pageWidth, double emScale, bool tajweedColor, JustStyle justStyle,
+  hb_buffer_cluster_level_t cluster_level, JustType justType) {
+
+  return Key{
+    line.text,
+    line.width,
+    pageWidth,
+    (int)line.lineJustification,
+    (int)line.lineType,
+    (int)justType,
+    (int)justStyle,
+    (int)cluster_level,
+    emScale,
+    tajweedColor,
+    layout.applyJustification,
+    layout.useNormAxisValues
+  };
+}
+
+size_t LineLayoutCache::KeyHash::operator()(const Key& key) const {
+  uint64_t h = std::hash<GlyphParameters>::mix(qHash(key.text) ^ ((uint64_t)(uint32_t)key.width << 32));
+  h = std::hash<GlyphParameters>::mix(h ^ (uint32_t)key.pageWidth);
+  h = std::hash<GlyphParameters>::mix(h ^ std::hash<GlyphParameters>::quantize(key.emScale));
+  h = std::hash<GlyphParameters>::mix(h ^ (uint64_t)(key.justification | key.lineType << 4 | key.justType << 8 | key.justStyle << 12
+    | key.clusterLevel << 16 | key.tajweedColor << 20 | key.applyJustification << 21 | key.useNormAxisValues << 22));
+  return (size_t)h;
+}
+
+bool LineLayoutCache::find(const Key& key, LineLayoutInfo& line) const {
+
+  std::lock_guard<std::mutex> guard(mutex);
+
+  auto find = lines.find(key);
+
+  if (find == lines.end()) {
+    return false;
+  }
+
+  line = find->second;
+
+  return true;
+}
+
+void LineLayoutCache::insert(const Key& key, const LineLayoutInfo& line) {
+  std::lock_guard<std::mutex> guard(mutex);
+  lines.insert({ key, line });
+}
+
+void LineLayoutCache::validate(const QVector<QByteArray>& tables) {
+
+  std::lock_guard<std::mutex> guard(mutex);
+
+  bool same = tables.size() == this->tables.size();
+
+  for (int i = 0; same && i < tables.size(); i++) {
+    // The tables rebuilt without change share their data with the previous ones
+    same = tables[i].constData() == this->tables[i].constData() || tables[i] == this->tables[i];
+  }
+
+  if (!same) {
+    lines.clear();
+    this->tables = tables;
+  }
+}
+
+void LineLayoutCache::clear() {
+  std::lock_guard<std::mutex> guard(mutex);
+  lines.clear();
+  tables.clear();
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#pragma once
+
+#include <unordered_map>
+#include <mutex>
+
+#include <QString>
+#include <QVector>
+#include <QByteArray>
+
+#include "OtLayout.h"
+
+/*
+  Lines justified by OtLayout::justifyPage keyed by their text, width, justification and type, the page width, the
+  scale and the shaping settings, so that a page is only justified again for the lines that changed.
+
+  The lines depend on the lookups and on the justification parameters through the GSUB, GPOS, GDEF and JTST tables :
+  validate clears the cache when one of them is not the table the lines were justified with. OtLayout also clears it
+  with the alternates. The vertical position of a line depends on its index in the page, it is set by justifyPage.
+  The cache is shared by the sessions of concurrent threads.
+*/
+class LineLayoutCache {
+public:
+
+  struct Key {
+    QString text;
+    int width;
+    int pageWidth;
+    int justification;
+    int lineType;
+    int justType;
+    int justStyle;
+    int clusterLevel;
+    double emScale;
+    bool tajweedColor;
+    bool applyJustification;
+    bool useNormAxisValues;
+
+    bool operator==(const Key& r) const {
+      return width == r.width && pageWidth == r.pageWidth && justification == r.justification && lineType == r.lineType && justType == r.justType
+        && justStyle == r.justStyle && clusterLevel == r.clusterLevel && emScale == r.emScale && tajweedColor == r.tajweedColor
+        && applyJustification == r.applyJustification && useNormAxisValues == r.useNormAxisValues && text == r.text;
+    }
+  };
+
+  static Key key(const OtLayout& layout, const LineToJustify& line, int pageWidth, double emScale, bool tajweedColor, JustStyle justStyle,
+    hb_buffer_cluster_level_t cluster_level, JustType justType);
+
+  bool find(const Key& key, LineLayoutInfo& line) const;
+  void insert(const Key& key, const LineLayoutInfo& line);
+
+  void validate(const QVector<QByteArray>& tables);
+  void clear();
+
+private:
+
+  struct KeyHash {
+    size_t operator()(const Key& key) const;
+  };
+
+  std::unordered_map<Key, LineLayoutInfo, KeyHash> lines;
+  QVector<QByteArray> tables;
+  mutable std::mutex mutex;
+};
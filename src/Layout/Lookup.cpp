@@ -52,6 +52,20 @@ void Lookup::setGlyphSet(QVector<QString> list) {
     flags = flags | Flags::UseMarkFilteringSet;
   }
 }
+void Lookup::resolveSubstitutionHandler() {
+  if (name == "markexpansion.l1") {
+    substitutionHandler = MarkExpansion;
+  }
+  else if (name.startsWith("expa.")) {
+    substitutionHandler = Expansion;
+  }
+  else if (name.contains("test")) {
+    substitutionHandler = TestSubstitution;
+  }
+  else {
+    substitutionHandler = DefaultSubstitution;
+  }
+}
 void Lookup::readJson(const QJsonObject& jsonsubtable) {
   QString type = jsonsubtable["type"].toString();
 
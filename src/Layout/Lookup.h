@@ -160,6 +160,14 @@ public:
     MarkAttachmentType = 0xFF00u
   };
 
+  // Behaviour of the substitution callback of OtLayout for the lookup
+  enum SubstitutionHandler {
+    DefaultSubstitution,
+    MarkExpansion,
+    Expansion,
+    TestSubstitution
+  };
+
   Lookup(OtLayout* layout);
   ~Lookup();
 
@@ -185,6 +193,10 @@ public:
 
   Type type;
 
+  // Resolved from the name when the table is built so that the callback does not compare names
+  SubstitutionHandler substitutionHandler = DefaultSubstitution;
+  void resolveSubstitutionHandler();
+
   QVector<Subtable*> getSubtables(bool extended);
 
 };
@@ -43,6 +43,13 @@
 #include "automedina/automedina.h"
 #include "QByteArrayOperator.h"
 #include "GlyphVis.h"
+#include "AlternateStore.h"
+#include "OutlineInterpolator.h"
+#include "OutlineArena.h"
+#include "ShapingSession.h"
+#include "LineLayoutCache.h"
+#include "JustificationStore.h"
+#include "PageBreaker.h"
 #include "FeaParser/driver.h"
 #include "FeaParser/feaast.h"
 #include "qiodevice.h"
@@ -52,6 +59,7 @@
 
 #include "qurantext/quran.h"
 #include <limits>
+#include <unordered_set>
 
 #include <QtCore/qmath.h>
 #include <fstream>
@@ -97,6 +105,8 @@ static hb_blob_t* harfbuzzGetTables(hb_face_t* face, hb_tag_t tag, void* userDat
 {
   OtLayout* layout = reinterpret_cast<OtLayout*>(userData);
 
+  std::lock_guard<std::mutex> guard(layout->tableMutex);
+
   QByteArray data;
   hb_memory_mode_t mode = HB_MEMORY_MODE_READONLY;
 
@@ -144,6 +154,10 @@ static hb_blob_t* harfbuzzGetTables(hb_face_t* face, hb_tag_t tag, void* userDat
     break;
   }
 
+  if (mode == HB_MEMORY_MODE_READONLY) {
+    return layout->getTableBlob(tag, data);
+  }
+
   return hb_blob_create(data.constData(), data.size(), mode, NULL, NULL);
 
 }
@@ -211,6 +225,16 @@ static hb_position_t getGlyphHorizontalAdvance(hb_font_t* hbFont, void* fontData
 {
   OtLayout* layout = reinterpret_cast<OtLayout*>(fontData);
 
+  if (auto info = layout->glyphInfo(glyph)) {
+    if (info->gdefClass == OtLayout::MarkGlyph) {
+      return 0;
+    }
+    if (parameters.lefttatweel == 0 && parameters.righttatweel == 0) {
+      return hbFont->em_scale_x(info->advance);
+    }
+    return hbFont->em_scale_x(layout->getAdvance(info->glyph, parameters));
+  }
+
   if (!layout->glyphNamePerCode.contains(glyph)) {
     //std::cout << "Glyph " << glyph << " not found" << std::endl;
     return 0;
@@ -224,13 +248,14 @@ static hb_position_t getGlyphHorizontalAdvance(hb_font_t* hbFont, void* fontData
 
     GlyphVis* pglyph = &layout->glyphs[name];
 
+    double advance = pglyph->width;
+
     if (parameters.lefttatweel != 0 || parameters.righttatweel != 0) {
-      pglyph = layout->getAlternate(pglyph->charcode, parameters);
+      advance = layout->getAdvance(pglyph, parameters);
     }
 
-    auto xadvance = hbFont->em_scale_x(pglyph->width);
+    auto xadvance = hbFont->em_scale_x(advance);
 
-    double advance = pglyph->width;
     //return advance; // floatToHarfBuzzPosition(advance);
     int upem = 1000;
     int xscale, yscale;
@@ -396,19 +421,11 @@ static hb_bool_t get_cursive_anchor(hb_font_t* font, void* font_data,
 
     MarkBaseSubtable* subtableTable = static_cast<MarkBaseSubtable*>(subtable);
 
-    quint16 classIndex = subtableTable->markCodes[context->glyph_id];
-
-    QString className = subtableTable->classNamebyIndex[classIndex];
-
     double lefttatweel = layout->normalToParameter(context->base_glyph_id, context->lefttatweel, true);
     double righttatweel = layout->normalToParameter(context->base_glyph_id, context->righttatweel, false);
 
     if (context->type == hb_cursive_anchor_context_t::base) {
 
-      QString baseGlyphName = layout->glyphNamePerCode[context->base_glyph_id];
-
-      GlyphVis& curr = layout->glyphs[baseGlyphName];
-
       auto anchor = subtableTable->getBaseAnchor(context->glyph_id, context->base_glyph_id, { .lefttatweel = lefttatweel, .righttatweel = righttatweel });
       if (anchor) {
 
@@ -424,10 +441,6 @@ static hb_bool_t get_cursive_anchor(hb_font_t* font, void* font_data,
 
     }
     else if (context->type == hb_cursive_anchor_context_t::mark) {
-      QString markGlyphName = layout->glyphNamePerCode[context->glyph_id];
-
-
-      GlyphVis& curr = layout->glyphs[markGlyphName];
 
       auto anchor = subtableTable->getMarkAnchor(context->glyph_id, context->base_glyph_id, { .lefttatweel = lefttatweel, .righttatweel = righttatweel });
       if (anchor) {
@@ -460,7 +473,8 @@ static hb_bool_t get_substitution(hb_font_t* font, void* font_data,
 
   Lookup* lookupTable = layout->gsublookups.at(context->lookup_index);
 
-  if (lookupTable->name == "markexpansion.l1") {
+  switch (lookupTable->substitutionHandler) {
+  case Lookup::MarkExpansion: {
     auto buffer = context->buffer;
     unsigned int glyph_count;
 
@@ -476,16 +490,10 @@ static hb_bool_t get_substitution(hb_font_t* font, void* font_data,
 
     auto& prev_info = glyph_info[prevIndex];
 
-    char			buf[64];
-
-    hb_font_get_glyph_name(font, curr_info.codepoint, buf, sizeof(buf));
-
-    char			prevName[64];
-    hb_font_get_glyph_name(font, prev_info.codepoint, prevName, sizeof(prevName));
-    if (QString(prevName) == "behshape.medi.expa") {
+    if (layout->glyphNameIs(prev_info.codepoint, OtLayout::GlyphInfo::BehshapeMediExpa)) {
       curr_info.lefttatweel = (std::min)(prev_info.lefttatweel, 1.5);
     }
-    else if (QString(prevName).contains(".expa")) {
+    else if (layout->glyphNameIs(prev_info.codepoint, OtLayout::GlyphInfo::Expa)) {
       curr_info.lefttatweel = 1.5;
 
     }
@@ -493,21 +501,18 @@ static hb_bool_t get_substitution(hb_font_t* font, void* font_data,
       //curr_info.lefttatweel = 0.07 + 0.1 * prev_info.lefttatweel;
     }
 
-    auto& curr_glyph = *layout->getGlyph(curr_info.codepoint);
-
-
-
+    break;
   }
-  else if (lookupTable->name.startsWith("expa.")) {
+  case Lookup::Expansion: {
 
     auto buffer = context->buffer;
 
     auto& curr_info = buffer->cur();
 
-    auto name = layout->glyphNamePerCode[curr_info.codepoint];
+    auto& justificationContext = layout->currentJustificationContext();
 
-    layout->justificationContext.GlyphsToExtend.push_back(buffer->idx);
-    layout->justificationContext.Substitutes.push_back(context->substitute);
+    justificationContext.GlyphsToExtend.push_back(buffer->idx);
+    justificationContext.Substitutes.push_back(context->substitute);
 
     auto subtable = lookupTable->subtables.at(context->subtable_index);
 
@@ -516,8 +521,8 @@ static hb_bool_t get_substitution(hb_font_t* font, void* font_data,
       if (subtableTable->format == 10) {
         SingleSubtableWithExpansion* tatweelSubtable = static_cast<SingleSubtableWithExpansion*>(subtableTable);
         auto& expa = tatweelSubtable->expansion[curr_info.codepoint];
-        layout->justificationContext.Expansions.insert({ buffer->idx, expa });
-        layout->justificationContext.totalWeight += expa.weight;
+        justificationContext.Expansions.insert({ buffer->idx, expa });
+        justificationContext.totalWeight += expa.weight;
       }
     }
 
@@ -527,29 +532,26 @@ static hb_bool_t get_substitution(hb_font_t* font, void* font_data,
     return false;
 
   }
-  else if (lookupTable->name.contains("test")) {
+  case Lookup::TestSubstitution: {
 
     auto buffer = context->buffer;
 
     auto& curr_info = buffer->cur();
 
-    auto name = layout->glyphNamePerCode[curr_info.codepoint];
-
     //JustificationContext::GlyphsToExtend.append(buffer->idx);
 
-    if (name == "behshape.medi") {
+    if (layout->glyphNameIs(curr_info.codepoint, OtLayout::GlyphInfo::BehshapeMedi)) {
       curr_info.lefttatweel = 3;
       curr_info.righttatweel = 2;
     }
 
+    break;
   }
-  else {
+  default: {
     auto buffer = context->buffer;
 
     auto& curr_info = buffer->cur();
 
-    auto name = layout->glyphNamePerCode[curr_info.codepoint];
-
     //JustificationContext::GlyphsToExtend.append(buffer->idx);
     //JustificationContext::Substitutes.append(context->substitute);
 
@@ -565,6 +567,8 @@ static hb_bool_t get_substitution(hb_font_t* font, void* font_data,
         curr_info.righttatweel += expa.MaxRightTatweel;
       }
     }
+    break;
+  }
   }
 
   return true;
@@ -680,7 +684,12 @@ GlyphVis* OtLayout::getGlyph(QString name, GlyphParameters parameters) {
 
   if (parameters.lefttatweel != 0 || parameters.righttatweel != 0 || parameters.scalex != 0) {
 
-    pglyph = getAlternate(pglyph->charcode, parameters);
+    if (auto session = ShapingSession::current()) {
+      pglyph = session->getAlternate(pglyph->charcode, parameters);
+    }
+    else {
+      pglyph = getAlternate(pglyph->charcode, parameters);
+    }
   }
 
   return pglyph;
@@ -688,6 +697,16 @@ GlyphVis* OtLayout::getGlyph(QString name, GlyphParameters parameters) {
 
 GlyphVis* OtLayout::getGlyph(int code, GlyphParameters parameters) {
 
+  if (auto info = glyphInfo(code)) {
+    if (parameters.lefttatweel != 0 || parameters.righttatweel != 0 || parameters.scalex != 0) {
+      if (auto session = ShapingSession::current()) {
+        return session->getAlternate(info->glyph->charcode, parameters);
+      }
+      return getAlternate(info->glyph->charcode, parameters);
+    }
+    return info->glyph;
+  }
+
   if (glyphNamePerCode.contains(code)) {
     return getGlyph(glyphNamePerCode[code], parameters);
   }
@@ -697,6 +716,10 @@ GlyphVis* OtLayout::getGlyph(int code, GlyphParameters parameters) {
 
 GlyphVis* OtLayout::getGlyph(int code) {
 
+  if (auto info = glyphInfo(code)) {
+    return info->glyph;
+  }
+
   GlyphVis* curr = nullptr;
 
   if (glyphNamePerCode.contains(code)) {
@@ -708,6 +731,48 @@ GlyphVis* OtLayout::getGlyph(int code) {
   return curr;
 }
 
+void OtLayout::updateGlyphInfos() {
+
+  glyphInfos.clear();
+
+  if (!glyphNamePerCode.isEmpty()) {
+    glyphInfos.resize(glyphNamePerCode.lastKey() + 1);
+  }
+
+  for (auto it = glyphNamePerCode.constBegin(); it != glyphNamePerCode.constEnd(); ++it) {
+    auto glyph = glyphs.find(it.value());
+    if (glyph == glyphs.end()) continue;
+
+    auto& info = glyphInfos[it.key()];
+
+    info.glyph = &glyph.value();
+    info.gdefClass = glyphGlobalClasses.value(it.key(), (GDEFClasses)0);
+    info.advance = info.glyph->width;
+
+    if (it.value() == "behshape.medi.expa") {
+      info.nameFlags |= GlyphInfo::BehshapeMediExpa;
+    }
+    else if (it.value() == "behshape.medi") {
+      info.nameFlags |= GlyphInfo::BehshapeMedi;
+    }
+    if (it.value().contains(".expa")) {
+      info.nameFlags |= GlyphInfo::Expa;
+    }
+    if (it.value().contains("aya")) {
+      info.nameFlags |= GlyphInfo::Aya;
+    }
+
+    auto limits = expandableGlyphs.find(it.value());
+    if (limits != expandableGlyphs.end()) {
+      info.limits = &limits->second;
+    }
+  }
+
+  glyphInfosValid = true;
+
+  lineLayouts->clear();
+}
+
 QByteArray OtLayout::getGDEF() {
   if (!gdef_array.isEmpty() && !dirty) {
     return gdef_array;
@@ -790,6 +855,30 @@ QByteArray OtLayout::getGPOS() {
 
   return gpos_array;
 }
+hb_blob_t* OtLayout::getTableBlob(hb_tag_t tag, const QByteArray& data) {
+
+  hb_blob_t* blob = tableBlobs.value(tag, nullptr);
+
+  if (blob != nullptr) {
+    unsigned int length;
+    const char* blobData = hb_blob_get_data(blob, &length);
+    if (blobData == data.constData() && length == (unsigned int)data.size()) {
+      return hb_blob_reference(blob);
+    }
+    hb_blob_destroy(blob);
+  }
+
+  // The blob shares the data of the table so it stays valid when the table is rebuilt
+  QByteArray* copy = new QByteArray(data);
+
+  blob = hb_blob_create(copy->constData(), copy->size(), HB_MEMORY_MODE_READONLY, copy, [](void* userData) {
+    delete reinterpret_cast<QByteArray*>(userData);
+    });
+
+  tableBlobs.insert(tag, hb_blob_reference(blob));
+
+  return blob;
+}
 QByteArray OtLayout::getFeatureList(QMap<QString, QSet<quint16>> allFeatures) {
 
   QByteArray featureList_array;
@@ -901,153 +990,41 @@ QByteArray OtLayout::getGSUBorGPOS(bool isgsub, QVector<Lookup*>& lookups, QMap<
   root.append(scriptList);
   root.append(featureList);
 
-  quint16 lookupCount = lookups.size();
-
-  quint32 lookupListtotalSize = 2 + 2 * lookupCount;
+  QVector<OtTableBuilder::LookupEntry> lookupEntries;
+  QVector<OtTableBuilder::SubtableEntry> subtableEntries;
 
-  int nbSubtablekt01expa1 = 0;
+  QVector<int> subtableskt01expa1;
 
   for (int i = 0; i < lookups.size(); ++i) {
 
     Lookup* lookup = lookups.at(i);
 
-    auto subtables = lookup->getSubtables(extended);
-
-    quint32 nb_subtables = subtables.size();
-
-    if (lookup->name == "kt01.expa.1") {
-      nbSubtablekt01expa1 = nb_subtables;
-    }
-
-    auto expaLookup = lookup->name == "kt02.expa.1" || lookup->name == "kt03.expa.1" || lookup->name == "kt04.expa.1" || lookup->name == "kt05.expa.1";
-
-    if (expaLookup) {
-      nb_subtables = nbSubtablekt01expa1;
-    }
-
-    //lookup header
-    lookupListtotalSize += 2 + 2 + 2 + 2 * nb_subtables;
-
-    if (lookup->markGlyphSetIndex != -1) {
-      lookupListtotalSize += 2;
-    }
-
-    //extension subtables
-    lookupListtotalSize += 8 * nb_subtables;
-
-  }
-
-  QByteArray lookupList;
-  QByteArray lookups_array;
-  lookupList << lookupCount;
-
-  quint16 beginoffset = 2 + 2 * lookupCount;
-  quint16 extensiontype = isgsub ? Lookup::extensiongsub : Lookup::extensiongpos;
-  QByteArray subtablesArray;
-
-  quint32 subtablesOffset = lookupListtotalSize;
+    lookup->resolveSubstitutionHandler();
 
-  std::vector<quint32> subtablesOffsetkt01expa1;
-
-  for (int i = 0; i < lookups.size(); ++i) {
-
-    Lookup* lookup = lookups.at(i);
+    OtTableBuilder::LookupEntry entry{ lookup };
 
     auto expaLookup = lookup->name == "kt02.expa.1" || lookup->name == "kt03.expa.1" || lookup->name == "kt04.expa.1" || lookup->name == "kt05.expa.1";
 
-    auto subtables = lookup->getSubtables(extended);
-
-    quint32 nb_subtables = subtables.size();
-
     if (expaLookup) {
-      nb_subtables = nbSubtablekt01expa1;
-    }
-
-    QByteArray lookupArray;
-
-    lookupArray << extensiontype;
-    lookupArray << lookup->flags;
-    lookupArray << (quint16)nb_subtables;
-
-    quint16 debutsequence = 2 + 2 + 2 + 2 * nb_subtables;
-
-    if (lookup->markGlyphSetIndex != -1) {
-      debutsequence += 2;
+      // Shares the subtables of kt01.expa.1
+      entry.subtables = subtableskt01expa1;
     }
-
-    QByteArray exttables_array;
-
-
-    for (int i = 0; i < nb_subtables; ++i) {
-
-
-
-      lookupArray << debutsequence;
-
-
-      quint16 lookuptype = (quint16)lookup->type;
-
-      if (lookup->name == "kt01.expa.1") {
-        subtablesOffsetkt01expa1.push_back(subtablesOffset);
-      }
-
-      if (expaLookup) {
-        exttables_array << (quint16)1 << lookuptype << (quint32)(subtablesOffsetkt01expa1[i] - (beginoffset + debutsequence));
+    else {
+      for (auto subtable : lookup->getSubtables(extended)) {
+        entry.subtables.append(subtableEntries.size());
+        subtableEntries.append({ subtable, !extended && subtable->isConvertible() });
       }
-      else {
-
-        exttables_array << (quint16)1 << lookuptype << (quint32)(subtablesOffset - (beginoffset + debutsequence));
-
-        QByteArray subtableArray;
-
-        auto& subtable = subtables.at(i);
-
-        if (!extended && subtable->isConvertible()) {
-          subtableArray = subtable->getConvertedOpenTypeTable();
-        }
-        else {
-          subtableArray = subtable->getOptOpenTypeTable(extended);
-        }
-
-        if (lookup->type != Lookup::fsmgsub && subtableArray.size() > 0xFFFF) {
-          std::cout << lookup->name.toStdString() << " : Subtable " << subtable->name.toStdString()
-            << " exceeds the limit of 64K : " << subtableArray.size()
-            << std::endl;
-          //throw std::runtime_error{ "Subtable exeeded the limit of 64K" };
-        }
-
-
-
-        subtablesArray.append(subtableArray);
-
-        subtablesOffset += subtableArray.size();
+      if (lookup->name == "kt01.expa.1") {
+        subtableskt01expa1 = entry.subtables;
       }
-
-
-
-      debutsequence += 8;
-    }
-
-    if (lookup->markGlyphSetIndex != -1) {
-      lookupArray << lookup->markGlyphSetIndex;
     }
 
-    lookupArray.append(exttables_array);
-    lookups_array.append(lookupArray);
-
-    lookupList << beginoffset;
-
-    beginoffset += lookupArray.size();
-
+    lookupEntries.append(entry);
   }
 
-  lookupList.append(lookups_array);
-  lookupList.append(subtablesArray);
-
-
-  root.append(lookupList);
+  auto& builder = isgsub ? gsubBuilder : gposBuilder;
 
-  return root;
+  return builder.build(root, isgsub, extended, lookupEntries, subtableEntries);
 
 }
 /*
@@ -1123,6 +1100,24 @@ justTable{ this }, font{ font }, isOTVar{ generateVariableOpenType } {
 
   auto path = font->filePath();
   QFileInfo fileInfo = QFileInfo(path);
+
+  outlineArena = std::make_shared<OutlineArena>();
+
+  alternateStore = new AlternateStore(font->mp);
+
+  outlineInterpolator = new OutlineInterpolator(this);
+  lineLayouts = new LineLayoutCache();
+  justifications = new JustificationStore();
+  interpolateAlternates = isOTVar;
+
+#ifndef DIGITALKHATT_WEBLIB
+  QDir outputDir(fileInfo.path() + "/output");
+  if (outputDir.exists() || outputDir.mkpath(".")) {
+    alternateStore->open(outputDir.filePath(fileInfo.baseName() + ".alternates"), font->sourceFingerprint());
+    justifications->open(outputDir.filePath(fileInfo.baseName() + ".justifications"));
+  }
+#endif
+
 #ifdef NDEBUG
   QString debugPostfix = "";
 #else
@@ -1158,6 +1153,13 @@ OtLayout::~OtLayout() {
   }
   clearAlternates();
 
+  delete outlineInterpolator;
+  delete alternateStore;
+  delete lineLayouts;
+  delete justifications;
+  for (auto blob : tableBlobs) {
+    hb_blob_destroy(blob);
+  }
   delete face;
   delete automedina;
   delete toOpenType;
@@ -1183,12 +1185,6 @@ void OtLayout::generateSubstEquivGlyphs() {
 }
 
 void OtLayout::clearAlternates() {
-  for (auto& glyph : tempGlyphs) {
-    for (auto& path : glyph.second) {
-      delete path.second;
-    }
-    //glyph.second.clear();
-  }
   /*
   for (auto& glyph : nojustalternatePaths) {
     for (auto& path : glyph.second) {
@@ -1198,7 +1194,54 @@ void OtLayout::clearAlternates() {
   }*/
 
   tempGlyphs.clear();
+  advances.clear();
+  alternateGeneration++;
+  wordWidths.clear();
+  stretchProfiles.clear();
+  lineLayouts->clear();
+
+  // The outlines of the deleted alternates are released with their arena once no other glyph shares it
+  outlineArena = std::make_shared<OutlineArena>();
+
+}
+
+void OtLayout::trimAlternates() {
+
+  std::lock_guard<std::mutex> guard(alternateMutex);
 
+  if (tempGlyphs.trim() == 0) return;
+
+  // Evicted outlines stay in the arena until it is released. Once they dominate it the remaining alternates are copied
+  // to a new arena, the old one is freed with the last glyph sharing it.
+  if (outlineArena->allocatedBytes() <= 2 * tempGlyphs.bytes()) return;
+
+  auto arena = std::make_shared<OutlineArena>();
+
+  tempGlyphs.forEach([this, &arena](int, const GlyphParameters&, GlyphVis* glyph) {
+    if (glyph->outlineArena != outlineArena) return;
+    auto body = font->copyEdgeBody(glyph->copiedPath, arena.get());
+    glyph->releaseCopiedPath();
+    glyph->copiedPath = body;
+    glyph->isCopiedPath = true;
+    glyph->outlineArena = arena;
+    });
+
+  outlineArena = arena;
+}
+
+void OtLayout::setAlternateCacheBudget(size_t bytes) {
+  std::lock_guard<std::mutex> guard(alternateMutex);
+  tempGlyphs.setBudget(bytes);
+}
+
+AlternateCache::Stats OtLayout::alternateCacheStats() {
+  std::lock_guard<std::mutex> guard(alternateMutex);
+  return tempGlyphs.stats();
+}
+
+void OtLayout::resetAlternateCacheStats() {
+  std::lock_guard<std::mutex> guard(alternateMutex);
+  tempGlyphs.resetStats();
 }
 
 CalcAnchor OtLayout::getanchorCalcFunctions(QString functionName, Subtable * subtable) {
@@ -1459,12 +1502,23 @@ hb_font_t* OtLayout::createFont(double emScale, bool newFace)
 {
   int upem = 1000;
 
+  std::lock_guard<std::mutex> guard(faceMutex);
+
+  if (!glyphInfosValid) {
+    updateGlyphInfos();
+  }
+
   if (newFace || face == nullptr) {
     if (face != nullptr) {
       hb_face_destroy(face);
       face = nullptr;
     }
 
+    wordWidths.clear();
+    stretchProfiles.clear();
+
+    // The tables only change with the face, which is never replaced while other threads shape with it
+    validateLineLayouts();
 
     face = hb_face_create_for_tables(harfbuzzGetTables, this, 0);
     hb_face_set_upem(face, upem);
@@ -1657,6 +1711,7 @@ void OtLayout::setParameter(quint16 glyphCode, quint32 lookup, quint32 subtableI
       qDebug() << QString("Changing mark anchor %1::%2::%3::%4 : (%5,%6)").arg(lookupTable->name, subtable->name, className, markGlyphName, QString::number(newvalue.x()), QString::number(newvalue.y()));
     }
     subtableTable->isDirty = true;
+    subtableTable->anchorCache.clear();
 
 
 
@@ -1700,6 +1755,7 @@ void OtLayout::setParameter(quint16 glyphCode, quint32 lookup, quint32 subtableI
     //}
 
     subtableTable->isDirty = true;
+    subtableTable->anchorCache.clear();
 
     emit parameterChanged();
 
@@ -1714,12 +1770,14 @@ void OtLayout::applyJustFeature(hb_buffer_t * buffer, bool& needgpos, double& di
     return;
 
   const unsigned int table_index = 0u;
+
+  auto& justificationContext = currentJustificationContext();
   buffer->reverse();
 
   uint glyph_count;
 
   hb_buffer_t* copy_buffer = nullptr;
-  copy_buffer = hb_buffer_create();
+  copy_buffer = ShapingSession::acquireBuffer();
   hb_buffer_append(copy_buffer, buffer, 0, -1);
 
   hb_glyph_position_t* glyph_pos = hb_buffer_get_glyph_positions(copy_buffer, &glyph_count);
@@ -1952,7 +2010,7 @@ void OtLayout::applyJustFeature(hb_buffer_t * buffer, bool& needgpos, double& di
   }
   buffer->reverse();
   if (copy_buffer)
-    hb_buffer_destroy(copy_buffer);
+    ShapingSession::releaseBuffer(copy_buffer);
 
 }
 
@@ -1962,12 +2020,14 @@ void OtLayout::applyJustFeature_old(hb_buffer_t * buffer, bool& needgpos, double
     return;
 
   const unsigned int table_index = 0u;
+
+  auto& justificationContext = currentJustificationContext();
   buffer->reverse();
 
   uint glyph_count;
 
   hb_buffer_t* copy_buffer = nullptr;
-  copy_buffer = hb_buffer_create();
+  copy_buffer = ShapingSession::acquireBuffer();
   hb_buffer_append(copy_buffer, buffer, 0, -1);
 
   hb_glyph_position_t* glyph_pos = hb_buffer_get_glyph_positions(copy_buffer, &glyph_count);
@@ -2187,7 +2247,7 @@ void OtLayout::applyJustFeature_old(hb_buffer_t * buffer, bool& needgpos, double
   }
   buffer->reverse();
   if (copy_buffer)
-    hb_buffer_destroy(copy_buffer);
+    ShapingSession::releaseBuffer(copy_buffer);
 
 }
 
@@ -2251,7 +2311,6 @@ void OtLayout::jutifyLine_old(hb_font_t * shapefont, hb_buffer_t * text_buffer,
 
   if (applyJustification && lineWidth != 0) {
 
-    JustificationInProgress = true;
     bool continueJustification = true;
     bool schr1applied = false;
     while (continueJustification) {
@@ -2315,7 +2374,6 @@ void OtLayout::jutifyLine_old(hb_font_t * shapefont, hb_buffer_t * text_buffer,
         //hb_shape(shapefont, buffer, nullptr, 0);
       }
     }
-    JustificationInProgress = false;
   }
   copyBuffer(text_buffer, buffer);
 
@@ -2350,7 +2408,6 @@ void OtLayout::jutifyLine(hb_font_t * shapefont, hb_buffer_t * text_buffer, int
   features[1].start = 0;
   features[1].end = -1;
 
-  JustificationInProgress = applyJustification; // true;
   hb_shape(shapefont, text_buffer, features, 2);
   /*
   if (tajweedColor) {
@@ -2362,21 +2419,21 @@ void OtLayout::jutifyLine(hb_font_t * shapefont, hb_buffer_t * text_buffer, int
   else {
     hb_shape(shapefont, text_buffer, nullptr, 0);
   }*/
-  JustificationInProgress = false;
 
 }
 
 QList<LineLayoutInfo> OtLayout::justifyPage(double emScale, int pageWidth, const QVector<LineToJustify>&lines, bool newFace, bool tajweedColor, JustStyle justStyle, hb_buffer_cluster_level_t  cluster_level, JustType justType) {
 
-
   if (justType == JustType::Madina || justType == JustType::IndoPak || justType == JustType::Experimental) {
     return justifyPageUsingFeatures(emScale, pageWidth, lines, newFace, tajweedColor, cluster_level, justType, justStyle);
   }
 
   QList<LineLayoutInfo> page;
 
-  hb_buffer_t* buffer = buffer = hb_buffer_create();
-  hb_font_t* shapefont = this->createFont(emScale, newFace);
+  ShapingSession session{ this, emScale, newFace };
+
+  hb_buffer_t* buffer = session.buffer();
+  hb_font_t* shapefont = session.font();
 
   int currentyPos = TopSpace << OtLayout::SCALEBY;
 
@@ -2402,6 +2459,16 @@ QList<LineLayoutInfo> OtLayout::justifyPage(double emScale, int pageWidth, const
 
   for (auto& line : lines) {
 
+    auto key = LineLayoutCache::key(*this, line, pageWidth, emScale, tajweedColor, justStyle, cluster_level, justType);
+
+    LineLayoutInfo cachedLine;
+    if (lineLayouts->find(key, cachedLine)) {
+      cachedLine.ystartposition = currentyPos;
+      currentyPos = currentyPos + (InterLineSpacing << OtLayout::SCALEBY);
+      page.append(cachedLine);
+      continue;
+    }
+
     bool first = true;
     bool overfull = false;
     currentFont = shapefont;
@@ -2506,7 +2573,6 @@ QList<LineLayoutInfo> OtLayout::justifyPage(double emScale, int pageWidth, const
       lineLayout.fontSize = fontSize;
 
       if (overfull) {
-        hb_font_destroy(currentFont);
         overfull = false;
       }
       else if (justStyle == JustStyle::FontSize) {
@@ -2514,7 +2580,7 @@ QList<LineLayoutInfo> OtLayout::justifyPage(double emScale, int pageWidth, const
           double ratio = (double)lineWidth / currentlineWidth;
           if (ratio > 0.01) {
             fontSize = emScale * ratio;
-            currentFont = this->createFont(fontSize, false);
+            currentFont = session.font(fontSize);
             overfull = true;
             continue;
           }
@@ -2531,12 +2597,10 @@ QList<LineLayoutInfo> OtLayout::justifyPage(double emScale, int pageWidth, const
       lineLayout.type = line.lineType;
 
       page.append(lineLayout);
+      lineLayouts->insert(key, lineLayout);
     }
   }
 
-  hb_font_destroy(shapefont);
-  hb_buffer_destroy(buffer);
-
   return page;
 }
 
@@ -2585,22 +2649,7 @@ QList<QStringList> OtLayout::pageBreak(double emScale, int lineWidth, bool pageF
 }
 QList<QStringList> OtLayout::pageBreak(double emScale, int lineWidth, bool pageFinishbyaVerse, QString text, QSet<int> forcedBreaks, int nbPages) {
 
-  typedef long ParaWidth;
-
-  struct Candidate {
-    size_t index;  // index int the text buffer
-    int prev = -1;  // index to previous break
-    int totalWidth = 0;  // width of text until this point, if we decide to break here
-    double  totalDemerits = 0.0;  // best demerits found for this break (index) and lineNumber
-    size_t lineNumber = 0;  // only updated for non-constant line widths
-    size_t pageNumber = 1;
-    size_t totalSpaces = 0;  // preceding space count after breaking
-  };
-
-
-  constexpr double DEMERITS_INFTY = std::numeric_limits<double>::max();
-
-  hb_buffer_t* buffer = buffer = hb_buffer_create();
+  hb_buffer_t* buffer = hb_buffer_create();
 
   hb_buffer_set_direction(buffer, HB_DIRECTION_RTL);
   hb_buffer_set_script(buffer, HB_SCRIPT_ARABIC);
@@ -2623,354 +2672,88 @@ QList<QStringList> OtLayout::pageBreak(double emScale, int lineWidth, bool pageF
   const int maxStretch = 100 * emScale;
   const int maxShrink = 50 * emScale;
 
-  //ParaWidth lineWidth = (17000 - (2 * 400)) << OtLayout::SCALEBY;
-
   hb_glyph_info_t* glyph_info = hb_buffer_get_glyph_infos(buffer, &glyph_count);
-  hb_glyph_position_t* glyph_pos = hb_buffer_get_glyph_positions(buffer, &glyph_count);
 
+  PageBreaker::Parameters parameters;
 
+  parameters.lineWidth = lineWidth;
+  parameters.spaceWidth = spaceWidth;
+  parameters.stretchPerSpace = maxStretch;
+  parameters.shrinkPerSpace = maxShrink;
+  if (nbPages > 0) {
+    parameters.stretchPerWidth = 0.05;
+    parameters.shrinkPerWidth = 0.01;
+  }
+  parameters.nbPages = nbPages;
+  parameters.pageFinishbyaVerse = pageFinishbyaVerse;
 
-  ParaWidth totalWidth = 0;
-  int totalSpaces = 0;
-  std::vector<int> actives;
-  std::vector<Candidate> candidates;
-
-  candidates.push_back({});
-  Candidate* initCand = &candidates.back();
+  auto lines = PageBreaker(*this, buffer, forcedBreaks).breakPages(parameters);
 
-  initCand->pageNumber = 1;
-  initCand->lineNumber = 0;
-  initCand->index = glyph_count;
-  initCand->prev = -1;
+  QStringList originalPage;
+  QList<QStringList> originalPages;
 
-  actives.push_back(0);
+  for (auto& line : lines) {
 
-  auto sortActives = [&candidates](const int& a, const int& b) {
-    if (candidates[a].pageNumber < candidates[b].pageNumber) {
-      return true;
+    if (line.lineNumber == 1 && !originalPage.isEmpty()) {
+      originalPages.append(originalPage);
+      originalPage.clear();
     }
-    else if (candidates[a].pageNumber > candidates[b].pageNumber) {
 
-      return false;
-    }
-    else {
-      return candidates[a].lineNumber < candidates[b].lineNumber;
-    }
+    int beginCluster = glyph_info[line.begin - 1].cluster;
 
-    };
+    originalPage.append(text.mid(beginCluster, glyph_info[line.end].cluster - beginCluster));
+  }
 
-  for (int i = glyph_count - 1; i >= 0; i--) {
+  if (!originalPage.isEmpty()) {
+    originalPages.append(originalPage);
+  }
 
-    if (glyph_info[i].codepoint != 10 && glyph_info[i].codepoint != 0x20) {
-      totalWidth += glyph_pos[i].x_advance;
-      continue;
-    }
+  hb_font_destroy(font);
+  hb_buffer_destroy(buffer);
 
-    double penalty = 0;
+  return originalPages;
 
-    //check nextglyph equal aya and set penalty
-    if (i != 0 && glyphNamePerCode[glyph_info[i - 1].codepoint].contains("aya")) {
-      // avoid break
-      penalty = 500;
-    }
-    //check previous glyph eual aya and set penalty
-    else if (i != glyph_count - 1 && glyphNamePerCode[glyph_info[i + 1].codepoint].contains("aya")) {
-      // prefer break
-      penalty = -1;
-    }
+}
 
-    auto forcedBreak = forcedBreaks.contains(glyph_info[i].cluster);
+LayoutPages OtLayout::pageBreak(double emScale, int lineWidth, bool pageFinishbyaVerse, int lastPage, hb_buffer_cluster_level_t  cluster_level) {
 
-    totalSpaces++;
+  bool isQurancomplex = false;
 
-    QHash<int, Candidate> potcandidates;
+  hb_buffer_t* buffer = hb_buffer_create();
 
-    auto activeit = actives.begin();
-    while (activeit != actives.end()) {
+  hb_buffer_set_direction(buffer, HB_DIRECTION_RTL);
+  hb_buffer_set_script(buffer, HB_SCRIPT_ARABIC);
+  hb_buffer_set_language(buffer, hb_language_from_string("ar", strlen("ar")));
+  hb_buffer_set_cluster_level(buffer, cluster_level);
 
-      auto active = &candidates.at(*activeit);
+  hb_font_t* font = this->createFont(emScale);
 
-      // must terminate a page with end of aya
-      // A page has always 15 lines
-      if (pageFinishbyaVerse) {
-        if (active->lineNumber == 14 && !(glyph_info[i + 1].codepoint >= Automedina::AyaNumberCode && glyph_info[i + 1].codepoint <= Automedina::AyaNumberCode + 286)) {
-          activeit++;
-          continue;
-        }
-      }
+  QString quran;
 
-      // calculate adjustment ratio
-      double adjRatio = 0.0;
-      if (nbPages <= 0) {
-        int nbSpaces = totalSpaces - active->totalSpaces - 1;
-        ParaWidth width = (totalWidth - active->totalWidth) + nbSpaces * spaceWidth;
-        if (width < lineWidth) { // short line
-          adjRatio = (lineWidth - width) / (nbSpaces * maxStretch);
-        }
-        else if (width > lineWidth) { // a long line
-          adjRatio = (lineWidth - width) / (nbSpaces * maxShrink);
-        }
+  // The first two pages and the pages from lastPage are laid out as they are in qurantext
+  for (int i = 2; i < lastPage; i++) {
+    //const char * text = qurantext[i];
+    const char* tt;
 
-        if (adjRatio < -1) {
-          activeit = actives.erase(activeit);
-          continue;
-        }
-      }
-      else {
-        int nbSpaces = totalSpaces - active->totalSpaces - 1;
-        auto wordsWidth = (totalWidth - active->totalWidth);
-        ParaWidth width = wordsWidth + nbSpaces * (spaceWidth);
-        //ParaWidth width = wordsWidth + nbSpaces * (200 * emScale);
-        double maxLineStretch = 0.05 * wordsWidth + nbSpaces * maxStretch;
-        double maxLineShrink = 0.01 * wordsWidth + nbSpaces * maxShrink;
-        if (width < lineWidth) { // short line
-          adjRatio = (lineWidth - width) / (maxLineStretch);
-        }
-        else if (width > lineWidth) { // a long line
-          adjRatio = (lineWidth - width) / (maxLineShrink);
-          if (adjRatio < -1) {
-            //adjRatio = lineWidth - width;
-          }
-        }
-        //std::cout << "lineWidth=" << lineWidth << ", maxLineShrink=" << maxLineShrink << ", width=" << width << ", adjRatio=" << adjRatio << std::endl;
-        /*
-        if (adjRatio < -100) {
-          activeit = actives.erase(activeit);
-          continue;
-        }*/
-      }
+    if (isQurancomplex) {
+      tt = quranComplex[i] + 1;
+    }
+    else {
+      tt = qurantext[i] + 1;
+    }
 
-      std::feclearexcept(FE_ALL_EXCEPT);
+    //unsigned int text_len = strlen(tt);
 
-      double demerits = 0;
-      double badness = 100 * std::pow(std::abs(adjRatio), 3);
-      if (penalty >= 0) {
-        demerits = (1 + std::pow(badness + penalty, 2));
-      }
-      else {
-        demerits = (1 + std::pow(badness, 2) - std::pow(penalty, 2));
-      }
+    quran.append(quran.fromUtf8(tt));
 
-      if ((bool)std::fetestexcept(FE_OVERFLOW) || (bool)std::fetestexcept(FE_UNDERFLOW)) {
-        throw "Error";
-      }
+    //hb_buffer_add_utf8(buffer, tt, text_len, 0, text_len);
 
-      double totalDemerits = active->totalDemerits + demerits;
+  }
 
-      /*
-                qDebug() << "index : " << active->index
-                    << ", lineNumber : " << active->lineNumber
-                    << ", pageNumber : " << active->pageNumber
-                    << ", totalSpaces : " << active->totalSpaces
-                    << ", totalWidth : " << active->totalWidth
-                    << ",active->totalDemerits : " << active->totalDemerits
-                    << ",demerits : " << demerits
-                    << ",totalDemerits : " << totalDemerits
-                    << ",currentIndex : " << i;*/
 
 
-      if ((bool)std::fetestexcept(FE_OVERFLOW) || (bool)std::fetestexcept(FE_UNDERFLOW)) {
-        throw "Error";
-      }
 
-      int lineNumber = active->lineNumber + 1;
-      int pageNumber = active->pageNumber;
-
-      if (lineNumber == 16) {
-        lineNumber = 1;
-        pageNumber = pageNumber + 1;
-      }
-
-      int key = lineNumber;
-
-      if (nbPages > 0) {
-        key = (pageNumber - 1) * 15 + lineNumber;
-      }
-
-
-      if (!potcandidates.contains(key) || potcandidates[key].totalDemerits > totalDemerits) {
-
-
-        potcandidates[key] = {};
-
-        Candidate* cand = &potcandidates[key];
-
-
-        cand->lineNumber = lineNumber;
-        cand->pageNumber = pageNumber;
-
-        cand->index = i;
-        cand->totalSpaces = totalSpaces;
-        cand->totalWidth = totalWidth;
-        cand->totalDemerits = totalDemerits;
-        cand->prev = *activeit;
-
-
-      }
-
-      if (nbPages > 0 && nbPages != 1) {
-        if (potcandidates.size() > 30 * 15) break;
-      }
-
-      activeit++;
-    }
-
-    if (forcedBreak) {
-      actives.clear();
-    }
-
-    for (auto& cand : potcandidates) {
-      actives.push_back(candidates.size());
-      candidates.push_back(cand);
-    }
-    std::sort(actives.begin(), actives.end(), sortActives);
-  }
-
-  Candidate* bestCandidate = nullptr;
-
-  double best = DEMERITS_INFTY;
-  for (auto activenum : actives) {
-    auto active = &candidates.at(activenum);
-    //qDebug() << "index : " << active->index << ", lineNumber : " << active->lineNumber << "Total demerits : " << active->totalDemerits;
-    if (active->index == 0 && active->totalDemerits < best && active->lineNumber == 15 && (!(nbPages > 0) || active->pageNumber == nbPages)) {
-      best = active->totalDemerits;
-      bestCandidate = active;
-    }
-
-  }
-
-  if (bestCandidate == nullptr) {
-    return {};
-  }
-
-
-  QStringList originalPage;
-  QList<QStringList> originalPages;
-
-
-  auto cand = bestCandidate;
-  int currentpageNumber = bestCandidate->pageNumber;
-
-  //std::cout << std::fixed << "lineWidth=" << lineWidth << ",spaceWidth=" << spaceWidth << ",maxStretch=" << maxStretch << ",maxShrink=" << maxShrink << std::endl;
-
-  while (cand->prev != -1) {
-
-    auto prev = &candidates.at(cand->prev);
-
-    int beginIndex = prev->index - 1;
-    int endIndex = cand->index + 1;
-
-    QString originalLine;
-
-    originalLine.append(text.mid(glyph_info[prev->index - 1].cluster, glyph_info[cand->index].cluster - glyph_info[prev->index - 1].cluster));
-
-    /*
-    int currentcluster = glyph_info[beginIndex].cluster;
-    int currentnewcluster = 0;
-
-    for (int i = beginIndex; i >= endIndex; i--) {
-
-      if (glyph_info[i].cluster != currentcluster) {
-        int clusternb = glyph_info[i].cluster - currentcluster;
-        originalLine.append(text.mid(currentcluster, clusternb));
-        currentcluster = glyph_info[i].cluster;
-        currentnewcluster += clusternb;
-      }
-
-    }*/
-
-    //originalLine.append(text.mid(currentcluster, glyph_info[endIndex - 1].cluster - currentcluster));
-
-    if (cand->pageNumber == currentpageNumber) {
-      originalPage.prepend(originalLine);
-    }
-    else {
-      currentpageNumber--;
-      originalPages.prepend(originalPage);
-      originalPage.clear();
-      originalPage.append(originalLine);
-
-    }
-
-    /*
-    int nbSpaces = cand->totalSpaces - prev->totalSpaces - 1;
-    auto wordsWidth = (cand->totalWidth - prev->totalWidth);
-    ParaWidth width = wordsWidth + nbSpaces * (spaceWidth);
-
-    std::cout << std::fixed << "pageNumber=" << cand->pageNumber << ",lineNumber=" << cand->lineNumber << ",demerits=" << cand->totalDemerits - prev->totalDemerits
-      << ",totalDemerits=" << cand->totalDemerits
-      << ",nbSpaces=" << nbSpaces
-      << ",wordsWidth=" << cand->totalWidth - prev->totalWidth
-      << ",currLineWidth=" << width
-      << std::endl;*/
-
-
-    cand = prev;
-  }
-
-
-  originalPages.prepend(originalPage);
-
-  return originalPages;
-
-}
-
-LayoutPages OtLayout::pageBreak(double emScale, int lineWidth, bool pageFinishbyaVerse, int lastPage, hb_buffer_cluster_level_t  cluster_level) {
-
-  bool use20_604_Format = true;
-
-  bool isQurancomplex = false;
-
-  typedef double ParaWidth;
-
-  struct Candidate {
-    size_t index;  // index int the text buffer
-    int prev;  // index to previous break
-    ParaWidth totalWidth;  // width of text until this point, if we decide to break here
-    double  totalDemerits;  // best demerits found for this break (index) and lineNumber
-    size_t lineNumber;  // only updated for non-constant line widths
-    size_t pageNumber;
-    size_t totalSpaces;  // preceding space count after breaking
-  };
-
-
-  const double DEMERITS_INFTY = std::numeric_limits<double>::max();
-
-  hb_buffer_t* buffer = buffer = hb_buffer_create();
-
-  hb_buffer_set_direction(buffer, HB_DIRECTION_RTL);
-  hb_buffer_set_script(buffer, HB_SCRIPT_ARABIC);
-  hb_buffer_set_language(buffer, hb_language_from_string("ar", strlen("ar")));
-  hb_buffer_set_cluster_level(buffer, cluster_level);
-
-  hb_font_t* font = this->createFont(emScale);
-
-  QString quran;
-
-  //for (int i = 2; i < lastPage; i++) {
-  for (int i = 581; i < 600; i++) {
-    //const char * text = qurantext[i];
-    const char* tt;
-
-    if (isQurancomplex) {
-      tt = quranComplex[i] + 1;
-    }
-    else {
-      tt = qurantext[i] + 1;
-    }
-
-    //unsigned int text_len = strlen(tt);
-
-    quran.append(quran.fromUtf8(tt));
-
-    //hb_buffer_add_utf8(buffer, tt, text_len, 0, text_len);
-
-  }
-
-
-
-
-  //quran = quran.replace(QRegularExpression("\\s*" + QString("۞") + "\\s*"), QString("۞") + " ");  
+  //quran = quran.replace(QRegularExpression("\\s*" + QString("۞") + "\\s*"), QString("۞") + " ");  
 
   QSet<int> lineBreaks;
   QSet<int> suraLines;
@@ -3048,191 +2831,29 @@ LayoutPages OtLayout::pageBreak(double emScale, int lineWidth, bool pageFinishby
 
   const int spaceWidth = 100 * emScale;
   const int maxStretch = 100 * emScale;
-  const int maxShrink = 50 * emScale;
 
   //ParaWidth lineWidth = (17000 - (2 * 400)) << OtLayout::SCALEBY;
 
   hb_glyph_info_t* glyph_info = hb_buffer_get_glyph_infos(buffer, &glyph_count);
   hb_glyph_position_t* glyph_pos = hb_buffer_get_glyph_positions(buffer, &glyph_count);
 
+  PageBreaker::Parameters parameters;
 
+  parameters.lineWidth = lineWidth;
+  parameters.spaceWidth = spaceWidth;
+  parameters.stretchPerLine = 0.05 * lineWidth;
+  parameters.shrinkPerLine = 0.02 * lineWidth;
+  parameters.nbPages = lastPage - 2;
+  parameters.pageFinishbyaVerse = pageFinishbyaVerse;
 
-  ParaWidth totalWidth = 0;
-  int totalSpaces = 0;
-  std::vector<int> actives;
-  std::vector<Candidate> candidates;
-
-  candidates.push_back({});
-  Candidate* initCand = &candidates.back();
-
-  initCand->pageNumber = 1;
-  initCand->lineNumber = 0;
-  initCand->index = glyph_count;
-  initCand->prev = -1;
-
-  actives.push_back(0);
-
-  for (int i = glyph_count - 1; i >= 0; i--) {
-
-    if (glyph_info[i].codepoint != 10 && glyph_info[i].codepoint != 0x20) {
-      totalWidth += glyph_pos[i].x_advance;
-      continue;
-    }
-
-    totalSpaces++;
-
-    QHash<int, int> potcandidates;
-
-    auto activeit = actives.begin();
-    while (activeit != actives.end()) {
-
-      auto active = &candidates.at(*activeit);
-
-      // must terminate a page with end of aya
-      // A page has always 15 lines
-      if (pageFinishbyaVerse) {
-        if (active->lineNumber == 14 && !(glyph_info[i + 1].codepoint >= Automedina::AyaNumberCode && glyph_info[i + 1].codepoint <= Automedina::AyaNumberCode + 286)) {
-          activeit++;
-          continue;
-        }
-      }
-
-      // calculate adjustment ratio
-      double adjRatio = 0.0;
-      if (!use20_604_Format) {
-        int spaces = totalSpaces - active->totalSpaces;
-        ParaWidth width = (totalWidth - active->totalWidth) + spaces * spaceWidth;
-        if (width < lineWidth) { // short line
-          adjRatio = (lineWidth - width) / (spaces * maxStretch);
-        }
-        else if (width > lineWidth) { // a long line
-          adjRatio = (lineWidth - width) / (spaces * maxShrink);
-        }
-
-        if (adjRatio < -1) {
-          activeit = actives.erase(activeit);
-          continue;
-        }
-      }
-      else {
-        int spaces = totalSpaces - active->totalSpaces;
-        ParaWidth width = (totalWidth - active->totalWidth) + spaces * spaceWidth;
-        double maxLineStretch = 0.05 * lineWidth;
-        double maxLineShrink = 0.02 * lineWidth;
-        if (width < lineWidth) { // short line
-          adjRatio = (lineWidth - width) / (maxLineStretch);
-        }
-        else if (width > lineWidth) { // a long line
-          adjRatio = (lineWidth - width) / (maxLineShrink);
-        }
-
-        if (adjRatio < -100) {
-          activeit = actives.erase(activeit);
-          continue;
-        }
-      }
-
-
-      //if (adjRatio < 160) {
-      double demerits = (1 + 100 * std::pow(std::abs(adjRatio), 3));
-
-      double totalDemerits = active->totalDemerits + demerits;
-
-      /*
-                qDebug() << "index : " << active->index
-                    << ", lineNumber : " << active->lineNumber
-                    << ", pageNumber : " << active->pageNumber
-                    << ", totalSpaces : " << active->totalSpaces
-                    << ", totalWidth : " << active->totalWidth
-                    << ",active->totalDemerits : " << active->totalDemerits
-                    << ",demerits : " << demerits
-                    << ",totalDemerits : " << totalDemerits
-                    << ",currentIndex : " << i;*/
+  auto brokenLines = PageBreaker(*this, buffer, lineBreaks).breakPages(parameters);
 
-      int lineNumber = active->lineNumber + 1;
-      int pageNumber = active->pageNumber;
-
-      if (lineNumber == 16) {
-        lineNumber = 1;
-        pageNumber = pageNumber + 1;
-      }
-
-      int key = lineNumber;
-
-      if (use20_604_Format) {
-        key = (pageNumber - 1) * 15 + lineNumber;
-      }
-
-
-      if (!potcandidates.contains(key) || candidates.at(potcandidates[key]).totalDemerits > totalDemerits) {
-
-
-        potcandidates[key] = candidates.size();
-
-        candidates.push_back({});
-        Candidate* cand = &candidates.back();
-
-
-        cand->lineNumber = lineNumber;
-        cand->pageNumber = pageNumber;
-
-        cand->index = i;
-        cand->totalSpaces = totalSpaces;
-        cand->totalWidth = totalWidth;
-        cand->totalDemerits = totalDemerits;
-        cand->prev = *activeit;
-
-
-      }
-
-      if (use20_604_Format) {
-        if (potcandidates.size() > 30 * 15) break;
-      }
-
-      activeit++;
-    }
-
-    if (lineBreaks.contains(glyph_info[i].cluster)) {
-      actives.clear();
-    }
-
-    for (auto cand : potcandidates) {
-      actives.push_back(cand);
-    }
-
-    std::sort(actives.begin(), actives.end(), [&candidates](const int& a, const int& b) {
-      if (candidates[a].pageNumber < candidates[b].pageNumber) {
-        return true;
-      }
-      else if (candidates[a].pageNumber > candidates[b].pageNumber) {
-
-        return false;
-      }
-      else {
-        return candidates[a].lineNumber < candidates[b].lineNumber;
-      }
-
-      });
-
-  }
-
-  Candidate* bestCandidate = nullptr;
-
-  double best = DEMERITS_INFTY;
-  for (auto activenum : actives) {
-    auto active = &candidates.at(activenum);
-    //qDebug() << "index : " << active->index << ", lineNumber : " << active->lineNumber << "Total demerits : " << active->totalDemerits;
-    if (active->index == 0 && active->totalDemerits < best && active->lineNumber == 15 && (!use20_604_Format || active->pageNumber == 18)) {
-      best = active->totalDemerits;
-      bestCandidate = active;
-    }
-
-  }
-
-  if (bestCandidate == nullptr) {
+  if (brokenLines.isEmpty()) {
     //QMessageBox msgBox;
     //msgBox.setText("No feasable solution. Try to change the scale.");
     //msgBox.exec();
+    hb_font_destroy(font);
+    hb_buffer_destroy(buffer);
     return {};
   }
 
@@ -3243,8 +2864,7 @@ LayoutPages OtLayout::pageBreak(double emScale, int lineWidth, bool pageFinishby
   QList<QString> suraNamebyPage;
 
 
-  auto cand = bestCandidate;
-  int currentpageNumber = bestCandidate->pageNumber;
+  int currentpageNumber = brokenLines.last().pageNumber;
 
   int nbbeginsajda = 0;
   int nbendsajda = 0;
@@ -3258,14 +2878,14 @@ LayoutPages OtLayout::pageBreak(double emScale, int lineWidth, bool pageFinishby
   QString firstSuraInCurrentage;
 
 
-  while (cand->prev != -1) {
+  for (int lineIndex = brokenLines.size() - 1; lineIndex >= 0; lineIndex--) {
 
-    auto prev = &candidates.at(cand->prev);
+    auto& line = brokenLines[lineIndex];
 
-    int beginIndex = prev->index - 1;
-    int endIndex = cand->index + 1;
-    int totalSpaces = cand->totalSpaces - prev->totalSpaces - 1;
-    int totalWidth = cand->totalWidth - prev->totalWidth;
+    int beginIndex = line.begin - 1;
+    int endIndex = line.end + 1;
+    int totalSpaces = line.spaces;
+    int totalWidth = line.wordsWidth;
 
     int minSpaceWidth = spaceWidth - maxStretch;
 
@@ -3285,7 +2905,7 @@ LayoutPages OtLayout::pageBreak(double emScale, int lineWidth, bool pageFinishby
 
     int currentxPos = 0;
 
-    if (cand->pageNumber != currentpageNumber) {
+    if (line.pageNumber != currentpageNumber) {
       if (!firstSuraInCurrentage.isEmpty()) {
         suraNamebyPage.prepend(firstSuraInCurrentage);
 
@@ -3384,7 +3004,7 @@ LayoutPages OtLayout::pageBreak(double emScale, int lineWidth, bool pageFinishby
 
 
 
-    if (cand->pageNumber == currentpageNumber) {
+    if (line.pageNumber == currentpageNumber) {
       lineLayout.ystartposition = currentyPos;
       currentPage.prepend(lineLayout);
       originalPage.prepend(originalLine);
@@ -3404,7 +3024,6 @@ LayoutPages OtLayout::pageBreak(double emScale, int lineWidth, bool pageFinishby
     }
 
     currentyPos -= OtLayout::InterLineSpacing << OtLayout::SCALEBY;
-    cand = &candidates.at(cand->prev);
 
 
   }
@@ -3515,7 +3134,7 @@ LayoutPages OtLayout::pageBreak(double emScale, int lineWidth, bool pageFinishby
     originalPages.append(lines);
   }
 
-  delete font;
+  hb_font_destroy(font);
   hb_buffer_destroy(buffer);
 
   //Compare text
@@ -3566,83 +3185,81 @@ GlyphVis* OtLayout::getAlternate(int glyphCode, GlyphParameters parameters, bool
     }
   }
 
-  auto cachedGlyphs = !generateNewGlyph ? &tempGlyphs[glyphCode] : &addedGlyphs[glyphCode];
+  auto findCached = [this, generateNewGlyph](int glyphCode, const GlyphParameters& parameters) -> GlyphVis* {
+    // getAlternate is also called without alternateMutex so the lookup must not reorder the cache
+    if (!generateNewGlyph) {
+      return tempGlyphs.peek(glyphCode, parameters);
+    }
+    auto& cachedGlyphs = addedGlyphs[glyphCode];
+    auto find = cachedGlyphs.find(parameters);
+    return find != cachedGlyphs.end() ? find->second : nullptr;
+    };
+
+  auto insertCached = [this, generateNewGlyph](int glyphCode, const GlyphParameters& parameters, GlyphVis* glyph) {
+    if (!generateNewGlyph) {
+      tempGlyphs.insert(glyphCode, parameters, glyph);
+    }
+    else {
+      addedGlyphs[glyphCode].insert({ parameters, glyph });
+    }
+    };
 
-  auto tryfind1 = cachedGlyphs->find(parameters);
+  GlyphVis* tryfind1 = findCached(glyphCode, parameters);
 
-  if (tryfind1 != cachedGlyphs->end()) {
+  if (tryfind1 != nullptr) {
     if (addToEquivSubst) {
       auto& tt = substEquivGlyphs[glyphCode];
-      tt.insert({ parameters, tryfind1->second });
+      tt.insert({ parameters, tryfind1 });
     }
-    return tryfind1->second;
+    return tryfind1;
   }
 
   auto glyph = this->getGlyph(glyphCode);
 
-  if (glyph->isAlternate) {
-    auto originalGlyph = glyph->originalglyph;
-    parameters.lefttatweel += glyph->charlt;
-    parameters.righttatweel += glyph->charrt;
-
-    glyph = &glyphs[originalGlyph];
-
-    glyphCode = glyph->charcode;
-  }
-
-  auto expnadable = expandableGlyphs.find(glyph->name);
-
-  if (expnadable != expandableGlyphs.end()) {
-    if (parameters.lefttatweel < expnadable->second.minLeft) {
-      parameters.lefttatweel = expnadable->second.minLeft;
-    }
-    else if (parameters.lefttatweel > expnadable->second.maxLeft) {
-      parameters.lefttatweel = expnadable->second.maxLeft;
-    }
-    if (parameters.righttatweel < expnadable->second.minRight) {
-      parameters.righttatweel = expnadable->second.minRight;
-    }
-    else if (parameters.righttatweel > expnadable->second.maxRight) {
-      parameters.righttatweel = expnadable->second.maxRight;
-    }
-  }
-  else if (parameters.scalex == 0) {
-    //std::cout << "No parameter is set for glyph " << glyph->name.toStdString() << std::endl;
+  if (!normalizeAlternateRequest(glyph, glyphCode, parameters)) {
     return glyph;
   }
 
-  cachedGlyphs = !generateNewGlyph ? &tempGlyphs[glyphCode] : &addedGlyphs[glyphCode];
-
-  auto tryfind2 = cachedGlyphs->find(parameters);
+  GlyphVis* tryfind2 = findCached(glyphCode, parameters);
 
-  if (tryfind2 != cachedGlyphs->end()) {
+  if (tryfind2 != nullptr) {
     if (addToEquivSubst) {
       auto& tt = substEquivGlyphs[glyphCode];
-      tt.insert({ parameters, tryfind2->second });
+      tt.insert({ parameters, tryfind2 });
+    }
+    return tryfind2;
+  }
+
+  if (!generateNewGlyph && interpolateAlternates) {
+    GlyphVis* interpolated = outlineInterpolator->interpolate(glyph, parameters);
+    if (interpolated != nullptr) {
+      interpolated->expanded = true;
+      tempGlyphs.insert(glyphCode, parameters, interpolated);
+      if (addToEquivSubst) {
+        auto& tt = substEquivGlyphs[glyphCode];
+        tt.insert({ parameters, interpolated });
+      }
+      return interpolated;
     }
-    return tryfind2->second;
   }
 
+  QString sourceCode;
+
   if (automedina->addedGlyphs.contains(glyph->name)) {
-    font->generateAlternate(glyph->name, parameters, automedina->addedGlyphs.value(glyph->name));
+    sourceCode = automedina->addedGlyphs.value(glyph->name);
   } else if (!font->glyphperName.contains(glyph->name)) {
     //std::cout << glyph->name.toStdString() << " is auto generated. It dows not exist in the original font" <<  std::endl;
     return glyph;
   }
-  else {
-    font->generateAlternate(glyph->name, parameters);
-  }
 
-  mp_edge_object* edge = font->getEdge(AlternatelastCode);
+  bool stored;
 
-  if (edge == nullptr) {
-    throw "Error";
-  }
+  mp_edge_object* edge = generateAlternateEdge(font->mp, glyph, parameters, sourceCode, stored);
 
   GlyphVis* newglyph = nullptr;
 
   if (!generateNewGlyph) {
-    newglyph = new	GlyphVis{ this, edge, true };
+    newglyph = new	GlyphVis{ this, edge, !stored };
     newglyph->expanded = true;
   }
   else {
@@ -3651,7 +3268,7 @@ GlyphVis* OtLayout::getAlternate(int glyphCode, GlyphParameters parameters, bool
 
     QString name = QString("%1.added_%2").arg(glyph->name).arg(charcode);
 
-    GlyphVis& temp = *glyphs.insert(name, GlyphVis(this, edge, true));
+    GlyphVis& temp = *glyphs.insert(name, GlyphVis(this, edge, !stored));
 
     newglyph = &temp;
 
@@ -3663,6 +3280,8 @@ GlyphVis* OtLayout::getAlternate(int glyphCode, GlyphParameters parameters, bool
     glyphNamePerCode[newglyph->charcode] = newglyph->name;
     glyphCodePerName[newglyph->name] = newglyph->charcode;
 
+    invalidateGlyphInfos();
+
 
 
     if (glyphGlobalClasses.contains(glyphCode)) {
@@ -3707,7 +3326,7 @@ GlyphVis* OtLayout::getAlternate(int glyphCode, GlyphParameters parameters, bool
     }
   }
 
-  cachedGlyphs->insert({ parameters, newglyph });
+  insertCached(glyphCode, parameters, newglyph);
 
   if (addToEquivSubst) {
     auto& tt = substEquivGlyphs[glyphCode];
@@ -3717,6 +3336,382 @@ GlyphVis* OtLayout::getAlternate(int glyphCode, GlyphParameters parameters, bool
   return newglyph;
 
 
+}
+mp_edge_object* OtLayout::generateAlternateEdge(MP instance, GlyphVis* glyph, GlyphParameters parameters, QString sourceCode, bool& stored) {
+
+  // Edges loaded from the alternate store stay alive until the store is closed so their body does not need to be copied
+  auto storeKey = AlternateStore::key(glyph->name, parameters, sourceCode, font->glyphSourceDigest(glyph->name));
+
+  mp_edge_object* edge = alternateStore->find(storeKey);
+
+  if (edge != nullptr) {
+    stored = true;
+    return edge;
+  }
+
+  font->generateAlternate(instance, glyph->name, parameters, sourceCode);
+
+  edge = font->getEdge(instance, AlternatelastCode);
+
+  if (edge == nullptr) {
+    throw "Error";
+  }
+
+  auto storedEdge = alternateStore->insert(storeKey, edge);
+
+  stored = storedEdge != nullptr;
+
+  return stored ? storedEdge : edge;
+}
+double OtLayout::getAdvance(GlyphVis* glyph, GlyphParameters parameters) {
+
+  int glyphCode = glyph->charcode;
+
+  GlyphVis* original = glyph;
+  GlyphParameters originalParameters = parameters;
+
+  if (!normalizeAlternateRequest(glyph, glyphCode, parameters)) {
+    return glyph->width;
+  }
+
+  AdvanceKey key{ glyphCode, {
+    std::hash<GlyphParameters>::quantize(parameters.lefttatweel),
+    std::hash<GlyphParameters>::quantize(parameters.righttatweel),
+    std::hash<GlyphParameters>::quantize(parameters.third),
+    std::hash<GlyphParameters>::quantize(parameters.fourth),
+    std::hash<GlyphParameters>::quantize(parameters.fifth),
+    std::hash<GlyphParameters>::quantize(parameters.scalex) } };
+
+  if (auto session = ShapingSession::current()) {
+
+    auto find = session->advances.find(key);
+
+    if (find != session->advances.end()) {
+      return find->second;
+    }
+
+    double width;
+    bool found;
+
+    // The masters are generated before taking the lock so that the other threads are not blocked while MetaPost runs
+    bool interpolable = interpolateAlternates && outlineInterpolator->prepare(glyph, parameters);
+
+    {
+      std::lock_guard<std::mutex> guard(alternateMutex);
+
+      auto shared = advances.find(key);
+
+      found = shared != advances.end();
+
+      if (found) {
+        width = shared->second;
+      }
+      else if (interpolable && outlineInterpolator->advance(glyph, parameters, width)) {
+        advances.insert({ key, width });
+        found = true;
+      }
+    }
+
+    if (!found) {
+      width = session->getAlternate(original->charcode, originalParameters)->width;
+
+      std::lock_guard<std::mutex> guard(alternateMutex);
+      advances.insert({ key, width });
+    }
+
+    session->advances.insert({ key, width });
+
+    return width;
+  }
+
+  auto find = advances.find(key);
+
+  if (find != advances.end()) {
+    return find->second;
+  }
+
+  double width;
+
+  if (!interpolateAlternates || !outlineInterpolator->advance(glyph, parameters, width)) {
+    width = getAlternate(original->charcode, originalParameters)->width;
+  }
+
+  advances.insert({ key, width });
+
+  return width;
+}
+void OtLayout::validateLineLayouts() {
+  std::lock_guard<std::mutex> guard(tableMutex);
+  auto gsub = getGSUB();
+  auto gpos = getGPOS();
+  auto gdef = getGDEF();
+  auto jtst = JTST();
+  lineLayouts->validate({ gsub, gpos, gdef, jtst });
+  // The anchors which GPOS is built from are part of the fingerprint of each stored line
+  justifications->validate({ gsub, gdef, jtst });
+}
+JustificationContext& OtLayout::currentJustificationContext() {
+  if (auto session = ShapingSession::current()) {
+    return session->justificationContext;
+  }
+  return justificationContext;
+}
+bool OtLayout::normalizeAlternateRequest(GlyphVis*& glyph, int& glyphCode, GlyphParameters& parameters) {
+
+  if (glyph->isAlternate) {
+    auto originalGlyph = glyph->originalglyph;
+    parameters.lefttatweel += glyph->charlt;
+    parameters.righttatweel += glyph->charrt;
+
+    glyph = &glyphs[originalGlyph];
+
+    glyphCode = glyph->charcode;
+  }
+
+  auto expnadable = expandableGlyphs.find(glyph->name);
+
+  if (expnadable != expandableGlyphs.end()) {
+    if (parameters.lefttatweel < expnadable->second.minLeft) {
+      parameters.lefttatweel = expnadable->second.minLeft;
+    }
+    else if (parameters.lefttatweel > expnadable->second.maxLeft) {
+      parameters.lefttatweel = expnadable->second.maxLeft;
+    }
+    if (parameters.righttatweel < expnadable->second.minRight) {
+      parameters.righttatweel = expnadable->second.minRight;
+    }
+    else if (parameters.righttatweel > expnadable->second.maxRight) {
+      parameters.righttatweel = expnadable->second.maxRight;
+    }
+  }
+  else if (parameters.scalex == 0) {
+    //std::cout << "No parameter is set for glyph " << glyph->name.toStdString() << std::endl;
+    return false;
+  }
+
+  return true;
+}
+GlyphVis* OtLayout::getAlternateConcurrent(int glyphCode, GlyphParameters parameters) {
+
+  if (font->metaPostPoolSize() == 0) {
+    std::lock_guard<std::mutex> guard(alternateMutex);
+    return getAlternate(glyphCode, parameters);
+  }
+
+  GlyphVis* glyph = nullptr;
+  QString sourceCode;
+
+  {
+    std::lock_guard<std::mutex> guard(alternateMutex);
+
+    GlyphVis* tryfind1 = tempGlyphs.find(glyphCode, parameters);
+    if (tryfind1 != nullptr) {
+      return tryfind1;
+    }
+
+    glyph = this->getGlyph(glyphCode);
+
+    if (glyph == nullptr || !normalizeAlternateRequest(glyph, glyphCode, parameters)) {
+      return glyph;
+    }
+
+    GlyphVis* tryfind2 = tempGlyphs.find(glyphCode, parameters);
+    if (tryfind2 != nullptr) {
+      return tryfind2;
+    }
+  }
+
+  // Same outlines as getAlternate so that shaping in a ShapingSession does not change the result.
+  // The masters are generated before taking the lock, which is held to copy the outline to the arena of the alternates.
+  if (interpolateAlternates && outlineInterpolator->prepare(glyph, parameters)) {
+    std::lock_guard<std::mutex> guard(alternateMutex);
+
+    GlyphVis* interpolated = outlineInterpolator->interpolate(glyph, parameters);
+    if (interpolated != nullptr) {
+      interpolated->expanded = true;
+      auto inserted = tempGlyphs.insert(glyphCode, parameters, interpolated);
+      if (!inserted.second) {
+        delete interpolated;
+      }
+      return inserted.first;
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(alternateMutex);
+
+    if (automedina->addedGlyphs.contains(glyph->name)) {
+      sourceCode = automedina->addedGlyphs.value(glyph->name);
+    }
+    else if (!font->glyphperName.contains(glyph->name)) {
+      return glyph;
+    }
+  }
+
+  GlyphVis* newglyph = nullptr;
+
+  mp_edge_object* storedEdge = alternateStore->find(AlternateStore::key(glyph->name, parameters, sourceCode, font->glyphSourceDigest(glyph->name)));
+
+  if (storedEdge != nullptr) {
+    newglyph = new GlyphVis{ this, storedEdge, false };
+    newglyph->expanded = true;
+  }
+  else {
+    MP instance = font->acquireInstance();
+
+    try {
+      bool stored;
+
+      mp_edge_object* edge = generateAlternateEdge(instance, glyph, parameters, sourceCode, stored);
+
+      // The path is copied before the instance is released since the next alternate replaces this edge
+      newglyph = new GlyphVis{ this, edge, !stored };
+      newglyph->expanded = true;
+    }
+    catch (...) {
+      font->releaseInstance(instance);
+      throw;
+    }
+
+    font->releaseInstance(instance);
+  }
+
+  std::lock_guard<std::mutex> guard(alternateMutex);
+
+  auto inserted = tempGlyphs.insert(glyphCode, parameters, newglyph);
+
+  if (!inserted.second) {
+    // Another thread generated the same alternate in the meantime
+    delete newglyph;
+    return inserted.first;
+  }
+
+  return newglyph;
+}
+void OtLayout::prefetchAlternates(const std::vector<std::pair<int, GlyphParameters>>& requests) {
+
+  struct PendingAlternate {
+    int glyphCode;
+    GlyphParameters parameters;
+    QString storeKey;
+  };
+
+  bool usePool = font->metaPostPoolSize() != 0;
+
+  std::vector<PendingAlternate> pending;
+  QVector<Font::AlternateRequest> batch;
+  std::unordered_map<int, std::unordered_set<GlyphParameters>> requested;
+
+  std::unique_lock<std::mutex> lock(alternateMutex);
+
+  for (auto& request : requests) {
+    int glyphCode = request.first;
+    GlyphParameters parameters = request.second;
+
+    if (tempGlyphs.contains(glyphCode, parameters)) continue;
+
+    GlyphVis* glyph = this->getGlyph(glyphCode);
+
+    if (glyph == nullptr || !normalizeAlternateRequest(glyph, glyphCode, parameters)) continue;
+
+    if (tempGlyphs.contains(glyphCode, parameters)) continue;
+
+    if (!requested[glyphCode].insert(parameters).second) continue;
+
+    // Same outlines as getAlternate and getAlternateConcurrent, whether the pool is used or not
+    if (interpolateAlternates) {
+      bool interpolable = true;
+      if (usePool) {
+        // The masters are generated on the pool without blocking the other threads
+        lock.unlock();
+        interpolable = outlineInterpolator->prepare(glyph, parameters);
+        lock.lock();
+        if (tempGlyphs.contains(glyphCode, parameters)) continue;
+      }
+      GlyphVis* interpolated = interpolable ? outlineInterpolator->interpolate(glyph, parameters) : nullptr;
+      if (interpolated != nullptr) {
+        interpolated->expanded = true;
+        tempGlyphs.insert(glyphCode, parameters, interpolated, true);
+        continue;
+      }
+    }
+
+    QString sourceCode;
+
+    if (automedina->addedGlyphs.contains(glyph->name)) {
+      sourceCode = automedina->addedGlyphs.value(glyph->name);
+    }
+    else if (!font->glyphperName.contains(glyph->name)) {
+      continue;
+    }
+
+    auto storeKey = AlternateStore::key(glyph->name, parameters, sourceCode, font->glyphSourceDigest(glyph->name));
+
+    mp_edge_object* storedEdge = alternateStore->find(storeKey);
+
+    if (storedEdge != nullptr) {
+      GlyphVis* newglyph = new GlyphVis{ this, storedEdge, false };
+      newglyph->expanded = true;
+      tempGlyphs.insert(glyphCode, parameters, newglyph, true);
+      continue;
+    }
+
+    pending.push_back({ glyphCode, parameters, storeKey });
+    batch.append({ glyph->name, parameters, sourceCode });
+  }
+
+  if (batch.isEmpty()) return;
+
+  std::vector<GlyphVis*> newglyphs(pending.size(), nullptr);
+
+  auto build = [&](MP instance) {
+    auto edges = font->generateAlternates(instance, batch);
+
+    // The paths are copied before the next execution on the instance replaces the edges
+    for (int i = 0; i < edges.size(); i++) {
+      if (edges[i] == nullptr) continue;
+      auto storedEdge = alternateStore->insert(pending[i].storeKey, edges[i]);
+      newglyphs[i] = new GlyphVis{ this, storedEdge != nullptr ? storedEdge : edges[i], storedEdge == nullptr };
+      newglyphs[i]->expanded = true;
+    }
+  };
+
+  if (usePool) {
+    lock.unlock();
+
+    MP instance = font->acquireInstance();
+
+    try {
+      build(instance);
+    }
+    catch (...) {
+      font->releaseInstance(instance);
+      for (auto newglyph : newglyphs) delete newglyph;
+      throw;
+    }
+
+    font->releaseInstance(instance);
+
+    lock.lock();
+  }
+  else {
+    try {
+      build(font->mp);
+    }
+    catch (...) {
+      for (auto newglyph : newglyphs) delete newglyph;
+      throw;
+    }
+  }
+
+  for (int i = 0; i < pending.size(); i++) {
+    if (newglyphs[i] == nullptr) continue;
+    auto inserted = tempGlyphs.insert(pending[i].glyphCode, pending[i].parameters, newglyphs[i], true);
+    if (!inserted.second) {
+      // Another thread generated the same alternate in the meantime
+      delete newglyphs[i];
+    }
+  }
 }
 QByteArray OtLayout::getCmap() {
 
@@ -29,14 +29,21 @@
 #include <optional>
 #include <unordered_map>
 #include <set>
+#include <algorithm>
 #include <QDataStream>
 #include "to_opentype.h"
 #include "FSMDriver.h"
 #include "JustificationContext.h"
 #include "qobject.h"
 #include "commontypes.h"
+#include "AlternateCache.h"
+#include "OtTableBuilder.h"
+#include "WordWidthCache.h"
+#include "StretchProfileCache.h"
 #include <stdexcept>
 #include <iostream>
+#include <mutex>
+#include <memory>
 #include "hb.h"
 #include "global.h"
 
@@ -48,13 +55,18 @@ struct hb_font_t;
 struct hb_face_t;
 class Automedina;
 class GlyphVis;
+class AlternateStore;
+class OutlineInterpolator;
+class OutlineArena;
+class LineLayoutCache;
+class JustificationStore;
 struct Subtable;
 struct MarkBaseSubtable;
 
 struct hb_buffer_t;
 
 typedef struct MP_instance* MP;
-
+struct mp_edge_object;
 
 
 struct ExtendedGlyph {
@@ -190,6 +202,8 @@ class OtLayout : public QObject {
   friend class GlyphVis;
   friend class LayoutWindow;
   friend class ToOpenType;
+  friend class OutlineInterpolator;
+  friend class ShapingSession;
 public:
 
   constexpr static int FrameHeight = 27400;
@@ -229,6 +243,8 @@ public:
   QByteArray getGSUB();
   QByteArray getGPOS();
   QByteArray getGDEF();
+  // Blob on the table kept alive by the faces using it, the last one is shared while the table does not change
+  hb_blob_t* getTableBlob(hb_tag_t tag, const QByteArray& data);
 
 public:
 
@@ -315,11 +331,43 @@ public:
 
   bool applyJustification = true;
 
+  // Build intermediate tatweel alternates by interpolating between masters instead of running MetaPost for each value.
+  // Enabled by default for variable fonts since the outlines then match the rendering of the generated font.
+  bool interpolateAlternates = false;
+
   GlyphVis* getAlternate(int glyphCode, GlyphParameters parameters, bool generateNewGlyph = false, bool addToEquivSubst = false);
+  // Thread-safe variant of getAlternate for temporary alternates. MetaPost work runs on an instance checked out from the font pool
+  // (see Font::initMetaPostPool) so several threads can generate alternates at the same time.
+  GlyphVis* getAlternateConcurrent(int glyphCode, GlyphParameters parameters);
+  // Generates the missing temporary alternates of the requests with a single MetaPost execution (see Font::generateAlternates).
+  // Thread-safe, uses an instance of the font pool when it is initialized.
+  void prefetchAlternates(const std::vector<std::pair<int, GlyphParameters>>& requests);
   std::unordered_map<GlyphParameters, GlyphVis*>& getSubstEquivGlyphs(int glyphCode);
+  // Width of the alternate of the glyph, memoized by glyph code and quantized parameters. It is interpolated from the masters
+  // when interpolateAlternates is set, otherwise the alternate is generated once by getAlternate.
+  double getAdvance(GlyphVis* glyph, GlyphParameters parameters);
   hb_position_t gethHorizontalAdvance(hb_font_t* hbFont, hb_codepoint_t glyph, GlyphParameters parameters, void* userData);
 
   void clearAlternates();
+  // Incremented by clearAlternates, the anchors computed on the previous alternates are not reused
+  uint64_t alternateGeneration = 0;
+
+  // Widths of the words shaped by the feature based justification, cleared with the alternates and when the face is replaced
+  WordWidthCache wordWidths;
+  // Stretch profiles of the words justified by the simple feature justification, cleared with the word widths
+  StretchProfileCache stretchProfiles;
+  // Lines justified by justifyPage, reused by the following calls for the lines which did not change
+  LineLayoutCache* lineLayouts = nullptr;
+  // Lines justified by the feature based justification in the previous runs, kept next to the alternates of the font
+  JustificationStore* justifications = nullptr;
+
+  // Evicts the least recently used temporary alternates until the cache fits its budget (see setAlternateCacheBudget).
+  // Pointers returned by getAlternate may be deleted, so it is only called between pages when no alternate is in use.
+  void trimAlternates();
+  // Memory budget of the temporary alternates in bytes, 0 keeps every alternate until clearAlternates
+  void setAlternateCacheBudget(size_t bytes);
+  AlternateCache::Stats alternateCacheStats();
+  void resetAlternateCacheStats();
 
   void parseCppLookup(QString lookupName);
 
@@ -335,7 +383,10 @@ public:
     fsmDriver.executeFSM(subtable, c);
   }
 
+  // Used by the substitution callback when shaping outside a ShapingSession
   JustificationContext justificationContext;
+  // Context of the session of the calling thread, justificationContext outside a session
+  JustificationContext& currentJustificationContext();
 
   bool isOTVar = false;
 
@@ -345,6 +396,48 @@ public:
 
   std::unordered_map<QString, ValueLimits> expandableGlyphs;
 
+  // What the harfbuzz callbacks need for a glyph code without hashing its name
+  struct GlyphInfo {
+    GlyphVis* glyph = nullptr;
+    quint16 gdefClass = 0;
+    double advance = 0;
+    const ValueLimits* limits = nullptr;
+
+    // Glyph names tested by the substitution callback and the page breaker
+    enum NameFlags : quint8 {
+      Expa = 1,
+      BehshapeMediExpa = 2,
+      BehshapeMedi = 4,
+      Aya = 8
+    };
+    quint8 nameFlags = 0;
+  };
+
+  // Null for the codes added since the table was built by createFont, which are looked up by name as before
+  const GlyphInfo* glyphInfo(hb_codepoint_t code) const {
+    return code < glyphInfos.size() && glyphInfos[code].glyph != nullptr ? &glyphInfos[code] : nullptr;
+  }
+  void invalidateGlyphInfos() { glyphInfosValid = false; }
+
+  bool glyphNameIs(hb_codepoint_t code, GlyphInfo::NameFlags flag) const {
+    auto info = glyphInfo(code);
+    if (info != nullptr) {
+      return info->nameFlags & flag;
+    }
+    auto name = glyphNamePerCode.value(code);
+    switch (flag) {
+    case GlyphInfo::Expa:
+      return name.contains(".expa");
+    case GlyphInfo::BehshapeMediExpa:
+      return name == "behshape.medi.expa";
+    case GlyphInfo::BehshapeMedi:
+      return name == "behshape.medi";
+    case GlyphInfo::Aya:
+      return name.contains("aya");
+    }
+    return false;
+  }
+
   std::pair<int, int> getDeltaSetEntry(DefaultDelta delta, const int subregionIndex) {
     return toOpenType->getDeltaSetEntry(delta, subregionIndex);
   }
@@ -376,17 +469,24 @@ public:
 
     ValueLimits limits;
 
-    const auto& name = glyphNamePerCode.value(code);
+    auto info = glyphInfo(code);
 
-    const auto& find = expandableGlyphs.find(name);
-
-    if (find == expandableGlyphs.end()) {
-      //throw new std::runtime_error("tatweel error for glyph " + name.toStdString());
-      std::cout << "No expandable glyph " + name.toStdString() + "\n";
-      return tatweel;
+    if (info != nullptr && info->limits != nullptr) {
+      limits = *info->limits;
     }
+    else {
+      const auto& name = glyphNamePerCode.value(code);
 
-    limits = find->second;
+      const auto& find = expandableGlyphs.find(name);
+
+      if (find == expandableGlyphs.end()) {
+        //throw new std::runtime_error("tatweel error for glyph " + name.toStdString());
+        std::cout << "No expandable glyph " + name.toStdString() + "\n";
+        return tatweel;
+      }
+
+      limits = find->second;
+    }
 
     double min = left ? limits.minLeft : limits.minRight;
     double max = left ? limits.maxLeft : limits.maxRight;
@@ -429,18 +529,63 @@ private:
   QByteArray getFeatureList(QMap<QString, QSet<quint16>> allFeatures);
   QByteArray getScriptList(int featureCount);
 
+  void updateGlyphInfos();
+
+  std::vector<GlyphInfo> glyphInfos;
+  bool glyphInfosValid = false;
+
+  OtTableBuilder gsubBuilder;
+  OtTableBuilder gposBuilder;
+  QHash<hb_tag_t, hb_blob_t*> tableBlobs;
+  // The faces of concurrent sessions may load their tables at the same time
+  std::mutex tableMutex;
+  // Sessions are created on the shaping threads, the first one builds the glyph infos and the face for the others
+  std::mutex faceMutex;
+
 
   double _nuqta = -1;
 
   QSet<Lookup*> disabledLookups;
 
   
-  std::unordered_map<int, std::unordered_map<GlyphParameters, GlyphVis*>> tempGlyphs;
+  AlternateCache tempGlyphs{ 256 * 1024 * 1024 };
   std::unordered_map<int, std::unordered_map<GlyphParameters, GlyphVis*>> addedGlyphs;
   std::unordered_map<int, std::unordered_map<GlyphParameters, GlyphVis*>> substEquivGlyphs;
 
+  struct AdvanceKey {
+    int glyphCode;
+    uint64_t parameters[6];
+
+    bool operator==(const AdvanceKey& r) const {
+      return glyphCode == r.glyphCode && std::equal(std::begin(parameters), std::end(parameters), std::begin(r.parameters));
+    }
+  };
+
+  struct AdvanceKeyHash {
+    size_t operator()(const AdvanceKey& key) const {
+      uint64_t h = std::hash<GlyphParameters>::mix((uint64_t)(uint32_t)key.glyphCode);
+      for (auto parameter : key.parameters) {
+        h = std::hash<GlyphParameters>::mix(h ^ parameter);
+      }
+      return (size_t)h;
+    }
+  };
+
+  std::unordered_map<AdvanceKey, double, AdvanceKeyHash> advances;
+
+  // Clears the justified lines when the tables they depend on changed
+  void validateLineLayouts();
+
+
+  std::mutex alternateMutex;
+
+  AlternateStore* alternateStore = nullptr;
+  OutlineInterpolator* outlineInterpolator = nullptr;
+  // Storage of the outlines copied for the current generation of alternates, replaced by clearAlternates
+  std::shared_ptr<OutlineArena> outlineArena;
+  mp_edge_object* generateAlternateEdge(MP instance, GlyphVis* glyph, GlyphParameters parameters, QString sourceCode, bool& stored);
 
-  bool JustificationInProgress = false;
+  bool normalizeAlternateRequest(GlyphVis*& glyph, int& glyphCode, GlyphParameters& parameters);
 
   void applyJustFeature(hb_buffer_t* buffer, bool& needgpos, double& diff, QString feature, hb_font_t* shapefont, double nuqta, double emScale);
   void applyJustFeature_old(hb_buffer_t* buffer, bool& needgpos, double& diff, QString feature, hb_font_t* shapefont, double nuqta, double emScale);
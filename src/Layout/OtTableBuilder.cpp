@@ -0,0 +1,251 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#include "OtTableBuilder.h"
+#include "Subtable.h"
+#include "Lookup.h"
+#include "QByteArrayOperator.h"
+#include <QtEndian>
+#include <cstring>
+#include <iostream>
+
+QByteArray OtTableBuilder::build(const QByteArray& header, bool isgsub, bool extended, const QVector<LookupEntry>& lookups, const QVector<SubtableEntry>& subtables) {
+
+  auto states = lookupStates(lookups);
+
+  bool sameStructure = !table.isEmpty() && header == this->header && isgsub == this->isgsub && extended == this->extended
+    && states == this->lookups && subtables.size() == slots.size();
+
+  for (int i = 0; sameStructure && i < subtables.size(); i++) {
+    sameStructure = subtables[i].subtable == slots[i].entry.subtable && subtables[i].converted == slots[i].entry.converted;
+  }
+
+  if (sameStructure) {
+    return update();
+  }
+
+  this->header = header;
+  this->isgsub = isgsub;
+  this->extended = extended;
+  this->lookups = states;
+
+  slots.clear();
+  slots.reserve(subtables.size());
+  for (auto& entry : subtables) {
+    slots.append({ entry, QByteArray(), 0 });
+  }
+
+  return fullBuild();
+}
+
+void OtTableBuilder::clear() {
+  table.clear();
+  header.clear();
+  lookups.clear();
+  slots.clear();
+  extensionOffsets.clear();
+  lookupListSize = 0;
+}
+
+QVector<OtTableBuilder::LookupState> OtTableBuilder::lookupStates(const QVector<LookupEntry>& lookups) {
+
+  QVector<LookupState> states;
+  states.reserve(lookups.size());
+
+  for (auto& entry : lookups) {
+    states.append({ entry.lookup, (quint16)entry.lookup->type, entry.lookup->flags, entry.lookup->markGlyphSetIndex, entry.subtables });
+  }
+
+  return states;
+}
+
+QByteArray OtTableBuilder::serialize(const SubtableEntry& entry, bool extended) {
+
+  auto subtable = entry.subtable;
+  auto lookup = subtable->getLookup();
+
+  QByteArray subtableArray = entry.converted ? subtable->getConvertedOpenTypeTable() : subtable->getOptOpenTypeTable(extended);
+
+  if (lookup->type != Lookup::fsmgsub && subtableArray.size() > 0xFFFF) {
+    std::cout << lookup->name.toStdString() << " : Subtable " << subtable->name.toStdString()
+      << " exceeds the limit of 64K : " << subtableArray.size()
+      << std::endl;
+  }
+
+  return subtableArray;
+}
+
+QByteArray OtTableBuilder::fullBuild() {
+
+  for (auto& slot : slots) {
+    slot.data = serialize(slot.entry, extended);
+  }
+
+  quint16 lookupCount = lookups.size();
+
+  lookupListSize = 2 + 2 * lookupCount;
+
+  for (auto& lookup : lookups) {
+    quint32 nb_subtables = lookup.subtables.size();
+
+    //lookup header
+    lookupListSize += 2 + 2 + 2 + 2 * nb_subtables;
+
+    if (lookup.markGlyphSetIndex != -1) {
+      lookupListSize += 2;
+    }
+
+    //extension subtables
+    lookupListSize += 8 * nb_subtables;
+  }
+
+  quint32 subtablesOffset = lookupListSize;
+
+  for (auto& slot : slots) {
+    slot.offset = subtablesOffset;
+    subtablesOffset += slot.data.size();
+  }
+
+  extensionOffsets.clear();
+
+  QByteArray lookupList;
+  QByteArray lookups_array;
+  lookupList << lookupCount;
+
+  quint16 beginoffset = 2 + 2 * lookupCount;
+  quint16 extensiontype = isgsub ? Lookup::extensiongsub : Lookup::extensiongpos;
+
+  for (auto& lookup : lookups) {
+
+    quint16 nb_subtables = lookup.subtables.size();
+
+    QByteArray lookupArray;
+
+    lookupArray << extensiontype;
+    lookupArray << lookup.flags;
+    lookupArray << nb_subtables;
+
+    quint16 debutsequence = 2 + 2 + 2 + 2 * nb_subtables;
+
+    if (lookup.markGlyphSetIndex != -1) {
+      debutsequence += 2;
+    }
+
+    QByteArray exttables_array;
+
+    for (int slot : lookup.subtables) {
+
+      lookupArray << debutsequence;
+
+      quint32 base = beginoffset + debutsequence;
+
+      extensionOffsets.append({ slot, (int)(header.size() + base + 4), base });
+
+      exttables_array << (quint16)1 << lookup.type << (quint32)(slots[slot].offset - base);
+
+      debutsequence += 8;
+    }
+
+    if (lookup.markGlyphSetIndex != -1) {
+      lookupArray << lookup.markGlyphSetIndex;
+    }
+
+    lookupArray.append(exttables_array);
+    lookups_array.append(lookupArray);
+
+    lookupList << beginoffset;
+
+    beginoffset += lookupArray.size();
+  }
+
+  lookupList.append(lookups_array);
+
+  table = header;
+  table.reserve(header.size() + subtablesOffset);
+  table.append(lookupList);
+
+  for (auto& slot : slots) {
+    table.append(slot.data);
+  }
+
+  return table;
+}
+
+QByteArray OtTableBuilder::update() {
+
+  QVector<int> changed;
+  bool resized = false;
+
+  for (int i = 0; i < slots.size(); i++) {
+    auto& slot = slots[i];
+
+    // A cached subtable still sharing the data of the table did not change
+    auto cached = slot.entry.converted ? nullptr : slot.entry.subtable->cachedOpenTypeTable();
+    if (cached != nullptr && cached->constData() == slot.data.constData()) continue;
+
+    QByteArray data = serialize(slot.entry, extended);
+
+    if (data != slot.data) {
+      changed.append(i);
+      resized = resized || data.size() != slot.data.size();
+    }
+
+    slot.data = data;
+  }
+
+  if (changed.isEmpty()) {
+    return table;
+  }
+
+  // The previous table may still be used by a face, the new one is a copy
+  if (!resized) {
+    QByteArray newTable = table;
+    char* d = newTable.data();
+    for (int i : changed) {
+      auto& slot = slots[i];
+      memcpy(d + header.size() + slot.offset, slot.data.constData(), slot.data.size());
+    }
+    table = newTable;
+    return table;
+  }
+
+  quint32 subtablesOffset = lookupListSize;
+
+  for (auto& slot : slots) {
+    slot.offset = subtablesOffset;
+    subtablesOffset += slot.data.size();
+  }
+
+  QByteArray newTable;
+  newTable.reserve(header.size() + subtablesOffset);
+  newTable.append(table.constData(), header.size() + lookupListSize);
+
+  for (auto& slot : slots) {
+    newTable.append(slot.data);
+  }
+
+  char* d = newTable.data();
+  for (auto& extensionOffset : extensionOffsets) {
+    qToBigEndian<quint32>(slots[extensionOffset.slot].offset - extensionOffset.base, d + extensionOffset.position);
+  }
+
+  table = newTable;
+
+  return table;
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#pragma once
+
+#include <QByteArray>
+#include <QVector>
+
+struct Subtable;
+struct Lookup;
+
+/*
+  Builds a GSUB or GPOS table from its header (script and feature lists) and its lookups, every subtable being wrapped
+  in an extension subtable.
+
+  The previous table is kept with the position of each subtable and of each extension offset. When the header and the
+  lookups did not change, only the subtables which are not cached by Subtable::getOptOpenTypeTable are serialized again :
+  they are written in place when their size did not change, otherwise the subtable data is appended again and only the
+  extension offsets are rewritten. A table whose subtables did not change at all is returned as is, which lets the
+  harfbuzz blob built on it be shared by the following faces.
+*/
+class OtTableBuilder {
+public:
+
+  struct LookupEntry {
+    Lookup* lookup;
+    // Index in subtables of the subtables of the lookup, a lookup may share the subtables of a previous one
+    QVector<int> subtables;
+  };
+
+  struct SubtableEntry {
+    Subtable* subtable;
+    // Serialized with getConvertedOpenTypeTable, which is never cached
+    bool converted;
+  };
+
+  QByteArray build(const QByteArray& header, bool isgsub, bool extended, const QVector<LookupEntry>& lookups, const QVector<SubtableEntry>& subtables);
+
+  void clear();
+
+private:
+
+  struct LookupState {
+    Lookup* lookup;
+    quint16 type;
+    quint16 flags;
+    quint16 markGlyphSetIndex;
+    QVector<int> subtables;
+
+    bool operator==(const LookupState& r) const {
+      return lookup == r.lookup && type == r.type && flags == r.flags && markGlyphSetIndex == r.markGlyphSetIndex && subtables == r.subtables;
+    }
+  };
+
+  struct Slot {
+    SubtableEntry entry;
+    QByteArray data;
+    quint32 offset;
+  };
+
+  struct ExtensionOffset {
+    int slot;
+    // Position of the offset in the table and offset of the extension subtable from the lookup list
+    int position;
+    quint32 base;
+  };
+
+  QByteArray serialize(const SubtableEntry& entry, bool extended);
+  static QVector<LookupState> lookupStates(const QVector<LookupEntry>& lookups);
+  QByteArray fullBuild();
+  QByteArray update();
+
+  QByteArray table;
+  QByteArray header;
+  bool isgsub = true;
+  bool extended = false;
+  QVector<LookupState> lookups;
+  QVector<Slot> slots;
+  QVector<ExtensionOffset> extensionOffsets;
+  quint32 lookupListSize = 0;
+};
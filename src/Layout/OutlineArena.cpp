@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#include "OutlineArena.h"
+#include <cstdlib>
+#include <new>
+
+OutlineArena::OutlineArena(size_t blockSize) : blockSize{ blockSize } {
+}
+
+OutlineArena::~OutlineArena() {
+  for (auto block : blocks) {
+    std::free(block);
+  }
+}
+
+void* OutlineArena::allocate(size_t size) {
+
+  constexpr size_t alignment = alignof(std::max_align_t);
+
+  size = (size + alignment - 1) & ~(alignment - 1);
+
+  std::lock_guard<std::mutex> guard(arenaMutex);
+
+  if (size > remaining) {
+    size_t newSize = size > blockSize ? size : blockSize;
+    char* block = static_cast<char*>(std::calloc(1, newSize));
+    if (block == nullptr) {
+      throw std::bad_alloc();
+    }
+    blocks.push_back(block);
+    allocated += newSize;
+    current = block;
+    remaining = newSize;
+  }
+
+  void* ret = current;
+  current += size;
+  remaining -= size;
+
+  return ret;
+}
+
+size_t OutlineArena::allocatedBytes() {
+  std::lock_guard<std::mutex> guard(arenaMutex);
+  return allocated;
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include <cstddef>
+
+/*
+  Region allocator for the outlines copied by Font::copyEdgeBody.
+  Allocations are zero-initialized and are never freed one by one, the whole arena is released when the last
+  GlyphVis referencing it is destroyed. OtLayout starts a new arena for each generation of the alternate caches.
+*/
+class OutlineArena {
+public:
+  OutlineArena(size_t blockSize = 64 * 1024);
+  ~OutlineArena();
+
+  OutlineArena(const OutlineArena&) = delete;
+  OutlineArena& operator=(const OutlineArena&) = delete;
+
+  void* allocate(size_t size);
+
+  // Size of the blocks held by the arena
+  size_t allocatedBytes();
+
+private:
+  std::vector<char*> blocks;
+  size_t blockSize;
+  char* current = nullptr;
+  size_t remaining = 0;
+  size_t allocated = 0;
+  std::mutex arenaMutex;
+};
@@ -0,0 +1,406 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#include "OutlineInterpolator.h"
+#include "OutlineArena.h"
+#include "OtLayout.h"
+#include "GlyphVis.h"
+#include "font.hpp"
+#ifndef DIGITALKHATT_WEBLIB
+#include "glyph.hpp"
+#endif
+#include "metafont.h"
+#include <cstring>
+#include <cmath>
+
+OutlineInterpolator::OutlineInterpolator(OtLayout* layout) : layout{ layout } {
+  arena = std::make_shared<OutlineArena>();
+}
+
+OutlineInterpolator::~OutlineInterpolator() {
+  clear();
+}
+
+void OutlineInterpolator::clear() {
+  std::lock_guard<std::mutex> guard(mastersMutex);
+  mastersByGlyph.clear();
+  arena = std::make_shared<OutlineArena>();
+}
+
+bool OutlineInterpolator::isCompatible(GlyphVis* defaultMaster, GlyphVis* master) {
+
+  auto body = defaultMaster->copiedPath;
+  auto masterBody = master->copiedPath;
+
+  while (body != nullptr && masterBody != nullptr) {
+    if (body->type != masterBody->type) return false;
+
+    if (body->type == mp_fill_code) {
+      mp_gr_knot p = ((mp_fill_object*)body)->path_p;
+      mp_gr_knot q = ((mp_fill_object*)masterBody)->path_p;
+
+      if ((p == nullptr) != (q == nullptr)) return false;
+
+      if (p != nullptr) {
+        auto first = p;
+        auto firstq = q;
+        do {
+          if (p->data.types.left_type != q->data.types.left_type) return false;
+          p = p->next;
+          q = q->next;
+        } while (p != first && q != firstq);
+
+        if (p != first || q != firstq) return false;
+      }
+    }
+
+    body = body->next;
+    masterBody = masterBody->next;
+  }
+
+  return body == nullptr && masterBody == nullptr;
+}
+
+std::shared_ptr<const OutlineInterpolator::Masters> OutlineInterpolator::getMasters(GlyphVis* glyph, const ValueLimits& limits) {
+
+  {
+    std::lock_guard<std::mutex> guard(mastersMutex);
+
+    auto find = mastersByGlyph.find(glyph->charcode);
+
+    if (find != mastersByGlyph.end() && find->second->limits == limits) {
+      return find->second;
+    }
+  }
+
+  auto masters = std::make_shared<Masters>();
+
+  masters->built = true;
+  masters->limits = limits;
+  masters->compatible = true;
+
+  GlyphParameters parameters[MasterCount];
+  parameters[MinLeft].lefttatweel = limits.minLeft;
+  parameters[MaxLeft].lefttatweel = limits.maxLeft;
+  parameters[MinRight].righttatweel = limits.minRight;
+  parameters[MaxRight].righttatweel = limits.maxRight;
+
+  // Masters lie on the axis limits so they are generated by MetaPost, outside the lock of the alternates so that the
+  // other threads of the pool are not blocked while MetaPost runs
+  auto font = layout->font;
+  bool usePool = font->metaPostPoolSize() != 0;
+  MP instance = usePool ? font->acquireInstance() : font->mp;
+
+  std::unique_ptr<GlyphVis> generated[MasterCount];
+
+  try {
+    for (int i = 0; i < MasterCount; i++) {
+      if (parameters[i].lefttatweel == 0.0 && parameters[i].righttatweel == 0.0) continue;
+
+      bool stored;
+
+      mp_edge_object* edge = layout->generateAlternateEdge(instance, glyph, parameters[i], QString(), stored);
+
+      // The path is copied before the next master replaces the edge of the instance
+      generated[i] = std::make_unique<GlyphVis>(layout, edge, !stored);
+
+      if (!isCompatible(glyph, generated[i].get())) {
+        masters->compatible = false;
+        break;
+      }
+    }
+  }
+  catch (...) {
+    if (usePool) {
+      font->releaseInstance(instance);
+    }
+    throw;
+  }
+
+  if (usePool) {
+    font->releaseInstance(instance);
+  }
+
+  std::lock_guard<std::mutex> guard(mastersMutex);
+
+  for (int i = 0; i < MasterCount && masters->compatible; i++) {
+    if (generated[i] == nullptr) continue;
+
+    // A copy is kept since the generated outline belongs to the alternate store or to the generated glyph, it is moved
+    // to the arena of the interpolator
+    auto copy = std::make_unique<GlyphVis>(*generated[i]);
+    copy->releaseCopiedPath();
+    copy->copiedPath = font->copyEdgeBody(generated[i]->copiedPath, arena.get());
+    copy->isCopiedPath = true;
+    copy->outlineArena = arena;
+
+    masters->masters[i] = std::move(copy);
+  }
+
+  auto& current = mastersByGlyph[glyph->charcode];
+
+  // Another thread built the same masters in the meantime
+  if (current != nullptr && current->limits == limits) {
+    return current;
+  }
+
+  current = masters;
+
+  return masters;
+}
+
+bool OutlineInterpolator::getWeights(GlyphVis* glyph, const GlyphParameters& parameters, std::shared_ptr<const Masters>& pmasters, double weights[MasterCount]) {
+
+  if (parameters.third != 0.0 || parameters.fourth != 0.0 || parameters.fifth != 0.0 || parameters.scalex != 0.0) {
+    return false;
+  }
+
+  auto find = layout->expandableGlyphs.find(glyph->name);
+
+  if (find == layout->expandableGlyphs.end()) {
+    return false;
+  }
+
+  const auto& limits = find->second;
+
+  double left = parameters.lefttatweel;
+  double right = parameters.righttatweel;
+
+  if (left == 0.0 && right == 0.0) {
+    return false;
+  }
+
+  bool onLeftMaster = right == 0.0 && (left == limits.minLeft || left == limits.maxLeft);
+  bool onRightMaster = left == 0.0 && (right == limits.minRight || right == limits.maxRight);
+
+  if (onLeftMaster || onRightMaster) {
+    return false;
+  }
+
+  auto masters = getMasters(glyph, limits);
+
+  if (!masters->compatible) {
+    return false;
+  }
+
+  for (int i = 0; i < MasterCount; i++) {
+    weights[i] = 0.0;
+  }
+
+  if (left < 0 && limits.minLeft != 0.0) {
+    weights[MinLeft] = left / limits.minLeft;
+  }
+  else if (left > 0 && limits.maxLeft != 0.0) {
+    weights[MaxLeft] = left / limits.maxLeft;
+  }
+
+  if (right < 0 && limits.minRight != 0.0) {
+    weights[MinRight] = right / limits.minRight;
+  }
+  else if (right > 0 && limits.maxRight != 0.0) {
+    weights[MaxRight] = right / limits.maxRight;
+  }
+
+  bool weighted = false;
+
+  for (int i = 0; i < MasterCount; i++) {
+    if (weights[i] != 0.0 && masters->masters[i] == nullptr) {
+      return false;
+    }
+    weighted = weighted || weights[i] != 0.0;
+  }
+
+  pmasters = masters;
+
+  return weighted;
+}
+
+bool OutlineInterpolator::prepare(GlyphVis* glyph, GlyphParameters parameters) {
+
+  std::shared_ptr<const Masters> masters;
+  double weights[MasterCount];
+
+  return getWeights(glyph, parameters, masters, weights);
+}
+
+bool OutlineInterpolator::advance(GlyphVis* glyph, GlyphParameters parameters, double& width) {
+
+  std::shared_ptr<const Masters> masters;
+  double weights[MasterCount];
+
+  if (!getWeights(glyph, parameters, masters, weights)) {
+    return false;
+  }
+
+  width = glyph->width;
+
+  for (int i = 0; i < MasterCount; i++) {
+    if (weights[i] != 0.0) {
+      width += weights[i] * (masters->masters[i]->width - glyph->width);
+    }
+  }
+
+  return true;
+}
+
+GlyphVis* OutlineInterpolator::interpolate(GlyphVis* glyph, GlyphParameters parameters) {
+
+  std::shared_ptr<const Masters> pmasters;
+  double weights[MasterCount];
+
+  if (!getWeights(glyph, parameters, pmasters, weights)) {
+    return nullptr;
+  }
+
+  auto& masters = *pmasters;
+
+  GlyphVis* templateMaster = nullptr;
+
+  for (int i = 0; i < MasterCount; i++) {
+    if (weights[i] != 0.0 && templateMaster == nullptr) {
+      templateMaster = masters.masters[i].get();
+    }
+  }
+
+  auto blend = [&](double base, auto getValue) {
+    double value = base;
+    for (int i = 0; i < MasterCount; i++) {
+      if (weights[i] != 0.0) {
+        value += weights[i] * (getValue(masters.masters[i].get()) - base);
+      }
+    }
+    return value;
+    };
+
+  // The template gives the names and types MetaPost sets for alternates, the geometry is rebuilt from the default glyph
+  GlyphVis* result = new GlyphVis(*templateMaster);
+
+  result->releaseCopiedPath();
+  result->copiedPath = layout->font->copyEdgeBody(glyph->copiedPath, layout->outlineArena.get());
+  result->isCopiedPath = true;
+  result->outlineArena = layout->outlineArena;
+
+  result->width = blend(glyph->width, [](GlyphVis* m) { return m->width; });
+  result->height = blend(glyph->height, [](GlyphVis* m) { return m->height; });
+  result->depth = blend(glyph->depth, [](GlyphVis* m) { return m->depth; });
+  result->charlt = blend(glyph->charlt, [](GlyphVis* m) { return m->charlt; });
+  result->charrt = blend(glyph->charrt, [](GlyphVis* m) { return m->charrt; });
+  result->bbox.llx = blend(glyph->bbox.llx, [](GlyphVis* m) { return m->bbox.llx; });
+  result->bbox.lly = blend(glyph->bbox.lly, [](GlyphVis* m) { return m->bbox.lly; });
+  result->bbox.urx = blend(glyph->bbox.urx, [](GlyphVis* m) { return m->bbox.urx; });
+  result->bbox.ury = blend(glyph->bbox.ury, [](GlyphVis* m) { return m->bbox.ury; });
+  result->matrix.xpart = blend(glyph->matrix.xpart, [](GlyphVis* m) { return m->matrix.xpart; });
+  result->matrix.ypart = blend(glyph->matrix.ypart, [](GlyphVis* m) { return m->matrix.ypart; });
+
+  auto blendPoint = [&](QPoint base, auto getPoint) {
+    double x = blend(base.x(), [&](GlyphVis* m) { return (double)getPoint(m).x(); });
+    double y = blend(base.y(), [&](GlyphVis* m) { return (double)getPoint(m).y(); });
+    return QPoint(round(x), round(y));
+    };
+
+  auto hasAnchor = [&](auto hasPoint) {
+    for (int i = 0; i < MasterCount; i++) {
+      if (weights[i] != 0.0 && !hasPoint(masters.masters[i].get())) return false;
+    }
+    return true;
+    };
+
+  if (glyph->leftAnchor && hasAnchor([](GlyphVis* m) { return m->leftAnchor.has_value(); })) {
+    result->leftAnchor = blendPoint(*glyph->leftAnchor, [](GlyphVis* m) { return *m->leftAnchor; });
+  }
+  if (glyph->rightAnchor && hasAnchor([](GlyphVis* m) { return m->rightAnchor.has_value(); })) {
+    result->rightAnchor = blendPoint(*glyph->rightAnchor, [](GlyphVis* m) { return *m->rightAnchor; });
+  }
+
+  for (auto it = glyph->anchors.constBegin(); it != glyph->anchors.constEnd(); ++it) {
+    auto& key = it.key();
+    if (!result->anchors.contains(key)) continue;
+    if (!hasAnchor([&key](GlyphVis* m) { return m->anchors.contains(key); })) continue;
+    result->anchors[key].anchor = blendPoint(it.value().anchor, [&key](GlyphVis* m) { return m->anchors.value(key).anchor; });
+  }
+
+  // Knots
+  mp_graphic_object* objects[MasterCount];
+  for (int i = 0; i < MasterCount; i++) {
+    objects[i] = masters.masters[i] ? masters.masters[i]->copiedPath : nullptr;
+  }
+
+  for (auto body = result->copiedPath, base = glyph->copiedPath; body != nullptr && base != nullptr; body = body->next, base = base->next) {
+    if (body->type == mp_fill_code) {
+      mp_gr_knot knots[MasterCount];
+      for (int i = 0; i < MasterCount; i++) {
+        knots[i] = objects[i] ? ((mp_fill_object*)objects[i])->path_p : nullptr;
+      }
+
+      mp_gr_knot p = ((mp_fill_object*)body)->path_p;
+      mp_gr_knot q = ((mp_fill_object*)base)->path_p;
+
+      if (p != nullptr) {
+        auto first = p;
+        do {
+          double x_coord = q->x_coord, y_coord = q->y_coord;
+          double left_x = q->left_x, left_y = q->left_y;
+          double right_x = q->right_x, right_y = q->right_y;
+
+          for (int i = 0; i < MasterCount; i++) {
+            if (weights[i] == 0.0) continue;
+            auto k = knots[i];
+            x_coord += weights[i] * (k->x_coord - q->x_coord);
+            y_coord += weights[i] * (k->y_coord - q->y_coord);
+            left_x += weights[i] * (k->left_x - q->left_x);
+            left_y += weights[i] * (k->left_y - q->left_y);
+            right_x += weights[i] * (k->right_x - q->right_x);
+            right_y += weights[i] * (k->right_y - q->right_y);
+          }
+
+          p->x_coord = x_coord;
+          p->y_coord = y_coord;
+          p->left_x = left_x;
+          p->left_y = left_y;
+          p->right_x = right_x;
+          p->right_y = right_y;
+
+          p = p->next;
+          q = q->next;
+          for (int i = 0; i < MasterCount; i++) {
+            if (knots[i]) knots[i] = knots[i]->next;
+          }
+        } while (p != first);
+      }
+    }
+
+    for (int i = 0; i < MasterCount; i++) {
+      if (objects[i]) objects[i] = objects[i]->next;
+    }
+  }
+
+  result->flatOutline = std::make_shared<const FlatOutline>(FlatOutline::fromBody(result->copiedPath));
+
+#ifndef DIGITALKHATT_WEBLIB
+  mp_edge_object edge;
+  memset(&edge, 0, sizeof(edge));
+  edge.body = result->copiedPath;
+  result->path = Glyph::getPath(&edge);
+  if (result->isColored()) {
+    result->picture = Glyph::getPicture(&edge);
+  }
+#endif
+
+  return result;
+}
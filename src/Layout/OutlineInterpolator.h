@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#pragma once
+
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include "commontypes.h"
+
+class OtLayout;
+class GlyphVis;
+class OutlineArena;
+
+/*
+  Builds tatweel alternates by linear delta interpolation between masters, the same model used by the variable font
+  (see ToOpenType::charStrings) : the default glyph plus one master at each limit of the lefttatweel/righttatweel axes
+  given by OtLayout::expandableGlyphs.
+  Masters are generated once by MetaPost, on an instance of the pool when there is one. interpolate returns nullptr when
+  the masters do not have the same knot topology so the caller falls back to MetaPost.
+  The masters are synchronized by the interpolator. interpolate copies the outline to the arena of the layout so it is
+  called with alternateMutex held by the concurrent callers, which call prepare before taking the lock so that the
+  masters are not generated while the other threads wait for it.
+*/
+class OutlineInterpolator {
+public:
+  OutlineInterpolator(OtLayout* layout);
+  ~OutlineInterpolator();
+
+  // Generates the masters of the glyph if needed, returns whether the alternate can be interpolated
+  bool prepare(GlyphVis* glyph, GlyphParameters parameters);
+  GlyphVis* interpolate(GlyphVis* glyph, GlyphParameters parameters);
+  // Width interpolate would give to the alternate, without building its outline
+  bool advance(GlyphVis* glyph, GlyphParameters parameters, double& width);
+
+  void clear();
+
+private:
+
+  enum MasterIndex {
+    MinLeft = 0,
+    MaxLeft,
+    MinRight,
+    MaxRight,
+    MasterCount
+  };
+
+  struct Masters {
+    bool built = false;
+    bool compatible = false;
+    ValueLimits limits;
+    std::unique_ptr<GlyphVis> masters[MasterCount];
+  };
+
+  std::shared_ptr<const Masters> getMasters(GlyphVis* glyph, const ValueLimits& limits);
+  bool getWeights(GlyphVis* glyph, const GlyphParameters& parameters, std::shared_ptr<const Masters>& masters, double weights[MasterCount]);
+  bool isCompatible(GlyphVis* defaultMaster, GlyphVis* master);
+
+  OtLayout* layout;
+  // Built masters are not modified, they are replaced when the limits of the glyph change
+  std::unordered_map<int, std::shared_ptr<const Masters>> mastersByGlyph;
+  std::shared_ptr<OutlineArena> arena;
+  std::mutex mastersMutex;
+};
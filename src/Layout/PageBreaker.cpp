@@ -0,0 +1,509 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#include "PageBreaker.h"
+#include "OtLayout.h"
+#include "automedina/automedina.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <QThread>
+
+PageBreaker::PageBreaker(const OtLayout& layout, hb_buffer_t* buffer, const QSet<int>& forcedBreaks) {
+
+  unsigned int glyph_count;
+
+  hb_glyph_info_t* glyph_info = hb_buffer_get_glyph_infos(buffer, &glyph_count);
+  hb_glyph_position_t* glyph_pos = hb_buffer_get_glyph_positions(buffer, &glyph_count);
+
+  int count = glyph_count;
+
+  // The text begins at the end of the buffer
+  breakpoints.push_back({ count, 0, 0, 0, 0, false, false });
+
+  qint64 width = 0;
+  int spaces = 0;
+
+  for (int i = count - 1; i >= 0; i--) {
+
+    if (glyph_info[i].codepoint != 10 && glyph_info[i].codepoint != 0x20) {
+      width += glyph_pos[i].x_advance;
+      continue;
+    }
+
+    spaces++;
+
+    double penalty = 0;
+
+    // avoid a break before an aya number, prefer a break after it
+    if (i != 0 && layout.glyphNameIs(glyph_info[i - 1].codepoint, OtLayout::GlyphInfo::Aya)) {
+      penalty = 500;
+    }
+    else if (i != count - 1 && layout.glyphNameIs(glyph_info[i + 1].codepoint, OtLayout::GlyphInfo::Aya)) {
+      penalty = -1;
+    }
+
+    bool ayaEnd = i != count - 1 && glyph_info[i + 1].codepoint >= Automedina::AyaNumberCode && glyph_info[i + 1].codepoint <= Automedina::AyaNumberCode + 286;
+
+    breakpoints.push_back({ i, width, spaces, 0, penalty, ayaEnd, forcedBreaks.contains(glyph_info[i].cluster) });
+  }
+}
+
+static void forEachParallel(int count, const std::function<void(int)>& function) {
+
+  std::atomic<int> next{ 0 };
+  int nbThreads = std::max(1, std::min(QThread::idealThreadCount(), count));
+  std::vector<QThread*> threads;
+
+  for (int t = 0; t < nbThreads; t++) {
+    QThread* thread = QThread::create([&] {
+      for (int index = next++; index < count; index = next++) {
+        function(index);
+      }
+      });
+    threads.push_back(thread);
+    thread->start();
+  }
+
+  for (auto t : threads) {
+    t->wait();
+    delete t;
+  }
+}
+
+QVector<PageBreaker::Line> PageBreaker::breakPages(const Parameters& parameters) {
+
+  auto lines = run(parameters);
+
+  if (lines.isEmpty() && (parameters.minAdjRatio != -std::numeric_limits<double>::infinity()
+    || parameters.maxAdjRatio != std::numeric_limits<double>::infinity() || parameters.lineBand != std::numeric_limits<int>::max())) {
+
+    auto unbounded = parameters;
+    unbounded.minAdjRatio = -std::numeric_limits<double>::infinity();
+    unbounded.maxAdjRatio = std::numeric_limits<double>::infinity();
+    unbounded.lineBand = std::numeric_limits<int>::max();
+
+    lines = run(unbounded);
+  }
+
+  return lines;
+}
+
+void PageBreaker::estimateLines(const Parameters& parameters) {
+
+  auto naturalWidth = [&parameters](const Breakpoint& breakpoint) {
+    return breakpoint.width + (double)breakpoint.spaces * parameters.spaceWidth;
+    };
+
+  double paragraphLines = 0;
+  int paragraphStart = 0;
+
+  for (size_t b = 1; b < breakpoints.size(); b++) {
+    auto& breakpoint = breakpoints[b];
+    double lines = (naturalWidth(breakpoint) - naturalWidth(breakpoints[paragraphStart])) / parameters.lineWidth;
+    if (breakpoint.forced) {
+      paragraphLines += std::ceil(lines);
+      paragraphStart = b;
+      breakpoint.lines = paragraphLines;
+    }
+    else {
+      breakpoint.lines = paragraphLines + lines;
+    }
+  }
+
+  int totalLines = parameters.nbPages * parameters.linesPerPage;
+
+  estimateScale = totalLines > 0 && breakpoints.back().lines > 0 ? totalLines / breakpoints.back().lines : 0;
+}
+
+QVector<PageBreaker::Line> PageBreaker::run(const Parameters& parameters) {
+
+  int nbBreakpoints = breakpoints.size();
+
+  // The text must end with a space
+  if (nbBreakpoints < 2 || breakpoints.back().index != 0) {
+    return {};
+  }
+
+  estimateLines(parameters);
+
+  const int linesPerPage = parameters.linesPerPage;
+  const int totalLines = parameters.nbPages > 0 ? parameters.nbPages * linesPerPage : 0;
+  const bool banded = totalLines > 0 && parameters.lineBand < totalLines;
+
+  struct Segment {
+    int first;
+    int last;
+  };
+
+  std::vector<Segment> segments;
+
+  int first = 0;
+  for (int b = 1; b < nbBreakpoints; b++) {
+    if (breakpoints[b].forced || b == nbBreakpoints - 1) {
+      segments.push_back({ first, b });
+      first = b;
+    }
+  }
+
+  int nbSegments = segments.size();
+
+  // A single pass over the whole text costs less than the segments broken from every line of a page on one core
+  if (nbSegments == 1 || QThread::idealThreadCount() < 2) {
+
+    std::vector<Node> nodes;
+    auto states = breakSegment(parameters, 0, nbBreakpoints - 1, 0, nodes);
+
+    int best = -1;
+    double bestDemerits = DEMERITS_INFTY;
+
+    for (auto& state : states) {
+      if ((state.line - 1) % linesPerPage + 1 == linesPerPage && (totalLines == 0 || state.line == totalLines) && state.totalDemerits < bestDemerits) {
+        bestDemerits = state.totalDemerits;
+        best = state.node;
+      }
+    }
+
+    if (best == -1) {
+      return {};
+    }
+
+    QVector<Line> lines;
+    appendLines(nodes, best, 0, linesPerPage, lines);
+
+    return lines;
+  }
+
+  // The breaks of a segment only depend on the line it begins at when a page must end with an aya
+  const int nbOffsets = parameters.pageFinishbyaVerse ? linesPerPage : 1;
+
+  std::vector<std::vector<State>> segmentStates(nbSegments * nbOffsets);
+
+  // The text begins at the first line of a page
+  forEachParallel(nbSegments * nbOffsets, [&](int task) {
+    int segment = task / nbOffsets;
+    int offset = task % nbOffsets;
+    if (segment == 0 && offset != 0) return;
+    std::vector<Node> nodes;
+    segmentStates[task] = breakSegment(parameters, segments[segment].first, segments[segment].last, offset, nodes);
+    });
+
+  // Best demerits per line number at the end of each segment, key being the line number in the page when the number of
+  // pages is not given
+  struct MergeState {
+    int key;
+    double totalDemerits;
+    int prev;
+    int offset;
+    int line;
+  };
+
+  std::vector<std::vector<MergeState>> merged(nbSegments + 1);
+  merged[0].push_back({ 0, 0.0, -1, 0, 0 });
+
+  std::vector<int> slotOf(totalLines > 0 ? totalLines + 1 : linesPerPage, -1);
+
+  for (int segment = 0; segment < nbSegments; segment++) {
+
+    auto& next = merged[segment + 1];
+    int estimate = std::lround(breakpoints[segments[segment].last].lines * estimateScale);
+
+    for (int prev = 0; prev < (int)merged[segment].size(); prev++) {
+
+      auto& from = merged[segment][prev];
+      int offset = nbOffsets == 1 ? 0 : from.key % linesPerPage;
+
+      for (auto& state : segmentStates[segment * nbOffsets + offset]) {
+
+        int key = from.key + state.line - offset;
+
+        if (totalLines > 0) {
+          if (key > totalLines || (banded && std::abs(key - estimate) > parameters.lineBand)) continue;
+        }
+        else {
+          key %= linesPerPage;
+        }
+
+        double totalDemerits = from.totalDemerits + state.totalDemerits;
+
+        int& slot = slotOf[key];
+        if (slot == -1) {
+          slot = next.size();
+          next.push_back({ key, totalDemerits, prev, offset, state.line });
+        }
+        else if (totalDemerits < next[slot].totalDemerits) {
+          next[slot] = { key, totalDemerits, prev, offset, state.line };
+        }
+      }
+    }
+
+    for (auto& state : next) {
+      slotOf[state.key] = -1;
+    }
+
+    if (next.empty()) {
+      return {};
+    }
+  }
+
+  int best = -1;
+  for (int i = 0; i < (int)merged.back().size(); i++) {
+    if (merged.back()[i].key == (totalLines > 0 ? totalLines : 0)) {
+      best = i;
+    }
+  }
+
+  if (best == -1) {
+    return {};
+  }
+
+  // The line the segment begins at and the line it ends at in the segment states
+  struct Choice {
+    int offset;
+    int line;
+    int base;
+  };
+
+  std::vector<Choice> choices(nbSegments);
+
+  for (int segment = nbSegments - 1, index = best; segment >= 0; index = merged[segment + 1][index].prev, segment--) {
+    auto& state = merged[segment + 1][index];
+    choices[segment] = { state.offset, state.line, 0 };
+  }
+
+  for (int segment = 1; segment < nbSegments; segment++) {
+    auto& prev = choices[segment - 1];
+    choices[segment].base = prev.base + prev.line - prev.offset;
+  }
+
+  std::vector<QVector<Line>> segmentLines(nbSegments);
+
+  forEachParallel(nbSegments, [&](int segment) {
+
+    auto& choice = choices[segment];
+
+    std::vector<Node> nodes;
+    auto states = breakSegment(parameters, segments[segment].first, segments[segment].last, choice.offset, nodes);
+
+    auto find = std::find_if(states.begin(), states.end(), [&choice](const State& state) { return state.line == choice.line; });
+    if (find == states.end()) return;
+
+    appendLines(nodes, find->node, choice.base - choice.offset, linesPerPage, segmentLines[segment]);
+    });
+
+  QVector<Line> lines;
+
+  for (auto& segment : segmentLines) {
+    if (segment.isEmpty()) return {};
+    for (auto& line : segment) {
+      lines.append(line);
+    }
+  }
+
+  return lines;
+}
+
+std::vector<PageBreaker::State> PageBreaker::breakSegment(const Parameters& parameters, int first, int last, int startLine, std::vector<Node>& nodes) const {
+
+  const int linesPerPage = parameters.linesPerPage;
+  const int totalLines = parameters.nbPages > 0 ? parameters.nbPages * linesPerPage : 0;
+  const bool banded = totalLines > 0 && parameters.lineBand < totalLines;
+
+  nodes.clear();
+  nodes.push_back({ first, startLine, -1 });
+
+  std::vector<Active> actives;
+  actives.push_back({ first, { { startLine, 0, 0.0 } } });
+
+  size_t nextCompaction = 1 << 20;
+
+  int keyCount = totalLines == 0 ? linesPerPage : banded ? 2 * parameters.lineBand + 1 : totalLines;
+
+  // Best state per line number at the current breakpoint, node being the previous node until the state is kept
+  std::vector<State> slots(keyCount, { 0, -1, DEMERITS_INFTY });
+  std::vector<int> touched;
+
+  for (int b = first + 1; b <= last; b++) {
+
+    auto& breakpoint = breakpoints[b];
+
+    bool forced = breakpoint.forced || b == last;
+
+    int keyLow = 1;
+    int keyHigh = totalLines == 0 ? linesPerPage : totalLines;
+
+    if (banded) {
+      int estimate = startLine + std::lround((breakpoint.lines - breakpoints[first].lines) * estimateScale);
+      keyLow = std::max(1, estimate - parameters.lineBand);
+      keyHigh = std::min(totalLines, estimate + parameters.lineBand);
+    }
+
+    size_t kept = 0;
+
+    for (size_t a = 0; a < actives.size(); a++) {
+
+      auto& from = breakpoints[actives[a].breakpoint];
+
+      qint64 wordsWidth = breakpoint.width - from.width;
+      int spaces = breakpoint.spaces - from.spaces - 1;
+      double width = wordsWidth + (double)spaces * parameters.spaceWidth;
+
+      // calculate adjustment ratio
+      double adjRatio = 0.0;
+      if (width < parameters.lineWidth) {
+        double stretch = parameters.stretchPerWidth * wordsWidth + parameters.stretchPerSpace * spaces + parameters.stretchPerLine;
+        adjRatio = (parameters.lineWidth - width) / std::max(stretch, 1.0);
+      }
+      else if (width > parameters.lineWidth) {
+        double shrink = parameters.shrinkPerWidth * wordsWidth + parameters.shrinkPerSpace * spaces + parameters.shrinkPerLine;
+        adjRatio = (parameters.lineWidth - width) / std::max(shrink, 1.0);
+      }
+
+      // The following lines from this breakpoint are longer
+      if (adjRatio < parameters.minAdjRatio) {
+        continue;
+      }
+
+      if (kept != a) {
+        actives[kept] = std::move(actives[a]);
+      }
+
+      auto& active = actives[kept++];
+
+      if (adjRatio > parameters.maxAdjRatio && !forced) {
+        continue;
+      }
+
+      double absRatio = std::abs(adjRatio);
+      double badness = 100 * absRatio * absRatio * absRatio;
+      double demerits;
+      if (breakpoint.penalty >= 0) {
+        demerits = 1 + (badness + breakpoint.penalty) * (badness + breakpoint.penalty);
+      }
+      else {
+        demerits = 1 + badness * badness - breakpoint.penalty * breakpoint.penalty;
+      }
+
+      for (auto& state : active.states) {
+
+        int lineNumber = state.line == 0 ? 0 : (state.line - 1) % linesPerPage + 1;
+
+        // must terminate a page with end of aya
+        if (parameters.pageFinishbyaVerse && lineNumber == linesPerPage - 1 && !breakpoint.ayaEnd) {
+          continue;
+        }
+
+        int line = state.line + 1;
+        int key = totalLines == 0 ? lineNumber % linesPerPage + 1 : line;
+
+        if (key < keyLow || key > keyHigh) {
+          continue;
+        }
+
+        auto& slot = slots[key - keyLow];
+        double totalDemerits = state.totalDemerits + demerits;
+
+        if (slot.totalDemerits == DEMERITS_INFTY) {
+          touched.push_back(key - keyLow);
+        }
+
+        if (totalDemerits < slot.totalDemerits) {
+          slot = { line, state.node, totalDemerits };
+        }
+      }
+    }
+
+    actives.resize(kept);
+
+    if (forced) {
+      actives.clear();
+    }
+
+    if (!touched.empty()) {
+      Active active{ b, {} };
+      active.states.reserve(touched.size());
+      for (int index : touched) {
+        auto& slot = slots[index];
+        active.states.push_back({ slot.line, (int)nodes.size(), slot.totalDemerits });
+        nodes.push_back({ b, slot.line, slot.node });
+        slot = { 0, -1, DEMERITS_INFTY };
+      }
+      touched.clear();
+      actives.push_back(std::move(active));
+    }
+
+    if (actives.empty()) {
+      return {};
+    }
+
+    if (nodes.size() >= nextCompaction) {
+      compact(nodes, actives);
+      nextCompaction = std::max<size_t>(1 << 20, 2 * nodes.size());
+    }
+  }
+
+  return actives.back().states;
+}
+
+void PageBreaker::appendLines(const std::vector<Node>& nodes, int node, int firstLine, int linesPerPage, QVector<Line>& lines) const {
+
+  int size = lines.size();
+
+  for (; nodes[node].prev != -1; node = nodes[node].prev) {
+    auto& to = nodes[node];
+    auto& end = breakpoints[to.breakpoint];
+    auto& begin = breakpoints[nodes[to.prev].breakpoint];
+    int line = firstLine + to.line;
+    lines.append({ begin.index, end.index, (line - 1) / linesPerPage + 1, (line - 1) % linesPerPage + 1, end.width - begin.width, end.spaces - begin.spaces - 1 });
+  }
+
+  std::reverse(lines.begin() + size, lines.end());
+}
+
+void PageBreaker::compact(std::vector<Node>& nodes, std::vector<Active>& actives) {
+
+  std::vector<int> newIndex(nodes.size(), -1);
+
+  for (auto& active : actives) {
+    for (auto& state : active.states) {
+      for (int node = state.node; node != -1 && newIndex[node] == -1; node = nodes[node].prev) {
+        newIndex[node] = 0;
+      }
+    }
+  }
+
+  // A node is always added after its previous node
+  int count = 0;
+  for (size_t i = 0; i < nodes.size(); i++) {
+    if (newIndex[i] == -1) continue;
+    newIndex[i] = count;
+    auto node = nodes[i];
+    node.prev = node.prev == -1 ? -1 : newIndex[node.prev];
+    nodes[count++] = node;
+  }
+
+  nodes.resize(count);
+
+  for (auto& active : actives) {
+    for (auto& state : active.states) {
+      state.node = newIndex[state.node];
+    }
+  }
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#pragma once
+
+#include <vector>
+#include <limits>
+
+#include <QSet>
+#include <QVector>
+
+#include "hb.h"
+
+class OtLayout;
+
+/*
+  Breaks a shaped text into lines of pages of 15 lines, minimizing the sum of the demerits of the lines.
+
+  The breakpoints (the spaces of the buffer) are extracted once with the prefix sums of the width of the words and of
+  the number of spaces, their aya penalty, whether they follow an aya number and whether the break is forced. The
+  breaker keeps for each active breakpoint its best demerits per line number. An active breakpoint is dropped once the
+  line from it is shrunk beyond minAdjRatio and a line stretched beyond maxAdjRatio is not considered, except before a
+  forced break. When the number of pages is given, the line numbers of a breakpoint are kept in a band around the number
+  of lines estimated at the natural width of the text. The back pointers of the dropped states are compacted as the
+  text advances so that the memory used does not grow with the length of the text.
+  When no solution is found within these bounds the text is broken again without them.
+
+  No line crosses a forced break (the sura and bism lines), the segments between them are broken in parallel when
+  more than one core is available : the breaks of a segment only depend on the line of the page it begins at, which is
+  tried for every line of the page when pages must end with an aya. The best demerits of each segment per number of
+  lines are then merged in order of the text, so that the whole text still fills exactly nbPages pages, and the chosen
+  segments are broken again to get their lines.
+*/
+class PageBreaker {
+public:
+
+  struct Parameters {
+    int lineWidth = 0;
+    int spaceWidth = 0;
+    // The maximum stretch and shrink of a line : a ratio of the width of its words, a width per space and per line
+    double stretchPerWidth = 0;
+    double stretchPerSpace = 0;
+    double stretchPerLine = 0;
+    double shrinkPerWidth = 0;
+    double shrinkPerSpace = 0;
+    double shrinkPerLine = 0;
+    int linesPerPage = 15;
+    // The text fills exactly nbPages pages, otherwise it ends at the last line of any page
+    int nbPages = 0;
+    bool pageFinishbyaVerse = false;
+    double minAdjRatio = -1;
+    double maxAdjRatio = 5;
+    // Line numbers kept around the estimated one when nbPages is given
+    int lineBand = 45;
+  };
+
+  // A line between the spaces at the glyph indexes begin and end, begin being the glyph count for the first line
+  struct Line {
+    int begin;
+    int end;
+    int pageNumber;
+    int lineNumber;
+    qint64 wordsWidth;
+    int spaces;
+  };
+
+  PageBreaker(const OtLayout& layout, hb_buffer_t* buffer, const QSet<int>& forcedBreaks);
+
+  // The lines of the pages in the order of the text, empty when there is no feasible solution
+  QVector<Line> breakPages(const Parameters& parameters);
+
+private:
+
+  struct Breakpoint {
+    int index;
+    // Words width and spaces before the breakpoint, its own space included
+    qint64 width;
+    int spaces;
+    // Lines before the breakpoint when the text is not justified, the paragraphs ending at a forced break being rounded up
+    double lines;
+    double penalty;
+    bool ayaEnd;
+    bool forced;
+  };
+
+  struct Node {
+    int breakpoint;
+    int line;
+    int prev;
+  };
+
+  struct State {
+    int line;
+    int node;
+    double totalDemerits;
+  };
+
+  struct Active {
+    int breakpoint;
+    std::vector<State> states;
+  };
+
+  static constexpr double DEMERITS_INFTY = std::numeric_limits<double>::max();
+
+  QVector<Line> run(const Parameters& parameters);
+  void estimateLines(const Parameters& parameters);
+  // The states at the breakpoint last of the text broken from the breakpoint first, which ends the line startLine
+  std::vector<State> breakSegment(const Parameters& parameters, int first, int last, int startLine, std::vector<Node>& nodes) const;
+  // Appends the lines ending at node, firstLine being added to the line numbers of the nodes
+  void appendLines(const std::vector<Node>& nodes, int node, int firstLine, int linesPerPage, QVector<Line>& lines) const;
+  static void compact(std::vector<Node>& nodes, std::vector<Active>& actives);
+
+  std::vector<Breakpoint> breakpoints;
+  double estimateScale = 0;
+};
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#include "ShapingSession.h"
+#include "hb.h"
+#include <cstring>
+
+static thread_local ShapingSession* currentSession = nullptr;
+
+ShapingSession::ShapingSession(OtLayout* layout, double emScale, bool newFace) : m_layout{ layout }, m_previous{ currentSession } {
+  m_buffer = hb_buffer_create();
+  m_font = layout->createFont(emScale, newFace);
+  fonts.insert({ { emScale, 0.0f }, m_font });
+  currentSession = this;
+}
+
+ShapingSession::~ShapingSession() {
+  currentSession = m_previous;
+  for (auto& font : fonts) {
+    hb_font_destroy(font.second);
+  }
+  for (auto buffer : freeBuffers) {
+    hb_buffer_destroy(buffer);
+  }
+  hb_buffer_destroy(m_buffer);
+}
+
+ShapingSession* ShapingSession::current() {
+  return currentSession;
+}
+
+GlyphVis* ShapingSession::getAlternate(int glyphCode, const GlyphParameters& parameters) {
+
+  Key key{ glyphCode, parameters };
+
+  auto find = alternates.find(key);
+
+  if (find != alternates.end()) {
+    return find->second;
+  }
+
+  GlyphVis* glyph = m_layout->getAlternateConcurrent(glyphCode, parameters);
+
+  alternates.insert({ key, glyph });
+
+  return glyph;
+}
+
+hb_font_t* ShapingSession::font(double emScale, float sclx) {
+
+  auto find = fonts.find({ emScale, sclx });
+
+  if (find != fonts.end()) {
+    return find->second;
+  }
+
+  hb_font_t* font = m_layout->createFont(emScale, false);
+
+  if (sclx != 0) {
+    hb_font_set_variation(font, HB_TAG('S', 'C', 'L', 'X'), sclx);
+  }
+
+  fonts.insert({ { emScale, sclx }, font });
+
+  return font;
+}
+
+hb_buffer_t* ShapingSession::acquireBuffer() {
+
+  hb_buffer_t* buffer;
+
+  if (currentSession != nullptr && !currentSession->freeBuffers.empty()) {
+    buffer = currentSession->freeBuffers.back();
+    currentSession->freeBuffers.pop_back();
+  }
+  else {
+    buffer = hb_buffer_create();
+  }
+
+  hb_buffer_set_direction(buffer, HB_DIRECTION_RTL);
+  hb_buffer_set_script(buffer, HB_SCRIPT_ARABIC);
+  hb_buffer_set_language(buffer, hb_language_from_string("ar", strlen("ar")));
+
+  return buffer;
+}
+
+void ShapingSession::releaseBuffer(hb_buffer_t* buffer) {
+
+  if (currentSession == nullptr) {
+    hb_buffer_destroy(buffer);
+    return;
+  }
+
+  hb_buffer_clear_contents(buffer);
+  currentSession->freeBuffers.push_back(buffer);
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#pragma once
+
+#include <unordered_map>
+#include <map>
+#include <vector>
+
+#include "commontypes.h"
+#include "JustificationContext.h"
+#include "OtLayout.h"
+
+class GlyphVis;
+struct hb_font_t;
+struct hb_buffer_t;
+
+/*
+  State of one shaping call of OtLayout (justifyPage), so that several pages can be justified at the same time by
+  different threads on the same layout.
+
+  The session owns the justification context filled by the substitution callback, the harfbuzz buffer and font and a
+  front of the alternate cache : alternates and advances already requested by the session are found without taking
+  OtLayout::alternateMutex, the others are requested with getAlternateConcurrent. The font data of the layout (glyphs,
+  lookups, tables and face) is only read.
+
+  Buffers and fonts are pooled for the duration of the session : acquireBuffer reuses the buffers released by the
+  session and font returns the font created by the session for a scale, so that the loops over lines and words do not
+  create them again.
+
+  The harfbuzz callbacks find the session of the calling thread with current(), a session is therefore created and
+  destroyed on the same thread. Outside a session the callbacks use the state of the layout as before.
+  The face is only replaced (newFace) when no other session is alive, and trimAlternates or clearAlternates must not be
+  called while a session holds alternates.
+*/
+class ShapingSession {
+public:
+
+  ShapingSession(OtLayout* layout, double emScale, bool newFace = false);
+  ~ShapingSession();
+
+  ShapingSession(const ShapingSession&) = delete;
+  ShapingSession& operator=(const ShapingSession&) = delete;
+
+  // Session of the calling thread, null when it is not shaping in a session
+  static ShapingSession* current();
+
+  OtLayout* layout() const { return m_layout; }
+  hb_buffer_t* buffer() const { return m_buffer; }
+  hb_font_t* font() const { return m_font; }
+  // Font of the layout at the scale with the SCLX axis set when sclx is not 0, owned by the session
+  hb_font_t* font(double emScale, float sclx = 0);
+
+  // RTL Arabic buffer, reused from the buffers released in the session of the calling thread.
+  // Outside a session the buffer is created and releaseBuffer destroys it.
+  static hb_buffer_t* acquireBuffer();
+  static void releaseBuffer(hb_buffer_t* buffer);
+
+  JustificationContext justificationContext;
+
+  GlyphVis* getAlternate(int glyphCode, const GlyphParameters& parameters);
+
+private:
+
+  friend class OtLayout;
+
+  struct Key {
+    int glyphCode;
+    GlyphParameters parameters;
+
+    bool operator==(const Key& r) const {
+      return glyphCode == r.glyphCode && parameters == r.parameters;
+    }
+  };
+
+  struct KeyHash {
+    size_t operator()(const Key& key) const {
+      return std::hash<GlyphParameters>::mix(std::hash<GlyphParameters>{}(key.parameters) ^ (uint64_t)(uint32_t)key.glyphCode);
+    }
+  };
+
+  OtLayout* m_layout;
+  hb_buffer_t* m_buffer;
+  hb_font_t* m_font;
+  ShapingSession* m_previous;
+
+  std::map<std::pair<double, float>, hb_font_t*> fonts;
+  std::vector<hb_buffer_t*> freeBuffers;
+
+  std::unordered_map<Key, GlyphVis*, KeyHash> alternates;
+  std::unordered_map<OtLayout::AdvanceKey, double, OtLayout::AdvanceKeyHash> advances;
+};
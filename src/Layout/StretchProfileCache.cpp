@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#include "StretchProfileCache.h"
+#include "commontypes.h"
+
+#include <mutex>
+
+#include <QHash>
+
+StretchProfileCache::Key StretchProfileCache::key(const QString& text, hb_font_t* font, int nbLevels) {
+
+  Key key{ text, 0, {} };
+
+  int yscale;
+  hb_font_get_scale(font, &key.scale, &yscale);
+
+  unsigned int length;
+  const int* coords = hb_font_get_var_coords_normalized(font, &length);
+
+  key.values.reserve(length + 1);
+  key.values.insert(key.values.end(), coords, coords + length);
+  key.values.push_back(nbLevels);
+
+  return key;
+}
+
+size_t StretchProfileCache::KeyHash::operator()(const Key& key) const {
+  uint64_t h = std::hash<GlyphParameters>::mix(qHash(key.text) ^ ((uint64_t)(uint32_t)key.scale << 32));
+  for (auto value : key.values) {
+    h = std::hash<GlyphParameters>::mix(h ^ (uint64_t)value);
+  }
+  return (size_t)h;
+}
+
+bool StretchProfileCache::find(const QString& text, hb_font_t* font, int nbLevels, Profile& profile) const {
+
+  auto k = key(text, font, nbLevels);
+
+  std::shared_lock<std::shared_mutex> lock(mutex);
+
+  auto find = profiles.find(k);
+
+  if (find == profiles.end()) {
+    return false;
+  }
+
+  profile = find->second;
+
+  return true;
+}
+
+void StretchProfileCache::insert(const QString& text, hb_font_t* font, int nbLevels, const Profile& profile) {
+
+  auto k = key(text, font, nbLevels);
+
+  std::unique_lock<std::shared_mutex> lock(mutex);
+
+  profiles.insert({ std::move(k), profile });
+}
+
+void StretchProfileCache::clear() {
+  std::unique_lock<std::shared_mutex> lock(mutex);
+  profiles.clear();
+}
+
+size_t StretchProfileCache::size() const {
+  std::shared_lock<std::shared_mutex> lock(mutex);
+  return profiles.size();
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+#include <shared_mutex>
+#include <cstdint>
+
+#include <QString>
+
+#include "hb.h"
+
+/*
+  Stretch profiles of the words justified by the simple feature justification (just_features.cpp) : the widths of a
+  word after each of its successive stretching steps and the features applied at each step. The steps of a word only
+  depend on the word, so a line is justified from the profiles of its words without shaping them again, and the
+  profiles are kept across lines and pages by OtLayout and cleared with the word widths.
+  The cache is shared by the sessions of concurrent threads.
+*/
+class StretchProfileCache {
+public:
+
+  struct Feature {
+    // Character index in the word
+    int index;
+    QString name;
+    int value;
+  };
+
+  struct Profile {
+    // The natural width of the word followed by its width after each step
+    std::vector<double> widths;
+    // The features of the word after each step
+    std::vector<std::vector<Feature>> features;
+  };
+
+  bool find(const QString& text, hb_font_t* font, int nbLevels, Profile& profile) const;
+  void insert(const QString& text, hb_font_t* font, int nbLevels, const Profile& profile);
+
+  void clear();
+  size_t size() const;
+
+private:
+
+  struct Key {
+    QString text;
+    int scale;
+    // Normalized variation coordinates followed by the number of levels
+    std::vector<int64_t> values;
+
+    bool operator==(const Key& r) const {
+      return scale == r.scale && values == r.values && text == r.text;
+    }
+  };
+
+  struct KeyHash {
+    size_t operator()(const Key& key) const;
+  };
+
+  static Key key(const QString& text, hb_font_t* font, int nbLevels);
+
+  std::unordered_map<Key, Profile, KeyHash> profiles;
+  mutable std::shared_mutex mutex;
+};
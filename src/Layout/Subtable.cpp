@@ -1523,6 +1523,12 @@ optional<QPoint> CursiveSubtable::getExit(quint16 glyph_id, GlyphParameters para
 
   optional<QPoint> exit;
 
+  auto generation = m_layout->alternateGeneration;
+
+  if (anchorCache.find(glyph_id, 1, parameters, generation, exit)) {
+    return exit;
+  }
+
   auto anchorType = m_lookup->flags & Lookup::Flags::RightToLeft ? GlyphVis::AnchorType::ExitAnchorRTL : GlyphVis::AnchorType::ExitAnchor;
 
   if (anchors.contains(glyph_id)) {
@@ -1553,6 +1559,8 @@ optional<QPoint> CursiveSubtable::getExit(quint16 glyph_id, GlyphParameters para
     }
   }
 
+  anchorCache.insert(glyph_id, 1, parameters, generation, exit);
+
   return exit;
 }
 
@@ -1560,6 +1568,12 @@ optional<QPoint> CursiveSubtable::getEntry(quint16 glyph_id, GlyphParameters par
 
   optional<QPoint> entry;
 
+  auto generation = m_layout->alternateGeneration;
+
+  if (anchorCache.find(glyph_id, 0, parameters, generation, entry)) {
+    return entry;
+  }
+
   auto anchorType = m_lookup->flags & Lookup::Flags::RightToLeft ? GlyphVis::AnchorType::EntryAnchorRTL : GlyphVis::AnchorType::EntryAnchor;
 
   if (anchors.contains(glyph_id)) {
@@ -1592,6 +1606,8 @@ optional<QPoint> CursiveSubtable::getEntry(quint16 glyph_id, GlyphParameters par
     }
   }
 
+  anchorCache.insert(glyph_id, 0, parameters, generation, entry);
+
   return entry;
 }
 QPoint CursiveSubtable::calculateEntry(GlyphVis* originalglyph, GlyphVis* extendedglyph, QPoint entry) {
@@ -1642,6 +1658,8 @@ void CursiveSubtable::readJson(const QJsonObject& json) {
 }
 void CursiveSubtable::readParameters(const QJsonObject& json) {
 
+  anchorCache.clear();
+
 
   if (json["exitParameters"].isObject()) {
     QJsonObject exitParametersObject = json["exitParameters"].toObject();
@@ -2025,6 +2043,8 @@ void MarkBaseSubtable::saveParameters(QJsonObject& json) const {
 }
 void MarkBaseSubtable::readParameters(const QJsonObject& json) {
 
+  anchorCache.clear();
+
   for (int index = 0; index < json.size(); ++index) {
     QString className = json.keys()[index];
     QJsonObject classobject = json[className].toObject();
@@ -2100,13 +2120,25 @@ QPoint MarkBaseSubtable::getBaseAnchor(QString baseGlyphName, QString className,
 
 optional<QPoint> MarkBaseSubtable::getBaseAnchor(quint16 mark_id, quint16 base_id, GlyphParameters parameters) {
 
-  quint16 classIndex = markCodes[mark_id];
+  quint16 classIndex = markCodes.value(mark_id);
+
+  optional<QPoint> anchor;
 
-  QString className = classNamebyIndex[classIndex];
+  auto generation = m_layout->alternateGeneration;
 
-  QString baseGlyphName = m_layout->glyphNamePerCode[base_id];
+  if (anchorCache.find(base_id, classIndex << 1, parameters, generation, anchor)) {
+    return anchor;
+  }
 
-  return getBaseAnchor(baseGlyphName, className, parameters);
+  QString className = classNamebyIndex.value(classIndex);
+
+  QString baseGlyphName = m_layout->glyphNamePerCode.value(base_id);
+
+  anchor = getBaseAnchor(baseGlyphName, className, parameters);
+
+  anchorCache.insert(base_id, classIndex << 1, parameters, generation, anchor);
+
+  return anchor;
 
 
 }
@@ -2150,18 +2182,33 @@ QPoint MarkBaseSubtable::getMarkAnchor(QString markGlyphName, QString className,
 }
 optional<QPoint> MarkBaseSubtable::getMarkAnchor(quint16 mark_id, quint16 base_id, GlyphParameters parameters) {
 
-  quint16 classIndex = markCodes[mark_id];
+  quint16 classIndex = markCodes.value(mark_id);
+
+  optional<QPoint> anchor;
 
-  QString className = classNamebyIndex[classIndex];
+  auto generation = m_layout->alternateGeneration;
 
-  QString markGlyphName = m_layout->glyphNamePerCode[mark_id];
+  if (anchorCache.find(mark_id, classIndex << 1 | 1, parameters, generation, anchor)) {
+    return anchor;
+  }
 
-  return getMarkAnchor(markGlyphName, className, parameters);
+  QString className = classNamebyIndex.value(classIndex);
+
+  QString markGlyphName = m_layout->glyphNamePerCode.value(mark_id);
+
+  anchor = getMarkAnchor(markGlyphName, className, parameters);
+
+  anchorCache.insert(mark_id, classIndex << 1 | 1, parameters, generation, anchor);
+
+  return anchor;
 
 }
 
 QByteArray MarkBaseSubtable::getOpenTypeTable(bool extended) {
 
+  // The mark classes are indexed again
+  anchorCache.clear();
+
   QByteArray root;
   QByteArray baseCoverage;
   QByteArray markCoverage;
@@ -27,6 +27,7 @@
 #include "OtLayout.h"
 #include <optional>
 #include "JustificationContext.h"
+#include "AnchorCache.h"
 
 
 struct Lookup;
@@ -76,6 +77,11 @@ struct Subtable {
     return m_lookup;
   }
 
+  // The table returned by getOptOpenTypeTable while it is not dirty
+  const QByteArray* cachedOpenTypeTable() const {
+    return isDirty ? nullptr : &openTypeSubTable;
+  }
+
   QString name;
 
 protected:
@@ -252,6 +258,9 @@ struct CursiveSubtable : Subtable {
 
   virtual std::optional<QPoint> getExit(quint16 glyph_id, GlyphParameters parameters);
 
+  // Anchors returned by getEntry and getExit, cleared when the parameters change
+  AnchorCache anchorCache;
+
 
 
 };
@@ -293,6 +302,9 @@ struct MarkBaseSubtable : Subtable {
   virtual QPoint getBaseAnchor(QString baseGlyphName, QString className, GlyphParameters parameters);
   virtual std::optional<QPoint> getMarkAnchor(quint16 mark_id, quint16 base_id, GlyphParameters parameters);
   QPoint getMarkAnchor(QString markGlyphName, QString className, GlyphParameters parameters);
+
+  // Anchors returned by getBaseAnchor and getMarkAnchor for a code, cleared when the parameters or the mark classes change
+  AnchorCache anchorCache;
 };
 
 struct ChainingSubtable : Subtable {
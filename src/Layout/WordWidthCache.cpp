@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#include "WordWidthCache.h"
+#include "commontypes.h"
+
+#include <mutex>
+
+WordWidthCache::Key WordWidthCache::key(const QString& text, hb_font_t* font, const std::vector<hb_feature_t>& features) {
+
+  Key key{ text, 0, {} };
+
+  int yscale;
+  hb_font_get_scale(font, &key.scale, &yscale);
+
+  unsigned int length;
+  const int* coords = hb_font_get_var_coords_normalized(font, &length);
+
+  key.values.reserve(length + 1 + 4 * features.size());
+  key.values.insert(key.values.end(), coords, coords + length);
+  // Separates the coordinates from the features
+  key.values.push_back(-1);
+
+  for (auto& feature : features) {
+    key.values.push_back(feature.tag);
+    key.values.push_back(feature.value);
+    key.values.push_back(feature.start);
+    key.values.push_back(feature.end);
+  }
+
+  return key;
+}
+
+size_t WordWidthCache::KeyHash::operator()(const Key& key) const {
+  uint64_t h = std::hash<GlyphParameters>::mix(qHash(key.text) ^ ((uint64_t)(uint32_t)key.scale << 32));
+  for (auto value : key.values) {
+    h = std::hash<GlyphParameters>::mix(h ^ (uint64_t)value);
+  }
+  return (size_t)h;
+}
+
+bool WordWidthCache::find(const QString& text, hb_font_t* font, const std::vector<hb_feature_t>& features, double& width) const {
+
+  auto k = key(text, font, features);
+
+  std::shared_lock<std::shared_mutex> lock(mutex);
+
+  auto find = widths.find(k);
+
+  if (find == widths.end()) {
+    return false;
+  }
+
+  width = find->second;
+
+  return true;
+}
+
+void WordWidthCache::insert(const QString& text, hb_font_t* font, const std::vector<hb_feature_t>& features, double width) {
+
+  auto k = key(text, font, features);
+
+  std::unique_lock<std::shared_mutex> lock(mutex);
+
+  widths.insert({ std::move(k), width });
+}
+
+void WordWidthCache::clear() {
+  std::unique_lock<std::shared_mutex> lock(mutex);
+  widths.clear();
+}
+
+size_t WordWidthCache::size() const {
+  std::shared_lock<std::shared_mutex> lock(mutex);
+  return widths.size();
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+#include <shared_mutex>
+#include <cstdint>
+
+#include <QString>
+#include <QHash>
+
+#include "hb.h"
+
+/*
+  Widths of the words shaped by the feature based justification (just_features.cpp), keyed by the text, the features,
+  the scale and the variation coordinates of the font. The same words are shaped again for each combination of features
+  tried on each line, the cache is kept across lines and pages by OtLayout and cleared when the face or the alternates
+  are replaced.
+  The cache is shared by the sessions of concurrent threads.
+*/
+class WordWidthCache {
+public:
+
+  bool find(const QString& text, hb_font_t* font, const std::vector<hb_feature_t>& features, double& width) const;
+  void insert(const QString& text, hb_font_t* font, const std::vector<hb_feature_t>& features, double width);
+
+  void clear();
+  size_t size() const;
+
+private:
+
+  struct Key {
+    QString text;
+    int scale;
+    // Normalized variation coordinates followed by the tag, value, start and end of each feature
+    std::vector<int64_t> values;
+
+    bool operator==(const Key& r) const {
+      return scale == r.scale && values == r.values && text == r.text;
+    }
+  };
+
+  struct KeyHash {
+    size_t operator()(const Key& key) const;
+  };
+
+  static Key key(const QString& text, hb_font_t* font, const std::vector<hb_feature_t>& features);
+
+  std::unordered_map<Key, double, KeyHash> widths;
+  mutable std::shared_mutex mutex;
+};
@@ -21,6 +21,7 @@
 #define H_COMMONTYPES
 
 #include <math.h>
+#include <stdint.h>
 
 struct GlyphParameters {
   double lefttatweel{ 0.0 };
@@ -39,14 +40,29 @@ struct GlyphParameters {
 namespace std {
   template<>
   struct hash<GlyphParameters> {
+    // Each parameter is quantized to 1/65536 so that equal values (0.0 and -0.0) give the same hash, then folded with
+    // a splitmix64 round so that permuted values such as lefttatweel/righttatweel pairs do not cancel each other
+    static uint64_t mix(uint64_t x) {
+      x ^= x >> 30;
+      x *= 0xbf58476d1ce4e5b9ULL;
+      x ^= x >> 27;
+      x *= 0x94d049bb133111ebULL;
+      x ^= x >> 31;
+      return x;
+    }
+    static uint64_t quantize(double value) {
+      return (uint64_t)(int64_t)floor(value * 65536.0 + 0.5);
+    }
     size_t operator()(const GlyphParameters& r) const
     {
-      return hash<double>{}(r.lefttatweel)
-        ^ hash<double>{}(r.righttatweel)
-        ^ hash<double>{}(r.third)
-        ^ hash<double>{}(r.fourth)
-        ^ hash<double>{}(r.fifth)
-        ^ hash<double>{}(r.scalex);
+      uint64_t h = 0x9e3779b97f4a7c15ULL;
+      h = mix(h ^ quantize(r.lefttatweel));
+      h = mix(h ^ quantize(r.righttatweel));
+      h = mix(h ^ quantize(r.third));
+      h = mix(h ^ quantize(r.fourth));
+      h = mix(h ^ quantize(r.fifth));
+      h = mix(h ^ quantize(r.scalex));
+      return (size_t)h;
     }
   };
 
@@ -1,7 +1,12 @@
 #include "OtLayout.h"
+#include "ShapingSession.h"
+#include "LineLayoutCache.h"
+#include "StretchProfileCache.h"
+#include "JustificationStore.h"
+#include "LetterPairRules.h"
 #include  <algorithm>
+#include <limits>
 #include "hb-buffer.hh"
-#include <qregularexpression.h>
 
 #include "hb-font.hh"
 
@@ -70,20 +75,6 @@ struct LineTextInfo {
   vector<WordInfo> wordInfos;
 };
 
-struct TextFontFeatures {
-  QString name;
-  int value;
-};
-
-struct JustResultByLine {
-  float sclxAxis = 0;
-  vector<TextFontFeatures> globalFeatures = {};
-  map<int, vector<TextFontFeatures>> fontFeatures = {}; /* FontFeatures by character index in the line */
-  double simpleSpacing;
-  double ayaSpacing;
-  double xScale;
-};
-
 struct JustInfo {
   map<int, vector<TextFontFeatures>> fontFeatures = {};
   double desiredWidth;
@@ -93,19 +84,15 @@ struct JustInfo {
 };
 
 
-static const QString rightNoJoinLetters = "آاٱأإدذرزوؤءة";
-static const QString dualJoinLetters = "بتثجحخسشصضطظعغفقكلمنهيئى";
-
-static set<QChar> bases{};
-
-void initBases() {
-  for (int i = 0; i < dualJoinLetters.size(); i++) {
-    bases.insert(dualJoinLetters.at(i));
-  }
-  for (int i = 0; i < rightNoJoinLetters.size(); i++) {
-    bases.insert(rightNoJoinLetters.at(i));
-  }
-}
+static const LetterClass behLetters("بتثنيئ");
+static const LetterClass behYehLetters("ئبتثنيى");
+static const LetterClass yehLetters("يئى");
+static const LetterClass fehQafLetters("فق");
+static const LetterClass ainLetters("عغ");
+static const LetterClass seenLetters("سش");
+static const LetterClass seenSadLetters("سشصض");
+static const LetterClass rehNoonLetters("رزن");
+static const LetterClass alefDalLamLetters("آادذٱأإل");
 
 static hb_segment_properties_t savedprops{
   HB_DIRECTION_RTL,
@@ -117,10 +104,6 @@ static hb_segment_properties_t savedprops{
 
 static LineTextInfo analyzeLineForJust(QString lineText) {
 
-  if (bases.size() == 0) {
-    initBases();
-  }
-
   LineTextInfo lineTextInfo = {
     .lineText = lineText,
     .ayaSpaceIndexes = {},
@@ -155,7 +138,7 @@ static LineTextInfo analyzeLineForJust(QString lineText) {
     }
     else {
       currentWord->text += qchar;
-      if (bases.find(qchar) != bases.end()) {
+      if (baseLetters.contains(qchar)) {
         currentWord->baseText += qchar;
         currentWord->baseIndexes.push_back(i - currentWord->startIndex);
         if (qchar == U'ء') {
@@ -164,7 +147,7 @@ static LineTextInfo analyzeLineForJust(QString lineText) {
         auto& subWord = currentWord->subwords.back();
         subWord.baseText += qchar;
         subWord.baseIndexes.push_back(i - currentWord->startIndex);
-        if (i < lineText.size() - 1 && qchar != U'ء' && rightNoJoinLetters.contains(qchar)) {
+        if (i < lineText.size() - 1 && qchar != U'ء' && rightNoJoinClass.contains(qchar)) {
           currentWord->subwords.push_back({ .baseIndexes = {}, .baseText = "" });
         }
 
@@ -178,7 +161,7 @@ static LineTextInfo analyzeLineForJust(QString lineText) {
 }
 
 static hb_buffer_t* shape(QString text, hb_font_t* font, vector< hb_feature_t> features) {
-  hb_buffer_t* buffer = buffer = hb_buffer_create();
+  hb_buffer_t* buffer = ShapingSession::acquireBuffer();
 
 
   hb_buffer_set_segment_properties(buffer, &savedprops);
@@ -196,10 +179,16 @@ static hb_buffer_t* shape(QString text, hb_font_t* font, vector< hb_feature_t> f
 
 static double getWidth(const QString& text, hb_font_t* font, const vector< hb_feature_t>& features) {
 
-  auto buffer = shape(text, font, features);
+  auto session = ShapingSession::current();
 
   double totalWidth = 0.0;
 
+  if (session != nullptr && session->layout()->wordWidths.find(text, font, features, totalWidth)) {
+    return totalWidth;
+  }
+
+  auto buffer = shape(text, font, features);
+
   unsigned int glyph_count;
 
   hb_glyph_position_t* glyph_pos = hb_buffer_get_glyph_positions(buffer, &glyph_count);
@@ -208,7 +197,11 @@ static double getWidth(const QString& text, hb_font_t* font, const vector< hb_fe
     totalWidth += glyph_pos[i].x_advance;
   }
 
-  hb_buffer_destroy(buffer);
+  ShapingSession::releaseBuffer(buffer);
+
+  if (session != nullptr) {
+    session->layout()->wordWidths.insert(text, font, features, totalWidth);
+  }
 
   return totalWidth;
 }
@@ -261,39 +254,6 @@ static AppliedResult tryApplyFeatures(int wordIndex, const LineTextInfo& lineTex
   }
 }
 
-struct SubWordsMatch {
-  vector<int> subWordIndexes;
-  vector<vector<QRegularExpressionMatch>> matches;
-};
-
-static SubWordsMatch matchSubWords(const WordInfo& wordInfo, const vector<QRegularExpression>& regExprs) {
-
-  SubWordsMatch result;
-
-
-  for (int subIndex = 0; subIndex < wordInfo.subwords.size(); subIndex++) {
-    const auto& subWord = wordInfo.subwords[subIndex];
-
-    result.matches.push_back({});
-
-    auto& subWordMatches = result.matches.back();
-
-    for (const auto& regExpr : regExprs) {
-      auto matches = regExpr.globalMatch(subWord.baseText);
-      while (matches.hasNext()) {
-        QRegularExpressionMatch match = matches.next();
-        subWordMatches.push_back(match);
-      }
-    }
-
-    if (subWordMatches.size() > 0) {
-      result.subWordIndexes.push_back(subIndex);
-    }
-  }
-
-  return result;
-}
-
 struct Appliedfeature {
   TextFontFeatures feature;
   int(*calcNewValue)(int, int);
@@ -384,24 +344,29 @@ static boolean applyAlternatesSubWords(const LineTextInfo& lineTextInfo, JustInf
 
   const auto& wordInfos = lineTextInfo.wordInfos;
 
-  vector<SubWordsMatch> matchresult;
-
-  auto patternAlt = "^.*(?<alt>[${" + chars + "}])$";
-  vector<QRegularExpression> regExprAlt{ QRegularExpression{patternAlt} };
+  // The subwords ending with one of the letters
+  vector<vector<int>> matchresult;
 
+  LetterClass altLetters(chars);
 
   for (int wordIndex = 0; wordIndex < wordInfos.size(); wordIndex++) {
-    matchresult.push_back(matchSubWords(wordInfos[wordIndex], regExprAlt));
+    matchresult.push_back({});
+    auto& subwords = wordInfos[wordIndex].subwords;
+    for (int subIndex = 0; subIndex < subwords.size(); subIndex++) {
+      if (!subwords[subIndex].baseText.isEmpty() && altLetters.contains(subwords[subIndex].baseText.back())) {
+        matchresult.back().push_back(subIndex);
+      }
+    }
   }
 
   for (int level = 1; level <= nbLevels; level++) {
     for (int wordIndex = 0; wordIndex < wordInfos.size(); wordIndex++) {
       const auto& wordInfo = wordInfos[wordIndex];
-      const auto& subWordsMatch = matchresult[wordIndex];
+      const auto& subWordIndexes = matchresult[wordIndex];
 
-      for (int i = subWordsMatch.subWordIndexes.size() - 1; i >= 0; i--) {
-        auto subWordIndex = subWordsMatch.subWordIndexes[i];
-        auto matchIndex = subWordsMatch.matches[subWordIndex][0].capturedStart("alt");
+      for (int i = subWordIndexes.size() - 1; i >= 0; i--) {
+        auto subWordIndex = subWordIndexes[i];
+        auto matchIndex = wordInfo.subwords[subWordIndex].baseText.size() - 1;
         auto indexInLine = wordInfo.startIndex + wordInfo.subwords[subWordIndex].baseIndexes[matchIndex];
 
         auto appliedResult = applyAlternate(lineTextInfo, justInfo, wordIndex, indexInLine);
@@ -421,30 +386,6 @@ static boolean applyAlternatesSubWords(const LineTextInfo& lineTextInfo, JustInf
   return false;
 }
 
-static QString rightKashExp = QString("بتثنيئ") + "جحخ" + "سش" + "صض" + "طظ" + "عغ" + "فق" + "م" + "ه";
-static QString leftKash = QString("ئبتثني") + "جحخ" + "طظ" + "عغ" + "فق" + "ةلم" + "رز";
-static QString mediLeftAsendant = "ل";
-static const QString finalAscendant = "آادذٱأإكلهة";
-static auto regexBeh = vector<QRegularExpression>{ QRegularExpression("^.+(?<k1>[بتثنيسشصض][بتثنيم]).+$") };
-static auto regexFinaAscendant = vector<QRegularExpression>{ QRegularExpression(QString("^.*(?<k1>[%1][%2])$").arg(rightKashExp).arg(finalAscendant)) };
-static auto regexOtherKashidas = vector<QRegularExpression>{
-  QRegularExpression(QString(".*(?<k1>[%1][رز])").arg(rightKashExp)),
-  QRegularExpression(QString(".*(?<k1>[%1](?:[%2]|[%3]))").arg(rightKashExp).arg(mediLeftAsendant).arg(leftKash.replace("رز", ""))),
-};
-static auto regexKaf = vector<QRegularExpression>{ QRegularExpression("^.*(?<k1>[ك].).*$") };
-static auto regexSecondKashidaNotSameSubWord = vector<QRegularExpression>{
-  QRegularExpression(QString("^.+(?<k1>[بتثنيسشصض][بتثنيم]).+$")),
-  QRegularExpression(QString("^.*(?<k1>[%1][آادذٱأإكلهة])$").arg(rightKashExp)),
-  QRegularExpression(QString(".*(?<k1>[%1][رز])").arg(rightKashExp)),
-  QRegularExpression(QString(".*(?<k1>[%1](?:[%2]|[%3]))").arg(rightKashExp).arg(mediLeftAsendant).arg(leftKash.replace("رز", ""))),
-};
-static auto regexSecondKashidaSameSubWord = vector<QRegularExpression>{
-  QRegularExpression(QString("^.+(?<k1>[بتثنيسشصض][بتثنيم]).+")),
-  QRegularExpression(QString("(?<k1>[%1][آادذٱأإكلهة])$").arg(rightKashExp)),
-  QRegularExpression(QString("(?<k1>[%1][رز])").arg(rightKashExp)),
-  QRegularExpression(QString("(?<k1>[%1](?:[%2]|[%3]))").arg(rightKashExp).arg(mediLeftAsendant).arg(leftKash.replace("رز", ""))),
-};
-
 
 
 static void DealWithDecomposition(
@@ -465,77 +406,77 @@ static void DealWithDecomposition(
   auto chark4 = lineText[secondIndexInLine];
 
   if (
-    QString("ه").contains(chark3) &&
-    QString("م").contains(chark4) &&
+    chark3 == U'ه' &&
+    chark4 == U'م' &&
     subWordInfo.baseIndexes.back() == secondMatchIndex
     ) {
     firstAppliedFeatures.push_back({ .feature = {.name = "cv11", .value = 1 } });
     secondNewFeatures.push_back({ .name = "cv11", .value = 1 });
   }
   else if (
-    QString("بتثنيئ").contains(chark3) &&
+    behLetters.contains(chark3) &&
     subWordInfo.baseIndexes[0] == firstMatchIndex &&
-    QString("جحخ").contains(chark4)
+    jhkLetters.contains(chark4)
     ) {
     firstAppliedFeatures.push_back({ .feature = {.name = "cv12", .value = 1 } });
     secondNewFeatures.push_back({ .name = "cv12", .value = 1 });
   }
   else if (
-    QString("م").contains(chark3) &&
+    chark3 == U'م' &&
     subWordInfo.baseIndexes[0] == firstMatchIndex &&
-    QString("جحخ").contains(chark4)
+    jhkLetters.contains(chark4)
     ) {
     firstAppliedFeatures.push_back({ .feature = {.name = "cv13", .value = 1 } });
     secondNewFeatures.push_back({ .name = "cv13", .value = 1 });
   }
   else if (
-    QString("فق").contains(chark3) &&
+    fehQafLetters.contains(chark3) &&
     subWordInfo.baseIndexes[0] == firstMatchIndex &&
-    QString("جحخ").contains(chark4)
+    jhkLetters.contains(chark4)
     ) {
     firstAppliedFeatures.push_back({ .feature = {.name = "cv14", .value = 1 } });
     secondNewFeatures.push_back({ .name = "cv14", .value = 1 });
   }
   else if (
-    QString("ل").contains(chark3) &&
+    chark3 == U'ل' &&
     subWordInfo.baseIndexes[0] == firstMatchIndex &&
-    QString("جحخ").contains(chark4)
+    jhkLetters.contains(chark4)
     ) {
     firstAppliedFeatures.push_back({ .feature = {.name = "cv15", .value = 1 } });
     secondNewFeatures.push_back({ .name = "cv15", .value = 1 });
   }
   else if (
-    QString("عغ").contains(chark3) &&
+    ainLetters.contains(chark3) &&
     subWordInfo.baseIndexes[0] == firstMatchIndex &&
-    (QString("آادذٱأإل").contains(chark4) ||
-      (QString("بتثنيئ").contains(chark4) && subWordInfo.baseText.size() > 2 &&
-        QString("سش").contains(subWordInfo.baseText[2])))
+    (alefDalLamLetters.contains(chark4) ||
+      (behLetters.contains(chark4) && subWordInfo.baseText.size() > 2 &&
+        seenLetters.contains(subWordInfo.baseText[2])))
     ) {
     firstAppliedFeatures.push_back({ .feature = {.name = "cv16", .value = 1 } });
     secondNewFeatures.push_back({ .name = "cv16", .value = 1 });
   }
-  else if (QString("جحخ").contains(chark3)) {
+  else if (jhkLetters.contains(chark3)) {
     if (
-      QString("آادذٱأإل").contains(chark4) ||
-      (QString("هة").contains(chark4) &&
+      alefDalLamLetters.contains(chark4) ||
+      (hehLetters.contains(chark4) &&
         subWordInfo.baseIndexes.back() == secondMatchIndex) ||
-      (QString("بتثنيئ").contains(chark4) &&
+      (behLetters.contains(chark4) &&
         subWordInfo.baseIndexes.size() > 1 &&
         subWordInfo.baseIndexes.end()[-2] == secondMatchIndex &&
-        QString("رزن").contains(subWordInfo.baseText.back()))
+        rehNoonLetters.contains(subWordInfo.baseText.back()))
       ) {
       firstAppliedFeatures.push_back({ .feature = {.name = "cv16", .value = 1 } });
       secondNewFeatures.push_back({ .name = "cv16", .value = 1 });
     }
     else if (
       subWordInfo.baseIndexes[0] == firstMatchIndex &&
-      QString("م").contains(chark4)
+      chark4 == U'م'
       ) {
       firstAppliedFeatures.push_back({ .feature = {.name = "cv18", .value = 1 } });
       secondNewFeatures.push_back({ .name = "cv18", .value = 1 });
     }
   }
-  else if (QString("سشصض").contains(chark3) && QString("رز").contains(chark4)) {
+  else if (seenSadLetters.contains(chark3) && rehLetters.contains(chark4)) {
     firstAppliedFeatures.push_back({ .feature = {.name = "cv17", .value = 1 } });
     secondNewFeatures.push_back({ .name = "cv17", .value = 1 });
   }
@@ -591,9 +532,9 @@ static AppliedResult applyKashida(
     return appliedResult;
   }
   else if (
-    QString("ئبتثنيى").contains(chark3) &&
+    behYehLetters.contains(chark3) &&
     subWordInfo.baseIndexes[0] != firstMatchIndex &&
-    QString("رز").contains(chark4)
+    rehLetters.contains(chark4)
     ) {
     return appliedResult;
   }
@@ -602,7 +543,7 @@ static AppliedResult applyKashida(
 
   vector<Appliedfeature> firstAppliedFeatures{ Appliedfeature{.feature = {.name = "cv01", .value = 1 }, .calcNewValue = [](int prev, int curr) { return min(prev + curr, 6); } } };
 
-  if (QString("بتثنيئ").contains(chark3)) {
+  if (behLetters.contains(chark3)) {
     firstAppliedFeatures.push_back({ .feature = {.name = "cv10", .value = 1 } });
   }
 
@@ -624,7 +565,7 @@ static AppliedResult applyKashida(
 
   int cv02Value;
 
-  if (finalAscendant.contains(chark4) && subWordInfo.baseIndexes.back() == secondMatchIndex) {
+  if (finalAscendantLetters.contains(chark4) && subWordInfo.baseIndexes.back() == secondMatchIndex) {
     cv02Value = cv01Value;
   }
   else {
@@ -721,32 +662,36 @@ static boolean applyKashidasSubWords(
   auto& wordInfos = lineTextInfo.wordInfos;
   auto& lineText = lineTextInfo.lineText;
 
-  vector<SubWordsMatch> matchresult;
+  // The matches of each subword of each word
+  vector<vector<vector<LetterPairMatch>>> matchresult;
 
-  vector<QRegularExpression> regExprs;
+  const vector<LetterPairRule>* rules = nullptr;
   switch (type) {
   case StretchType::Beh:
-    regExprs = regexBeh;
+    rules = &behRules;
     break;
   case StretchType::FinaAscendant:
-    regExprs = regexFinaAscendant;
+    rules = &finaAscendantRules;
     break;
   case StretchType::OtherKashidas:
-    regExprs = regexOtherKashidas;
+    rules = &otherKashidasRules;
     break;
   case StretchType::Kaf:
-    regExprs = regexKaf;
+    rules = &kafRules;
     break;
   case StretchType::SecondKashidaNotSameSubWord:
-    regExprs = regexSecondKashidaNotSameSubWord;
+    rules = &secondKashidaNotSameSubWordRules;
     break;
   case StretchType::SecondKashidaSameSubWord:
-    regExprs = regexSecondKashidaSameSubWord;
+    rules = &secondKashidaSameSubWordRules;
     break;
   }
 
   for (int wordIndex = 0; wordIndex < wordInfos.size(); wordIndex++) {
-    matchresult.push_back(matchSubWords(wordInfos[wordIndex], regExprs));
+    matchresult.push_back({});
+    for (auto& subWord : wordInfos[wordIndex].subwords) {
+      matchresult.back().push_back(matchAllLetterPairs(subWord.baseText, *rules));
+    }
   }
 
   for (int level = 1; level <= nbLevels; level++) {
@@ -769,17 +714,13 @@ static boolean applyKashidasSubWords(
       auto done = false;
 
       for (
-        int i = subWordsMatch.subWordIndexes.size() - 1;
-        i >= 0 && !done;
-        i--
+        int subWordIndex = subWordsMatch.size() - 1;
+        subWordIndex >= 0 && !done;
+        subWordIndex--
         ) {
-        auto subWordIndex = subWordsMatch.subWordIndexes[i];
-
-        for (auto match : subWordsMatch.matches[subWordIndex]) {
-
-          auto firstSubWordMatchIndex = match.capturedStart("k1");
+        for (auto& match : subWordsMatch[subWordIndex]) {
 
-          if (firstSubWordMatchIndex == -1) continue;
+          auto firstSubWordMatchIndex = match.position;
           auto secondSubWordMacthIndex = firstSubWordMatchIndex + 1;
 
           if (type == StretchType::SecondKashidaNotSameSubWord) {
@@ -837,54 +778,22 @@ static boolean applyKashidasSubWords(
   return false;
 }
 
-//static const QString rightNoJoinLetters = "آاٱأإدذرزوؤءة";
-//static const QString dualJoinLetters = "بتثجحخسشصضطظعغفقكلمنهيئى";
-
-static const QString rightChars = dualJoinLetters;
-static const QString leftChars = dualJoinLetters + QString(rightNoJoinLetters).remove("ء");
-static const QString rightKash = QString(rightChars).remove(QRegularExpression("[لك]"));
-static const QString leftKashidaFina = QString(leftChars).remove(QRegularExpression("[وهصضطظ]"));
-static const QString leftKashidaMedi = QString(leftKashidaFina).remove("ه");
-static const QString jhk = "جحخ";
-
-static const QString altFinPat = "^.*([بتثفكنصضسشقيئى])$";
-static const QRegularExpression altFinaPrio1Reg(altFinPat);
-static const QString finalKashidaEndWord = QString("^.*([%1][آاٱأإملهة])$").arg(rightKash);
-static const QString finalKashida = QString("^.*([%1][دذآاٱأإملهة])$").arg(rightKash);
-static const QString hahKashida = QString("^.*([%1][%2]).*$|^.*([%1][هة])$").arg(jhk).arg(leftKashidaMedi);
-static const QRegularExpression regHahFinaAscenKashida(hahKashida + "|" + finalKashidaEndWord);
-static const QString behBehPat = "^.+([بتثنيسشصض][بتثنيم]).+$";
-static const QString rehPat = QString(".*([%1][رز])").arg(rightKash);
-static const QString otherPat = QString(".*([%1](?:[%2]|[%3]))").arg(rightKash).arg(mediLeftAsendant).arg(leftKashidaMedi);
-static const QString kafPat = "^.*([ك].).*$";
-static const QString patternAlt = altFinPat + "|" + hahKashida + "|" + finalKashida + "|" + behBehPat + "|" + rehPat + "|" + otherPat + "|" + kafPat;
-static const QRegularExpression regExprAlt(patternAlt);
 
+struct SimpleJustMatch {
+  int subWordIndex;
+  LetterPairMatch match;
+  int type;
+};
 
-static boolean  applySimpleJust(const LineTextInfo& lineTextInfo,
-  JustInfo& justInfo,
-  bool firstWordIncluded,
-  bool wordByWord,
-  int nbLevelAlt,
-  int nbLevelKashida)
-{
+static vector<SimpleJustMatch> matchSimpleJust(const LineTextInfo& lineTextInfo, int firstWordIndex) {
 
   auto& wordInfos = lineTextInfo.wordInfos;
-  auto& lineText = lineTextInfo.lineText;
-
-  struct SubWordMatch {
-    int subWordIndex;
-    QRegularExpressionMatch match;
-    int type;
-  };
 
-  vector<SubWordMatch> matchresult;
-
-  auto firstWordIndex = firstWordIncluded ? 0 : 1;
+  vector<SimpleJustMatch> matchresult;
 
   for (int wordIndex = 0; wordIndex < wordInfos.size(); wordIndex++) {
     auto& wordInfo = wordInfos[wordIndex];
-    SubWordMatch result{ .subWordIndex = -1, .match = {}, .type = 0 };
+    SimpleJustMatch result{ .subWordIndex = -1, .match = {}, .type = 0 };
     if (wordInfo.baseText.isEmpty() || wordIndex < firstWordIndex) {
       matchresult.push_back(result);
       continue;
@@ -892,15 +801,15 @@ static boolean  applySimpleJust(const LineTextInfo& lineTextInfo,
 
     auto lastIndex = wordInfo.subwords.size() - 1;
     auto& subWord = wordInfo.subwords[lastIndex];
-    auto match = altFinaPrio1Reg.match(subWord.baseText);
-    if (match.hasMatch()) {
+    auto match = matchLetterPairs(subWord.baseText, altFinaRules);
+    if (match.rule != 0) {
       result.subWordIndex = lastIndex;
       result.match = match;
       result.type = 1;
     }
-    else if (!QString("يئى").contains(wordInfo.baseText.back())) {
-      match = regHahFinaAscenKashida.match(subWord.baseText);
-      if (match.hasMatch()) {
+    else if (!yehLetters.contains(wordInfo.baseText.back())) {
+      match = matchLetterPairs(subWord.baseText, hahFinaAscenKashidaRules);
+      if (match.rule != 0) {
         result.subWordIndex = lastIndex;
         result.match = match;
         result.type = 2;
@@ -908,8 +817,8 @@ static boolean  applySimpleJust(const LineTextInfo& lineTextInfo,
       else {
         for (int subIndex = lastIndex; subIndex >= 0; subIndex--) {
           auto& subWord = wordInfo.subwords[subIndex];
-          auto match = regExprAlt.match(subWord.baseText);
-          if (match.hasMatch()) {
+          auto match = matchLetterPairs(subWord.baseText, simpleJustRules);
+          if (match.rule != 0) {
             result.subWordIndex = subIndex;
             result.match = match;
             result.type = 3;
@@ -922,59 +831,265 @@ static boolean  applySimpleJust(const LineTextInfo& lineTextInfo,
     matchresult.push_back(result);
   }
 
+  return matchresult;
+}
+
+static bool isSimpleJustAlternate(const SimpleJustMatch& subWordsMatch) {
+  return subWordsMatch.type == 1 || (subWordsMatch.type == 3 && (subWordsMatch.match.rule == 1));
+}
+
+// Stretches the word once more at the given level
+static AppliedResult applySimpleJustStep(const LineTextInfo& lineTextInfo,
+  JustInfo& justInfo,
+  int wordIndex,
+  const SimpleJustMatch& subWordsMatch,
+  int level,
+  int nbLevelAlt,
+  int nbLevelKashida)
+{
+  AppliedResult appliedResult = AppliedResult::NoChange;
+
+  auto& wordInfo = lineTextInfo.wordInfos[wordIndex];
+
+  auto& match = subWordsMatch.match;
+
+  auto subWordIndex = subWordsMatch.subWordIndex;
+
+  if (isSimpleJustAlternate(subWordsMatch)) {
+    // Alternates
+    if (level <= nbLevelAlt) {
+      auto baseIndex = match.position;
+      auto indexInLine = wordInfo.startIndex + wordInfo.subwords[subWordIndex].baseIndexes[baseIndex];
+      appliedResult = applyAlternate(lineTextInfo, justInfo, wordIndex, indexInLine);
+    }
+  }
+  else if (level <= nbLevelKashida) {
+    auto firstSubWordMatchIndex = match.position;
+    auto secondSubWordMacthIndex = firstSubWordMatchIndex + 1;
+
+    if (match.rule == 8 && subWordsMatch.type == 3) {
+      //Kaf
+      appliedResult = applyKaf(lineTextInfo, justInfo, wordIndex, subWordIndex, firstSubWordMatchIndex, secondSubWordMacthIndex);
+    }
+    else {
+      // Kashidas
+      appliedResult = applyKashida(lineTextInfo, justInfo, wordIndex, subWordIndex, firstSubWordMatchIndex, secondSubWordMacthIndex);
+    }
+  }
+
+  return appliedResult;
+}
+
+/*
+  The widths of the word after each of its steps, shaping the word alone with an unlimited line width. The steps stop at
+  the first one which does not change the width of the word or which is forbidden : the following levels would try
+  the same features again.
+*/
+static StretchProfileCache::Profile getStretchProfile(const LineTextInfo& lineTextInfo,
+  hb_font_t* font,
+  int wordIndex,
+  const SimpleJustMatch& subWordsMatch,
+  int nbLevelAlt,
+  int nbLevelKashida)
+{
+  auto& wordInfo = lineTextInfo.wordInfos[wordIndex];
+
+  auto nbLevels = isSimpleJustAlternate(subWordsMatch) ? nbLevelAlt : nbLevelKashida;
+
+  StretchProfileCache::Profile profile;
+
+  auto session = ShapingSession::current();
+
+  if (session != nullptr && session->layout()->stretchProfiles.find(wordInfo.text, font, nbLevels, profile)) {
+    return profile;
+  }
+
+  auto width = getWidth(wordInfo.text, font, {});
+
+  JustInfo justInfo{ .fontFeatures = {},.desiredWidth = numeric_limits<double>::infinity(),.textLineWidth = 0,
+    .layoutResult = vector<LayoutResult>(lineTextInfo.wordInfos.size()), .font = font };
+
+  justInfo.layoutResult[wordIndex].parWidth = width;
+
+  profile.widths.push_back(width);
+  profile.features.push_back({});
+
+  for (int level = 1; level <= nbLevels; level++) {
+    if (applySimpleJustStep(lineTextInfo, justInfo, wordIndex, subWordsMatch, level, nbLevelAlt, nbLevelKashida) != AppliedResult::Positive) {
+      break;
+    }
+
+    vector<StretchProfileCache::Feature> features;
+    for (auto& charFeatures : justInfo.fontFeatures) {
+      for (auto& feat : charFeatures.second) {
+        features.push_back({ charFeatures.first - wordInfo.startIndex, feat.name, feat.value });
+      }
+    }
+
+    profile.widths.push_back(justInfo.layoutResult[wordIndex].parWidth);
+    profile.features.push_back(features);
+  }
+
+  if (session != nullptr) {
+    session->layout()->stretchProfiles.insert(wordInfo.text, font, nbLevels, profile);
+  }
+
+  return profile;
+}
+
+static vector<hb_feature_t> getLineFeatures(const LineTextInfo& lineTextInfo, const map<int, vector<TextFontFeatures>>& fontFeatures) {
+
+  vector< hb_feature_t> features{};
+
+  for (auto& wordInfo : lineTextInfo.wordInfos) {
+    for (int i = wordInfo.startIndex; i <= wordInfo.endIndex; i++) {
+
+      auto justInfo = fontFeatures.find(i);
+      if (justInfo != fontFeatures.end()) {
+
+        for (auto& feat : justInfo->second) {
+          features.push_back({
+            hb_tag_from_string(feat.name.toStdString().c_str(),feat.name.size()),
+            (uint32_t)feat.value,
+            (unsigned int)(i),
+            (unsigned int)(i + 1)
+            });
+        }
+      }
+
+    }
+  }
+
+  return features;
+}
+
+/*
+  The words are stretched level by level from the end of the line as long as the line does not overflow. The steps of
+  each word are taken from its stretch profile, so no word is shaped while the features are chosen, and the line is
+  shaped with the chosen features to replace the sum of the widths of its words by its actual width. The last chosen
+  steps are undone while the shaped line overflows.
+*/
+static boolean  applySimpleJust(const LineTextInfo& lineTextInfo,
+  JustInfo& justInfo,
+  bool firstWordIncluded,
+  bool wordByWord,
+  int nbLevelAlt,
+  int nbLevelKashida)
+{
+
+  auto& wordInfos = lineTextInfo.wordInfos;
+
+  auto firstWordIndex = firstWordIncluded ? 0 : 1;
+
+  auto matchresult = matchSimpleJust(lineTextInfo, firstWordIndex);
+
+  vector<StretchProfileCache::Profile> profiles(wordInfos.size());
+  vector<int> steps(wordInfos.size(), 0);
+  // The words in the order of their chosen steps
+  vector<int> chosenWords;
+
+  for (int wordIndex = firstWordIndex; wordIndex < wordInfos.size(); wordIndex++) {
+    if (matchresult[wordIndex].match.rule != 0) {
+      profiles[wordIndex] = getStretchProfile(lineTextInfo, justInfo.font, wordIndex, matchresult[wordIndex], nbLevelAlt, nbLevelKashida);
+    }
+  }
+
   auto stretchedWords = std::map<int, boolean>();
 
-  for (int level = 1; level <= max(nbLevelAlt, nbLevelKashida); level++) {
+  bool overflow = false;
+  auto textLineWidth = justInfo.textLineWidth;
+
+  for (int level = 1; level <= max(nbLevelAlt, nbLevelKashida) && !overflow; level++) {
     for (int wordIndex = wordInfos.size() - 1; wordIndex >= firstWordIndex; wordIndex--) {
       if (stretchedWords.find(wordIndex + 1) != stretchedWords.end()) continue;
 
-      AppliedResult appliedResult;
-
-      auto& wordInfo = wordInfos[wordIndex];
       auto& subWordsMatch = matchresult[wordIndex];
 
-      auto& match = subWordsMatch.match;
+      if (subWordsMatch.match.rule == 0) continue;
 
+      if (level > (isSimpleJustAlternate(subWordsMatch) ? nbLevelAlt : nbLevelKashida)) continue;
 
-      if (!match.hasMatch()) continue;
+      auto& widths = profiles[wordIndex].widths;
+      auto& step = steps[wordIndex];
 
-      auto subWordIndex = subWordsMatch.subWordIndex;
+      // The word cannot be stretched anymore
+      if (step + 1 >= widths.size()) continue;
 
-      auto matchIndex = match.lastCapturedIndex();
+      auto diff = widths[step + 1] - widths[step];
 
-      if (subWordsMatch.type == 1 || (subWordsMatch.type == 3 && (matchIndex == 1))) {
-        // Alternates
-        if (level <= nbLevelAlt) {
-          auto baseIndex = match.capturedStart(matchIndex);
-          auto indexInLine = wordInfo.startIndex + wordInfo.subwords[subWordIndex].baseIndexes[baseIndex];
-          appliedResult = applyAlternate(lineTextInfo, justInfo, wordIndex, indexInLine);
-        }
+      if (textLineWidth + diff >= justInfo.desiredWidth) {
+        overflow = true;
+        break;
       }
-      else if (level <= nbLevelKashida) {
-        auto firstSubWordMatchIndex = match.capturedStart(matchIndex);
-        auto secondSubWordMacthIndex = firstSubWordMatchIndex + 1;
 
-        if (matchIndex == 8 && subWordsMatch.type == 3) {
-          //Kaf
-          appliedResult = applyKaf(lineTextInfo, justInfo, wordIndex, subWordIndex, firstSubWordMatchIndex, secondSubWordMacthIndex);
-        }
-        else {
-          // Kashidas
-          appliedResult = applyKashida(lineTextInfo, justInfo, wordIndex, subWordIndex, firstSubWordMatchIndex, secondSubWordMacthIndex);
-        }
-      }
+      textLineWidth += diff;
+      step++;
+      chosenWords.push_back(wordIndex);
 
-      if (appliedResult == AppliedResult::Overflow) {
-        return true;
+      if (wordByWord) {
+        stretchedWords.insert({ wordIndex, true });
       }
-      else if (appliedResult == AppliedResult::Positive) {
-        if (wordByWord) {
-          stretchedWords.insert({ wordIndex, true });
-        }
+    }
+  }
+
+  // The part of the width of the line which is not in its glyph advances, measured once the line is shaped
+  double stretch = 0;
+  bool stretchMeasured = false;
+  auto initialFeatures = justInfo.fontFeatures;
+
+  // The sum of the widths of the words differs from the width of the line when the features of a word change the
+  // shaping of its neighbours
+  while (true) {
+    justInfo.fontFeatures = initialFeatures;
+
+    for (int wordIndex = firstWordIndex; wordIndex < wordInfos.size(); wordIndex++) {
+      auto step = steps[wordIndex];
+      if (step == 0) continue;
+
+      auto& profile = profiles[wordIndex];
+
+      for (auto& feat : profile.features[step]) {
+        justInfo.fontFeatures[wordInfos[wordIndex].startIndex + feat.index].push_back({ .name = feat.name, .value = feat.value });
       }
+
+      justInfo.layoutResult[wordIndex].parWidth = profile.widths[step];
+    }
+
+    if (justInfo.fontFeatures.empty()) {
+      // Nothing is stretched, even when every chosen step was undone
+      textLineWidth = justInfo.textLineWidth;
+      break;
+    }
+
+    if (!stretchMeasured) {
+      stretch = justInfo.textLineWidth - getWidth(lineTextInfo.lineText, justInfo.font, {});
+      stretchMeasured = true;
+    }
+
+    auto buffer = shape(lineTextInfo.lineText, justInfo.font, getLineFeatures(lineTextInfo, justInfo.fontFeatures));
+
+    unsigned int glyph_count;
+    hb_glyph_position_t* glyph_pos = hb_buffer_get_glyph_positions(buffer, &glyph_count);
+
+    textLineWidth = stretch;
+    for (int i = 0; i < glyph_count; i++) {
+      textLineWidth += glyph_pos[i].x_advance;
     }
+
+    ShapingSession::releaseBuffer(buffer);
+
+    if (textLineWidth < justInfo.desiredWidth || chosenWords.empty()) break;
+
+    auto wordIndex = chosenWords.back();
+    chosenWords.pop_back();
+    steps[wordIndex]--;
+    justInfo.layoutResult[wordIndex].parWidth = profiles[wordIndex].widths[steps[wordIndex]];
+    overflow = true;
   }
-  return false;
+
+  justInfo.textLineWidth = textLineWidth;
+
+  return overflow;
 }
 
 static void applyExperimentalJust(const LineTextInfo& lineTextInfo, JustInfo& justInfo) {
@@ -1093,11 +1208,16 @@ static JustResultByLine justifyLine(const LineTextInfo& lineTextInfo, hb_font_t*
     //shrink
     if (justStyle == JustStyle::SCLX) {
       float xScale = desiredWidth / currentLineWidth;
-      auto ff = layout->createFont(font->x_scale / 1000, false);
-      hb_font_set_variation(ff, HB_TAG('S', 'C', 'L', 'X'), xScale * 100);
-      auto newCurrentLineWidth = getWidth(lineText, ff, {});
-
-      hb_font_destroy(ff);
+      double newCurrentLineWidth;
+      if (auto session = ShapingSession::current()) {
+        newCurrentLineWidth = getWidth(lineText, session->font(font->x_scale / 1000, xScale * 100), {});
+      }
+      else {
+        auto ff = layout->createFont(font->x_scale / 1000, false);
+        hb_font_set_variation(ff, HB_TAG('S', 'C', 'L', 'X'), xScale * 100);
+        newCurrentLineWidth = getWidth(lineText, ff, {});
+        hb_font_destroy(ff);
+      }
       if (newCurrentLineWidth < currentLineWidth) {
         result.sclxAxis = xScale * 100;
         result.xScale = desiredWidth / newCurrentLineWidth;
@@ -1132,24 +1252,8 @@ static LineLayoutInfo shapeLine(OtLayout* layout, int lineWidth, int pageWidth,
       });
   }
 
-  for (auto& wordInfo : lineTextInfo.wordInfos) {
-    for (int i = wordInfo.startIndex; i <= wordInfo.endIndex; i++) {
-
-      auto justInfo = justResult.fontFeatures.find(i);
-      if (justInfo != justResult.fontFeatures.end()) {
-
-        for (auto& feat : justInfo->second) {
-          features.push_back({
-            hb_tag_from_string(feat.name.toStdString().c_str(),feat.name.size()),
-            (uint32_t)feat.value,
-            (unsigned int)(i),
-            (unsigned int)(i + 1)
-            });
-        }
-      }
-
-    }
-  }
+  auto lineFeatures = getLineFeatures(lineTextInfo, justResult.fontFeatures);
+  features.insert(features.end(), lineFeatures.begin(), lineFeatures.end());
 
   auto buffer = shape(lineTextInfo.lineText, font, features);
 
@@ -1212,7 +1316,7 @@ static LineLayoutInfo shapeLine(OtLayout* layout, int lineWidth, int pageWidth,
 
   currentyPos = currentyPos + (layout->InterLineSpacing << OtLayout::SCALEBY);
 
-  hb_buffer_destroy(buffer);
+  ShapingSession::releaseBuffer(buffer);
 
   return lineLayout;
 
@@ -1225,8 +1329,9 @@ QList<LineLayoutInfo> OtLayout::justifyPageUsingFeatures(double emScale, int pag
 
   QList<LineLayoutInfo> page;
 
-  hb_font_t* defaultShapefont = this->createFont(emScale, newFace);
-  hb_font_t* justifyFont = this->createFont(1, false);
+  ShapingSession session{ this, emScale, newFace };
+
+  hb_font_t* justifyFont = session.font(1);
 
   vector<LineTextInfo> linesTextInfo;
   vector<double> fontSizeRatios;
@@ -1265,9 +1370,22 @@ QList<LineLayoutInfo> OtLayout::justifyPageUsingFeatures(double emScale, int pag
 
   int currentyPos = TopSpace << OtLayout::SCALEBY;
 
+  // The lines of SameSizeByPage depend on the other lines of the page
+  bool cacheLines = justStyle != JustStyle::SameSizeByPage;
+
   for (auto lineIdx = 0; lineIdx < lines.size(); lineIdx++) {
     auto& line = lines[lineIdx];
 
+    auto key = LineLayoutCache::key(*this, line, pageWidth, emScale, tajweedColor, justStyle, cluster_level, justType);
+
+    LineLayoutInfo cachedLine;
+    if (cacheLines && lineLayouts->find(key, cachedLine)) {
+      cachedLine.ystartposition = currentyPos;
+      currentyPos = currentyPos + (InterLineSpacing << OtLayout::SCALEBY);
+      page.append(cachedLine);
+      continue;
+    }
+
     auto lineTextInfo = analyzeLineForJust(line.text);
 
     auto fontSizeLineWidthRatio = line.width != 0 ? (double)FONTSIZE * emScale / line.width : 1;
@@ -1283,28 +1401,23 @@ QList<LineLayoutInfo> OtLayout::justifyPageUsingFeatures(double emScale, int pag
       fontRatio = 1; // min(fontSizeRatios[lineIdx], defaultFontRatio);
     }
 
-    auto justResultByLine = justifyLine(lineTextInfo, justifyFont, fontSizeLineWidthRatio * fontRatio, spaceWidth, justType, justStyle, this);
-    hb_font_t* shapeFont = defaultShapefont;
+    auto storeKey = JustificationStore::key(lineTextInfo.lineText, FONTSIZE / (fontSizeLineWidthRatio * fontRatio), spaceWidth, (int)justType, (int)justStyle);
+
+    JustResultByLine justResultByLine;
+
+    bool stored = justifications->find(storeKey, *this, justResultByLine);
+
+    if (!stored) {
+      justResultByLine = justifyLine(lineTextInfo, justifyFont, fontSizeLineWidthRatio * fontRatio, spaceWidth, justType, justStyle, this);
+    }
     auto newEmScale = emScale;
-    auto newFont = false;
     if (fontRatio != 1) {
-      newFont = true;
       newEmScale = emScale * fontRatio;
-      shapeFont = this->createFont(newEmScale, false);
-    }
-    if (justResultByLine.sclxAxis != 0) {
-      if (!newFont) {
-        newFont = true;
-        shapeFont = this->createFont(emScale, false);
-      }
-      hb_font_set_variation(shapeFont, HB_TAG('S', 'C', 'L', 'X'), justResultByLine.sclxAxis);
     }
+    hb_font_t* shapeFont = session.font(newEmScale, justResultByLine.sclxAxis);
 
     auto lineLayoutInfo = shapeLine(this, line.width, pageWidth, lineTextInfo, justResultByLine, tajweedColor, newEmScale, shapeFont, line.lineJustification, currentyPos);
 
-    if (newFont) {
-      hb_font_destroy(shapeFont);
-    }
     if (justStyle == JustStyle::SCLX) {
       lineLayoutInfo.fontSize = lineLayoutInfo.fontSize * justResultByLine.xScale;
       lineLayoutInfo.xscale = 1;
@@ -1316,10 +1429,27 @@ QList<LineLayoutInfo> OtLayout::justifyPageUsingFeatures(double emScale, int pag
 
 
     page.append(lineLayoutInfo);
-  }
 
-  hb_font_destroy(defaultShapefont);
-  hb_font_destroy(justifyFont);
+    if (!stored) {
+      QVector<quint16> glyphCodes;
+      for (auto& glyph : lineLayoutInfo.glyphs) {
+        glyphCodes.append(glyph.codepoint);
+      }
+      // The glyphs of the unjustified line, from which the stretched forms tried by the justification are derived
+      auto buffer = shape(lineTextInfo.lineText, justifyFont, {});
+      unsigned int glyph_count;
+      hb_glyph_info_t* glyph_info = hb_buffer_get_glyph_infos(buffer, &glyph_count);
+      for (unsigned int i = 0; i < glyph_count; i++) {
+        glyphCodes.append(glyph_info[i].codepoint);
+      }
+      ShapingSession::releaseBuffer(buffer);
+      justifications->insert(storeKey, *this, justResultByLine, glyphCodes);
+    }
+
+    if (cacheLines) {
+      lineLayouts->insert(key, lineLayoutInfo);
+    }
+  }
 
   return page;
 
@@ -291,7 +291,6 @@ void ToOpenType::setGIds() {
   QMap<quint16, QString> glyphNamePerCode;
   QMap<quint16, quint16> unicodeToGlyphCode;
   QMap<quint16, OtLayout::GDEFClasses> glyphGlobalClasses;
-  std::unordered_map<int, std::unordered_map<GlyphParameters, GlyphVis*>> tempGlyphs;
   std::unordered_map<int, std::unordered_map<GlyphParameters, GlyphVis*>> addedGlyphs;
   std::unordered_map<int, std::unordered_map<GlyphParameters, GlyphVis*>> substEquivGlyphs;
 
@@ -359,14 +358,11 @@ void ToOpenType::setGIds() {
   }
 
 
-  for (std::pair<int, std::unordered_map<GlyphParameters, GlyphVis*>> element : ot_layout->tempGlyphs)
-  {
-    if (!newCodes.contains(element.first)) {
-      throw new std::runtime_error(QString("Code %1 not found").arg(element.first).toStdString());
+  ot_layout->tempGlyphs.forEach([&newCodes](int glyphCode, const GlyphParameters&, GlyphVis*) {
+    if (!newCodes.contains(glyphCode)) {
+      throw new std::runtime_error(QString("Code %1 not found").arg(glyphCode).toStdString());
     }
-
-    tempGlyphs.insert({ newCodes.value(element.first), element.second });
-  }
+    });
 
   for (std::pair<int, std::unordered_map<GlyphParameters, GlyphVis*>> element : ot_layout->addedGlyphs)
   {
@@ -416,7 +412,7 @@ void ToOpenType::setGIds() {
   ot_layout->glyphCodePerName = glyphCodePerName;
   ot_layout->glyphNamePerCode = glyphNamePerCode;
   ot_layout->unicodeToGlyphCode = unicodeToGlyphCode;
-  ot_layout->tempGlyphs = tempGlyphs;
+  ot_layout->tempGlyphs.remapGlyphCodes([&newCodes](int glyphCode) { return newCodes.value(glyphCode); });
   ot_layout->addedGlyphs = addedGlyphs;
   ot_layout->substEquivGlyphs = substEquivGlyphs;
 
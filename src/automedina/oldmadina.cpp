@@ -149,7 +149,7 @@ void OldMadina::addchars() {
   for (int ayaNumber = 1; ayaNumber <= 286; ayaNumber++) {
     QString setcolored = ""; // QString("coloredglyph:=\"%1.colored%2\"").arg(ayaName).arg(ayaNumber);
     QString data = QString("beginchar(%1%2,-1,-1,2,-1);\n%%beginbody\ngenAyaNumber(%1, %2);%3;endchar;").arg(ayaName).arg(ayaNumber).arg(setcolored);    
-    m_layout->font->executeMetaPost(data);
+    m_layout->font->executeMetaPost(data, QString("%1%2").arg(ayaName).arg(ayaNumber));
     /*
     data = QString("beginchar(%1.colored%2,-1,-1,5,-1);\n%%beginbody\ngenAyaNumber(%1.colored, %2);endchar;").arg(ayaName).arg(ayaNumber);
     m_layout->font->executeMetaPost(data);*/
@@ -57,6 +57,8 @@ void GlyphScene::setGlyph(Glyph* glyph)
 
   this->m_glyph = glyph;
 
+  glyph->ensureParsed();
+
   if (contour) {
     delete contour;
   }
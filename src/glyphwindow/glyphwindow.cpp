@@ -31,6 +31,7 @@ GlyphWindow::GlyphWindow(Glyph* glyph)
 
   undoStack = glyph->undoStack();
   //glyph->setSource(glyph->source()); 
+  glyph->ensureParsed();
 
   this->glyph = glyph;
 
@@ -297,7 +298,7 @@ void GlyphWindow::createActions()
 void GlyphWindow::showAnchors(bool checked) {
   QString command = QString("showAnchors:=%1;").arg(checked ? 1 : 0);
 
-  glyph->font->executeMetaPost(command);
+  glyph->font->executeMetaPost(command, "showAnchors");
 
   glyph->setWidth(glyph->width());
 
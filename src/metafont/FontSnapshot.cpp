@@ -0,0 +1,554 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#include "FontSnapshot.h"
+#include "qfile.h"
+#include "qsavefile.h"
+#include "qdatastream.h"
+#include "qcryptographichash.h"
+#include "qregularexpression.h"
+#include "metafont.h"
+#include <cstring>
+
+static const char snapshotMagic[8] = { 'V','M','F','S','N','P','0','1' };
+static const int digestSize = 20;
+static const qint64 headerSize = sizeof(snapshotMagic) + digestSize;
+
+bool FontSnapshot::isRestorable(const QString& source) {
+  return source.startsWith("defchar") && !source.contains("savepicture") && !glyphName(source).isEmpty();
+}
+
+QString FontSnapshot::glyphName(const QString& source) {
+  // Only plain suffixes are accepted since the name is written in the restore command
+  static const QRegularExpression re("^(?:beginchar|defchar)\\s*\\(\\s*([A-Za-z_][A-Za-z_0-9.]*)\\s*,");
+
+  auto match = re.match(source);
+
+  return match.hasMatch() ? match.captured(1) : QString();
+}
+
+QByteArray FontSnapshot::digest(const QString& source) {
+  return QCryptographicHash::hash(source.toUtf8(), QCryptographicHash::Sha1);
+}
+
+QByteArray FontSnapshot::dependencyDigest(const QString& name, const QHash<QString, QString>& sources, QHash<QString, QByteArray>& digests) {
+
+  auto cached = digests.find(name);
+  if (cached != digests.end()) {
+    return cached.value();
+  }
+
+  // A cycle is an error for MetaPost anyway
+  digests.insert(name, QByteArray());
+
+  // makechardef defines name$ and name_ for each defchar glyph
+  static const QRegularExpression re("([A-Za-z_][A-Za-z_0-9.]*)(\\s*\\$)?");
+
+  QString source = sources.value(name);
+
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+
+  hash.addData(digest(source));
+
+  auto i = re.globalMatch(source);
+  while (i.hasNext()) {
+    auto match = i.next();
+    QString called = match.captured(1);
+    if (match.captured(2).isEmpty()) {
+      if (!called.endsWith('_')) continue;
+      called.chop(1);
+    }
+    if (called != name && sources.contains(called)) {
+      hash.addData(called.toUtf8());
+      hash.addData(dependencyDigest(called, sources, digests));
+    }
+  }
+
+  QByteArray ret = hash.result();
+
+  digests.insert(name, ret);
+
+  return ret;
+}
+
+bool FontSnapshot::open(QString fileName, QByteArray fingerprint, const QVector<GlyphSource>& glyphs, const QHash<QString, QString>& sources) {
+
+  this->fileName = fileName;
+  this->fingerprint = fingerprint.leftJustified(digestSize, '\0', true);
+  this->glyphs = glyphs;
+
+  digests.clear();
+  for (auto& glyph : glyphs) {
+    dependencyDigest(glyph.name, sources, digests);
+  }
+
+  records.clear();
+  restored.clear();
+  data.clear();
+  valid = false;
+
+  QFile file(fileName);
+
+  if (!file.open(QIODevice::ReadOnly)) {
+    return false;
+  }
+
+  data = file.readAll();
+
+  if (data.size() < headerSize || memcmp(data.constData(), snapshotMagic, sizeof(snapshotMagic)) != 0
+    || data.mid(sizeof(snapshotMagic), digestSize) != this->fingerprint) {
+    // New file or font sources changed : every glyph is drawn
+    data.clear();
+    return false;
+  }
+
+  QDataStream in(data);
+
+  in.skipRawData(headerSize);
+
+  qint32 count;
+
+  in >> count;
+
+  for (int i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+    QString name;
+    Record record;
+
+    in >> name >> record.digest >> record.size;
+
+    record.offset = in.device()->pos();
+
+    if (in.skipRawData(record.size) != (int)record.size) break;
+
+    records.insert(name, record);
+  }
+
+  valid = true;
+
+  for (int i = 0; i < glyphs.size(); i++) {
+    auto record = records.find(glyphs[i].name);
+    if (record != records.end() && record->digest == digests.value(glyphs[i].name)) {
+      restored.append(i);
+    }
+  }
+
+  return true;
+}
+
+QByteArray FontSnapshot::restoreCommand() const {
+
+  if (restored.isEmpty()) return {};
+
+  QByteArray command = "restoringsnapshot:=1;";
+
+  for (int index : restored) {
+    command += "restoredglyph." + glyphs[index].name.toLatin1() + ":=1;";
+  }
+
+  return command;
+}
+
+QByteArray FontSnapshot::endRestoreCommand() const {
+
+  if (restored.isEmpty()) return {};
+
+  return "numeric restoringsnapshot;";
+}
+
+bool FontSnapshot::glyphCode(MP mp, const QString& name, int& code) {
+
+  // makechardef gives the glyph variable the charcode of the glyph, the same way beginchar does
+  double value;
+
+  QByteArray varName = name.toLatin1();
+
+  if (!getMPNumVariable(mp, varName.constData(), &value)) {
+    return false;
+  }
+
+  code = (int)value;
+
+  return true;
+}
+
+void FontSnapshot::restore(MP mp) {
+
+  if (restored.isEmpty()) return;
+
+  QByteArray command = endRestoreCommand();
+
+  QVector<int> failed;
+
+  for (int index : restored) {
+    auto& glyph = glyphs[index];
+    auto& record = records[glyph.name];
+
+    int code;
+    mp_edge_object* edge = nullptr;
+
+    if (glyphCode(mp, glyph.name, code)) {
+      edge = deserialize(mp, data.constData() + record.offset, record.size);
+    }
+
+    if (edge == nullptr) {
+      failed.append(index);
+      command += glyph.source.toLocal8Bit() + "\n";
+      continue;
+    }
+
+    edge->charcode = code;
+
+    mp_add_edge(mp, edge);
+  }
+
+  // The glyphs which could not be restored are drawn now that the restore mode is ended
+  mp_execute(mp, command.data(), command.size());
+
+  for (int index : failed) {
+    restored.removeOne(index);
+  }
+
+  data.clear();
+}
+
+bool FontSnapshot::save(MP mp) {
+
+  if (valid && restored.size() == glyphs.size()) return true;
+
+  QByteArray body;
+  QDataStream out(&body, QIODevice::WriteOnly);
+
+  qint32 count = 0;
+
+  for (auto& glyph : glyphs) {
+    int code;
+    if (!glyphCode(mp, glyph.name, code)) continue;
+
+    mp_edge_object* edge = mp_find_edge(mp, code);
+
+    QByteArray payload;
+
+    if (edge == nullptr || !serialize(edge, payload)) continue;
+
+    out << glyph.name << digests.value(glyph.name) << (quint32)payload.size();
+    out.writeRawData(payload.constData(), payload.size());
+
+    count++;
+  }
+
+  QSaveFile file(fileName);
+
+  if (!file.open(QIODevice::WriteOnly)) {
+    return false;
+  }
+
+  QByteArray header;
+  QDataStream headerOut(&header, QIODevice::WriteOnly);
+
+  headerOut.writeRawData(snapshotMagic, sizeof(snapshotMagic));
+  headerOut.writeRawData(fingerprint.constData(), digestSize);
+  headerOut << count;
+
+  file.write(header);
+  file.write(body);
+
+  return file.commit();
+}
+
+static void writeString(QDataStream& out, const char* value) {
+  // a null QByteArray is read back as null
+  out << (value != nullptr ? QByteArray(value) : QByteArray());
+}
+
+static char* readString(MP mp, QDataStream& in) {
+  QByteArray value;
+  in >> value;
+  if (value.isNull()) return nullptr;
+  char* ret = (char*)mp_xmalloc(mp, value.size() + 1, 1);
+  memcpy(ret, value.constData(), value.size() + 1);
+  return ret;
+}
+
+static void writeKnots(QDataStream& out, mp_gr_knot path) {
+
+  qint32 nbKnots = 0;
+
+  if (path) {
+    auto p = path;
+    do {
+      nbKnots++;
+      p = p->next;
+    } while (p != path);
+  }
+
+  out << nbKnots;
+
+  if (path) {
+    auto p = path;
+    do {
+      out << p->x_coord << p->y_coord << p->left_x << p->left_y << p->right_x << p->right_y;
+      out << (quint16)p->data.types.left_type << (quint16)p->data.types.right_type << (quint8)p->originator;
+      p = p->next;
+    } while (p != path);
+  }
+}
+
+static mp_gr_knot readKnots(MP mp, QDataStream& in) {
+
+  qint32 nbKnots;
+
+  in >> nbKnots;
+
+  mp_gr_knot first = nullptr;
+  mp_gr_knot current = nullptr;
+
+  for (int k = 0; k < nbKnots && in.status() == QDataStream::Ok; k++) {
+    mp_gr_knot knot = (mp_gr_knot)mp_xmalloc(mp, 1, sizeof(struct mp_gr_knot_data));
+    memset(knot, 0, sizeof(struct mp_gr_knot_data));
+
+    quint16 left_type, right_type;
+    quint8 originator;
+
+    in >> knot->x_coord >> knot->y_coord >> knot->left_x >> knot->left_y >> knot->right_x >> knot->right_y;
+    in >> left_type >> right_type >> originator;
+
+    knot->data.types.left_type = left_type;
+    knot->data.types.right_type = right_type;
+    knot->originator = originator;
+
+    if (current == nullptr) {
+      first = knot;
+    }
+    else {
+      current->next = knot;
+    }
+    current = knot;
+  }
+
+  if (current != nullptr) {
+    current->next = first;
+  }
+
+  return first;
+}
+
+bool FontSnapshot::serialize(mp_edge_object* edge, QByteArray& payload) {
+
+  QDataStream out(&payload, QIODevice::WriteOnly);
+
+  out.setFloatingPointPrecision(QDataStream::DoublePrecision);
+
+  writeString(out, edge->charname);
+  writeString(out, edge->originalglyph);
+  writeString(out, edge->coloredglyph);
+  out << (qint32)edge->glyphtype;
+  out << edge->minx << edge->miny << edge->maxx << edge->maxy;
+  out << edge->width << edge->height << edge->depth << edge->ital_corr;
+  out << edge->lefttatweel << edge->charlt << edge->charrt;
+  out << edge->xleftanchor << edge->yleftanchor << edge->xrightanchor << edge->yrightanchor;
+  out << edge->xpart << edge->ypart;
+
+  out << (qint32)edge->numAnchors;
+  for (int i = 0; i < edge->numAnchors; i++) {
+    auto& anchor = edge->anchors[i];
+    writeString(out, anchor.anchorName);
+    out << (qint32)anchor.type << (qint32)anchor.x << (qint32)anchor.y;
+  }
+
+  qint32 nbObjects = 0;
+  for (auto body = edge->body; body; body = body->next) {
+    nbObjects++;
+  }
+
+  out << nbObjects;
+
+  for (auto body = edge->body; body; body = body->next) {
+
+    out << (qint32)body->type;
+
+    switch (body->type) {
+    case mp_fill_code: {
+      auto object = (mp_fill_object*)body;
+      writeString(out, object->pre_script);
+      writeString(out, object->post_script);
+      out << (quint8)object->color_model << object->color.a_val << object->color.b_val << object->color.c_val << object->color.d_val;
+      out << (quint8)object->ljoin << object->miterlim;
+      writeKnots(out, object->path_p);
+      writeKnots(out, object->htap_p);
+      writeKnots(out, object->pen_p);
+      break;
+    }
+    case mp_stroked_code: {
+      auto object = (mp_stroked_object*)body;
+      // dashed strokes are not used by the fonts, the glyph is then drawn by MetaPost
+      if (object->dash_p != nullptr) return false;
+      writeString(out, object->pre_script);
+      writeString(out, object->post_script);
+      out << (quint8)object->color_model << object->color.a_val << object->color.b_val << object->color.c_val << object->color.d_val;
+      out << (quint8)object->ljoin << (quint8)object->lcap << object->miterlim;
+      writeKnots(out, object->path_p);
+      writeKnots(out, object->pen_p);
+      break;
+    }
+    case mp_start_clip_code:
+      writeKnots(out, ((mp_clip_object*)body)->path_p);
+      break;
+    case mp_start_bounds_code:
+      writeKnots(out, ((mp_bounds_object*)body)->path_p);
+      break;
+    case mp_stop_clip_code:
+    case mp_stop_bounds_code:
+      break;
+    case mp_special_code:
+      writeString(out, ((mp_special_object*)body)->pre_script);
+      break;
+    default:
+      return false;
+    }
+  }
+
+  return out.status() == QDataStream::Ok;
+}
+
+mp_edge_object* FontSnapshot::deserialize(MP mp, const char* data, quint32 size) {
+
+  QByteArray payload = QByteArray::fromRawData(data, size);
+  QDataStream in(payload);
+
+  in.setFloatingPointPrecision(QDataStream::DoublePrecision);
+
+  mp_edge_object* edge = (mp_edge_object*)mp_xmalloc(mp, 1, sizeof(mp_edge_object));
+  memset(edge, 0, sizeof(mp_edge_object));
+
+  edge->parent = mp;
+
+  QByteArray charname, originalglyph, coloredglyph;
+  qint32 glyphtype, numAnchors, nbObjects;
+
+  in >> charname >> originalglyph >> coloredglyph;
+  in >> glyphtype;
+  in >> edge->minx >> edge->miny >> edge->maxx >> edge->maxy;
+  in >> edge->width >> edge->height >> edge->depth >> edge->ital_corr;
+  in >> edge->lefttatweel >> edge->charlt >> edge->charrt;
+  in >> edge->xleftanchor >> edge->yleftanchor >> edge->xrightanchor >> edge->yrightanchor;
+  in >> edge->xpart >> edge->ypart;
+
+  edge->glyphtype = glyphtype;
+
+  in >> numAnchors;
+
+  if (numAnchors < 0 || numAnchors > (qint32)(sizeof(edge->anchors) / sizeof(edge->anchors[0]))) {
+    mp_xfree(edge);
+    return nullptr;
+  }
+
+  edge->numAnchors = numAnchors;
+  for (int i = 0; i < numAnchors; i++) {
+    qint32 type, x, y;
+    edge->anchors[i].anchorName = readString(mp, in);
+    in >> type >> x >> y;
+    edge->anchors[i].type = type;
+    edge->anchors[i].x = x;
+    edge->anchors[i].y = y;
+  }
+
+  in >> nbObjects;
+
+  mp_graphic_object* last = nullptr;
+
+  for (int i = 0; i < nbObjects && in.status() == QDataStream::Ok; i++) {
+
+    qint32 type;
+
+    in >> type;
+
+    mp_graphic_object* object = mp_new_graphic_object(mp, type);
+
+    switch (type) {
+    case mp_fill_code: {
+      auto fill = (mp_fill_object*)object;
+      quint8 color_model, ljoin;
+      fill->pre_script = readString(mp, in);
+      fill->post_script = readString(mp, in);
+      in >> color_model >> fill->color.a_val >> fill->color.b_val >> fill->color.c_val >> fill->color.d_val;
+      in >> ljoin >> fill->miterlim;
+      fill->color_model = color_model;
+      fill->ljoin = ljoin;
+      fill->path_p = readKnots(mp, in);
+      fill->htap_p = readKnots(mp, in);
+      fill->pen_p = readKnots(mp, in);
+      break;
+    }
+    case mp_stroked_code: {
+      auto stroked = (mp_stroked_object*)object;
+      quint8 color_model, ljoin, lcap;
+      stroked->pre_script = readString(mp, in);
+      stroked->post_script = readString(mp, in);
+      in >> color_model >> stroked->color.a_val >> stroked->color.b_val >> stroked->color.c_val >> stroked->color.d_val;
+      in >> ljoin >> lcap >> stroked->miterlim;
+      stroked->color_model = color_model;
+      stroked->ljoin = ljoin;
+      stroked->lcap = lcap;
+      stroked->path_p = readKnots(mp, in);
+      stroked->pen_p = readKnots(mp, in);
+      break;
+    }
+    case mp_start_clip_code:
+      ((mp_clip_object*)object)->path_p = readKnots(mp, in);
+      break;
+    case mp_start_bounds_code:
+      ((mp_bounds_object*)object)->path_p = readKnots(mp, in);
+      break;
+    case mp_stop_clip_code:
+    case mp_stop_bounds_code:
+      break;
+    case mp_special_code:
+      ((mp_special_object*)object)->pre_script = readString(mp, in);
+      break;
+    default:
+      in.setStatus(QDataStream::ReadCorruptData);
+      break;
+    }
+
+    if (last == nullptr) {
+      edge->body = object;
+    }
+    else {
+      last->next = object;
+    }
+    last = object;
+  }
+
+  if (in.status() != QDataStream::Ok) {
+    mp_gr_toss_objects_extended(edge);
+    return nullptr;
+  }
+
+  // The strings of a shipped out edge belong to MetaPost and are not freed with it
+  strings.append(charname);
+  edge->charname = strings.last().data();
+  strings.append(originalglyph);
+  edge->originalglyph = strings.last().data();
+  if (!coloredglyph.isEmpty()) {
+    strings.append(coloredglyph);
+    edge->coloredglyph = strings.last().data();
+  }
+
+  return edge;
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <QHash>
+#include <QVector>
+#include <QList>
+
+typedef struct MP_instance* MP;
+struct mp_edge_object;
+
+/*
+  Snapshot of the glyph edges computed by the font job.
+
+  mplib cannot dump the state of an instance, so the job still runs at load time but the glyphs defined with defchar whose
+  source did not change since the snapshot was written are not drawn again : restoreCommand marks them for
+  makechardef (see vmf.mp) and restore adds their saved edges to the instance once the job has run.
+  Changed, new and unrestorable glyphs are drawn by MetaPost as usual and save rewrites the snapshot.
+  A glyph is also changed when a glyph whose name$ or name_ macros it calls, directly or not, is changed.
+  The snapshot is invalidated as a whole when the fingerprint of everything else the job reads changes.
+  Restored edges reference strings owned by the snapshot, it must outlive the instance.
+*/
+class FontSnapshot {
+public:
+
+  struct GlyphSource {
+    QString name;
+    QString source;
+  };
+
+  // Glyphs which can be restored : defchar glyphs which do not save a picture used by other glyphs
+  static bool isRestorable(const QString& source);
+  static QString glyphName(const QString& source);
+  static QByteArray digest(const QString& source);
+  // Digest of the source of the glyph and of the glyphs whose macros it calls, digests caches the computed ones
+  static QByteArray dependencyDigest(const QString& name, const QHash<QString, QString>& sources, QHash<QString, QByteArray>& digests);
+
+  // sources gives the source of every glyph of the font by name, to follow the macros called by the glyphs
+  bool open(QString fileName, QByteArray fingerprint, const QVector<GlyphSource>& glyphs, const QHash<QString, QString>& sources);
+
+  // MetaPost code to execute before the font job, empty when nothing can be restored
+  QByteArray restoreCommand() const;
+  // Executed after the font job so that the glyphs are drawn again when their source is executed
+  QByteArray endRestoreCommand() const;
+
+  void restore(MP mp);
+  bool save(MP mp);
+
+  int restoredCount() const { return restored.size(); }
+
+private:
+
+  friend class FontSnapshotTest;
+
+  struct Record {
+    QByteArray digest;
+    qint64 offset;
+    quint32 size;
+  };
+
+  static bool serialize(mp_edge_object* edge, QByteArray& payload);
+  mp_edge_object* deserialize(MP mp, const char* data, quint32 size);
+  bool glyphCode(MP mp, const QString& name, int& code);
+
+  QString fileName;
+  QByteArray fingerprint;
+  QByteArray data;
+  bool valid = false;
+
+  QVector<GlyphSource> glyphs;
+  // Digests of the glyphs and of the glyphs they depend on
+  QHash<QString, QByteArray> digests;
+  QHash<QString, Record> records;
+  QVector<int> restored;
+
+  // charname, originalglyph and coloredglyph of the restored edges
+  QList<QByteArray> strings;
+};
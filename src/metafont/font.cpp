@@ -28,6 +28,9 @@
 #include "qregularexpression.h"
 #include "qapplication.h"
 #include "qfileinfo.h"
+#include "qcryptographichash.h"
+#include "OutlineArena.h"
+#include "FontSnapshot.h"
 
 #include "hb.hh"
 #include "metafont.h"
@@ -47,26 +50,22 @@ bool Font::loadFile(const QString& fileName) {
     return false;
   }
 
+  clearMetaPostPool();
+
+  replayCommands.clear();
+  replayIndexes.clear();
+  executedSources.clear();
+  sourceDigests.clear();
+
   if (mp != nullptr) {
     mp_finish(mp);
   }
 
+  // The restored edges of the previous instance reference strings of its snapshot
+  delete snapshot;
+  snapshot = new FontSnapshot();
 
-
-  MP_options* _mp_options = mp_options();
-  //MP_options _mp_options;
-  _mp_options->noninteractive = 1;
-  _mp_options->command_line = NULL;
-  _mp_options->ini_version = true;
-  _mp_options->math_mode = mp_math_double_mode;
-  _mp_options->job_name = (char*)"VisualMetaFont";
-
-  //_mp_options->interaction = mp_nonstop_mode;
-  //_mp_options->mem_name = "plain";
-  //_mp_options->mem_name = "automedina";
-  //_mp_options -> main_memory = 1000000;
-
-  mp = mp_initialize(_mp_options);
+  mp = newInstance();
 
   if (!mp) exit(EXIT_FAILURE);
 
@@ -113,8 +112,58 @@ bool Font::loadFile(const QString& fileName) {
 
   std::filesystem::current_path(parentPath); //setting path
 
+  QString glyphsPath = QString::fromStdString(p1.parent_path().append("glyphs.mp").string());
+
+  QFile glyphsFile(glyphsPath);
+
+  if (!glyphsFile.open(QFile::ReadOnly | QFile::Text)) {
+    return false;
+  }
+
+  QTextStream in(&glyphsFile);
+
+  QString code = in.readAll();
+
+  QStringList glyphSources;
+  QHash<QString, QString> namedSources;
+  QVector<FontSnapshot::GlyphSource> restorableGlyphs;
+  // glyphs.mp without the sources of the restorable glyphs, which are compared one by one by the snapshot
+  QString snapshotCode;
+  int lastEnd = 0;
+
+  QRegularExpression re("((?:beginchar|defchar)(.*?)(?:enddefchar|endchar);)", QRegularExpression::DotMatchesEverythingOption);
+  QRegularExpressionMatchIterator i = re.globalMatch(code);
+  while (i.hasNext()) {
+    QRegularExpressionMatch match = i.next();
+    QString source = match.captured(1);
+    glyphSources.append(source);
+    auto name = FontSnapshot::glyphName(source);
+    if (!name.isEmpty()) {
+      namedSources.insert(name, source);
+    }
+    if (FontSnapshot::isRestorable(source)) {
+      restorableGlyphs.append({ name, source });
+      snapshotCode.append(code.midRef(lastEnd, match.capturedStart(1) - lastEnd));
+      snapshotCode.append(name);
+      lastEnd = match.capturedEnd(1);
+    }
+  }
+
+  snapshotCode.append(code.midRef(lastEnd));
+
   QByteArray command = initMF.toLocal8Bit();
 
+  m_initCommand = command;
+
+  QDir outputDir(m_currentDir + "/output");
+  if (outputDir.exists() || outputDir.mkpath(".")) {
+    snapshot->open(outputDir.filePath(QFileInfo(fileName).baseName() + ".snapshot"), snapshotFingerprint(snapshotCode), restorableGlyphs, namedSources);
+  }
+
+  executedSources = namedSources;
+
+  command.prepend(snapshot->restoreCommand());
+
   int status = mp_execute(mp, command.data(), command.size());
   if (status == mp_error_message_issued || status == mp_fatal_error_stop) {
     mp_run_data* results = mp_rundata(mp);
@@ -124,6 +173,10 @@ bool Font::loadFile(const QString& fileName) {
     throw "Could not initialize MetaPost library instance!\n" + ret;
   }
 
+  QApplication::setOverrideCursor(Qt::WaitCursor);
+
+  snapshot->restore(mp);
+
   if (mp->job_name != nullptr) {
     mp_xfree(mp->job_name);
   }
@@ -135,31 +188,18 @@ bool Font::loadFile(const QString& fileName) {
 
   mp->job_name = strdup(job_name.c_str());
 
-  m_fontName = mp->job_name;
-
-  QString glyphsPath = QString::fromStdString(p1.parent_path().append("glyphs.mp").string());
+  m_jobName = job_name;
 
-  QFile glyphsFile(glyphsPath);
-
-  if (!glyphsFile.open(QFile::ReadOnly | QFile::Text)) {
-    return false;
-  }
-
-  QTextStream in(&glyphsFile);
-  QApplication::setOverrideCursor(Qt::WaitCursor);
-
-  QString code = in.readAll();
+  m_fontName = mp->job_name;
 
-  QRegularExpression re("((?:beginchar|defchar)(.*?)(?:enddefchar|endchar);)", QRegularExpression::DotMatchesEverythingOption);
-  QRegularExpressionMatchIterator i = re.globalMatch(code);
-  while (i.hasNext()) {
-    QRegularExpressionMatch match = i.next();
-    QString source = match.captured(1);
+  for (auto& source : glyphSources) {
     Glyph* glyph = new Glyph(source, this);
     glyphs.append(glyph);
     //glyphperUnicode[glyph->unicode()] = glyph;
   }
 
+  snapshot->save(mp);
+
   QFileInfo fileInfo(fileName);
 
   m_path = fileInfo.absoluteFilePath();
@@ -172,6 +212,149 @@ bool Font::loadFile(const QString& fileName) {
 
   return true;
 }
+MP Font::newInstance() {
+
+  MP_options* _mp_options = mp_options();
+  //MP_options _mp_options;
+  _mp_options->noninteractive = 1;
+  _mp_options->command_line = NULL;
+  _mp_options->ini_version = true;
+  _mp_options->math_mode = mp_math_double_mode;
+  _mp_options->job_name = (char*)"VisualMetaFont";
+
+  //_mp_options->interaction = mp_nonstop_mode;
+  //_mp_options->mem_name = "plain";
+  //_mp_options->mem_name = "automedina";
+  //_mp_options -> main_memory = 1000000;
+
+  MP instance = mp_initialize(_mp_options);
+
+  free(_mp_options);
+
+  return instance;
+}
+bool Font::initMetaPostPool(int size) {
+
+  clearMetaPostPool();
+
+  if (mp == nullptr || m_initCommand.isEmpty()) {
+    return false;
+  }
+
+  // Only the last command of each replay key is kept for the new instances
+  QVector<ReplayCommand> commands;
+  replayIndexes.clear();
+  for (auto& replay : replayCommands) {
+    if (!replay.command.isEmpty()) {
+      if (!replay.key.isEmpty()) {
+        replayIndexes.insert(replay.key, commands.size());
+      }
+      commands.append(replay);
+    }
+  }
+  replayCommands = commands;
+
+  // The font job inputs its files relative to the font directory
+  auto currentPath = std::filesystem::current_path();
+  std::filesystem::current_path(m_currentDir.toStdString());
+
+  for (int i = 0; i < size; i++) {
+    MP instance = newInstance();
+    if (!instance) break;
+
+    // Pool instances only generate alternates, the glyphs restored by the main instance are not drawn
+    QByteArray command = snapshot->restoreCommand() + m_initCommand + snapshot->endRestoreCommand();
+
+    int status = mp_execute(instance, command.data(), command.size());
+    if (status == mp_error_message_issued || status == mp_fatal_error_stop) {
+      mp_finish(instance);
+      break;
+    }
+
+    if (instance->job_name != nullptr) {
+      mp_xfree(instance->job_name);
+    }
+    instance->job_name = strdup(m_jobName.c_str());
+
+    try {
+      for (auto& replay : replayCommands) {
+        executeMetaPost(instance, replay.command);
+      }
+    }
+    catch (QString err) {
+      mp_finish(instance);
+      break;
+    }
+
+    replayPositions.insert(instance, replayCommands.size());
+    poolInstances.append(instance);
+  }
+
+  std::filesystem::current_path(currentPath);
+
+  // Glyph::source regenerates the source lazily so it cannot be read concurrently
+  for (auto glyph : glyphs) {
+    poolSources.insert(glyph->name(), glyph->source());
+  }
+
+  freeInstances = poolInstances;
+
+  return !poolInstances.isEmpty();
+}
+void Font::clearMetaPostPool() {
+  std::lock_guard<std::mutex> guard(poolMutex);
+
+  for (auto instance : poolInstances) {
+    mp_finish(instance);
+  }
+
+  poolInstances.clear();
+  freeInstances.clear();
+  poolSources.clear();
+  replayPositions.clear();
+}
+int Font::metaPostPoolSize() {
+  std::lock_guard<std::mutex> guard(poolMutex);
+  return poolInstances.size();
+}
+MP Font::acquireInstance() {
+  std::unique_lock<std::mutex> lock(poolMutex);
+
+  if (poolInstances.isEmpty()) {
+    throw std::runtime_error("MetaPost pool is not initialized");
+  }
+
+  poolCondition.wait(lock, [this] { return !freeInstances.isEmpty(); });
+
+  MP instance = freeInstances.takeLast();
+
+  auto& position = replayPositions[instance];
+  QVector<ReplayCommand> commands = replayCommands.mid(position);
+  position = replayCommands.size();
+
+  lock.unlock();
+
+  try {
+    for (auto& replay : commands) {
+      if (!replay.command.isEmpty()) {
+        executeMetaPost(instance, replay.command);
+      }
+    }
+  }
+  catch (...) {
+    releaseInstance(instance);
+    throw;
+  }
+
+  return instance;
+}
+void Font::releaseInstance(MP instance) {
+  {
+    std::lock_guard<std::mutex> guard(poolMutex);
+    freeInstances.append(instance);
+  }
+  poolCondition.notify_one();
+}
 double Font::lineHeight() {
 
   double lineheight = getInternalNumericVariable("lineheight");
@@ -309,9 +492,11 @@ bool Font::saveFile() {
 }
 
 Font::~Font() {
+  clearMetaPostPool();
   if (mp != nullptr) {
     mp_finish(mp);
   }
+  delete snapshot;
 }
 
 QString Font::filePath() {
@@ -334,12 +519,45 @@ Glyph* Font::getGlyph(uint charcode) {
   return NULL;
 
 }
-QString Font::executeMetaPost(QString command) {
+QString Font::executeMetaPost(QString command, const QString& replayKey) {
+  auto ret = executeMetaPost(mp, command);
+  recordReplayCommand(command, replayKey);
+  return ret;
+}
+void Font::recordReplayCommand(const QString& command, const QString& replayKey) {
+  std::lock_guard<std::mutex> guard(poolMutex);
+
+  if (!replayKey.isEmpty()) {
+    auto previous = replayIndexes.find(replayKey);
+    if (previous != replayIndexes.end()) {
+      replayCommands[previous.value()].command.clear();
+    }
+    replayIndexes.insert(replayKey, replayCommands.size());
+
+    if (glyphperName.contains(replayKey)) {
+      auto source = glyphperName.value(replayKey)->source();
+
+      // The scaled alternates of an edited glyph are generated from its new source
+      if (poolSources.contains(replayKey)) {
+        poolSources.insert(replayKey, source);
+      }
+
+      // The digests of the glyphs calling its macros change too
+      if (executedSources.value(replayKey) != source) {
+        executedSources.insert(replayKey, source);
+        sourceDigests.clear();
+      }
+    }
+  }
+
+  replayCommands.append({ replayKey, command });
+}
+QString Font::executeMetaPost(MP instance, QString command) {
 
-  mp->history = mp_spotless;
+  instance->history = mp_spotless;
   QByteArray commandBytes = command.toLatin1();
-  int status = mp_execute(mp, (char*)commandBytes.constData(), commandBytes.size());
-  mp_run_data* results = mp_rundata(mp);
+  int status = mp_execute(instance, (char*)commandBytes.constData(), commandBytes.size());
+  mp_run_data* results = mp_rundata(instance);
   QString ret(results->term_out.data);
   ret.trimmed();
   if (status == mp_error_message_issued || status == mp_fatal_error_stop) {
@@ -351,29 +569,33 @@ QString Font::executeMetaPost(QString command) {
 
 }
 mp_edge_object* Font::getEdges() {
-  mp_run_data* _mp_results = mp_rundata(mp);
+  return getEdges(mp);
+};
+mp_edge_object* Font::getEdges(MP instance) {
+  mp_run_data* _mp_results = mp_rundata(instance);
   mp_edge_object* edges = _mp_results->edges;
   return edges;
 };
 
 mp_edge_object* Font::getEdge(int charCode) {
+  return getEdge(mp, charCode);
+}
+mp_edge_object* Font::getEdge(MP instance, int charCode) {
+  return mp_find_edge(instance, charCode);
+}
 
-  mp_edge_object* edge = nullptr;
+void Font::generateAlternate(QString macroname, GlyphParameters params, QString sourceCode) {
+  generateAlternate(mp, macroname, params, sourceCode);
+}
+void Font::generateAlternate(MP instance, QString macroname, GlyphParameters params, QString sourceCode) {
 
-  mp_edge_object* p = getEdges();
+  auto source = alternateSource(instance, macroname, params, sourceCode);
 
-  while (p) {
-    if (p->charcode == charCode) {
-      edge = p;
-      break;
-    }
-    p = p->next;
+  if (!source.isEmpty()) {
+    executeMetaPost(instance, source);
   }
-
-  return edge;
 }
-
-void Font::generateAlternate(QString macroname, GlyphParameters params, QString sourceCode) {
+QString Font::alternateSource(MP instance, QString macroname, GlyphParameters params, QString sourceCode) {
 
   QString metaParams = QString("save params;params0:=%1;params1:=%2;params3:=%3;params4:=%4;params5:=%5;params100:=%6;")
     .arg(params.lefttatweel)
@@ -384,41 +606,90 @@ void Font::generateAlternate(QString macroname, GlyphParameters params, QString
     .arg(params.scalex);
 
   if (!sourceCode.isEmpty()) {
-    auto source = metaParams + sourceCode;
-    executeMetaPost(source);
-    return;
+    return metaParams + sourceCode;
   }
 
   if (params.lefttatweel != 0 || params.righttatweel != 0) {
-
-    auto metapostString = QString("%1generateAlternate(%2$,params);").arg(metaParams).arg(macroname);
-
-    executeMetaPost(metapostString);
+    return QString("%1generateAlternate(%2$,params);").arg(metaParams).arg(macroname);
   }
   else if (params.scalex != 0) {
-    if (glyphperName.contains(macroname)) {
+    if (instance != mp && poolSources.contains(macroname)) {
+      return metaParams + poolSources.value(macroname);
+    }
+    else if (glyphperName.contains(macroname)) {
       auto glyph = glyphperName[macroname];
-      auto source = metaParams + glyph->source();
       /* auto beginChar = QString("%1(%2,%3").arg(glyph->beginMacroName()).arg(glyph->name()).arg(glyph->unicode());
 
       source.replace(beginChar, QString("%1%2(alternatechar,%3").arg(metaParams).arg(glyph->beginMacroName()).arg(OtLayout::AlternatelastCode));
       auto index = source.indexOf("\n");
       source.insert(index, QString("originalglyph := \"%1\";").arg(macroname));*/
-      
-      executeMetaPost(source);
 
+      return metaParams + glyph->source();
     }
     else {
       throw std::runtime_error("Error");
     }
   }
 
+  return QString();
+}
+QVector<mp_edge_object*> Font::generateAlternates(const QVector<AlternateRequest>& requests) {
+  return generateAlternates(mp, requests);
+}
+QVector<mp_edge_object*> Font::generateAlternates(MP instance, const QVector<AlternateRequest>& requests) {
+
+  QVector<mp_edge_object*> edges(requests.size(), nullptr);
+
+  if (requests.isEmpty()) return edges;
+
+  // Each alternate is generated in its own group with a distinct char code since a shipout replaces the edge having the same code
+  QString program;
+  QVector<bool> generated(requests.size(), false);
+
+  for (int i = 0; i < requests.size(); i++) {
+    auto& request = requests[i];
+    auto source = alternateSource(instance, request.macroname, request.params, request.sourceCode);
+    if (source.isEmpty()) continue;
+    generated[i] = true;
+    program.append(QString("begingroup save alternatecode;alternatecode:=%1;").arg(OtLayout::AlternatelastCode + i));
+    program.append(source);
+    program.append("\nendgroup;\n");
+  }
+
+  if (program.isEmpty()) return edges;
+
+  executeMetaPost(instance, program);
 
+  for (int i = 0; i < requests.size(); i++) {
+    if (generated[i]) {
+      edges[i] = getEdge(instance, OtLayout::AlternatelastCode + i);
+    }
+  }
+
+  return edges;
 }
-mp_graphic_object* Font::copyEdgeBody(mp_graphic_object* body) {
+mp_graphic_object* Font::copyEdgeBody(mp_graphic_object* body, OutlineArena* arena) {
   mp_graphic_object* result = nullptr;
 
-  auto copypath = [this](mp_gr_knot knot)
+  auto newknot = [this, arena]()
+    {
+      if (arena != nullptr) {
+        return (mp_gr_knot)arena->allocate(sizeof(struct mp_gr_knot_data));
+      }
+      return (mp_gr_knot)mp_xmalloc(mp, 1, sizeof(struct mp_gr_knot_data));
+    };
+
+  auto newfillobject = [this, arena]()
+    {
+      if (arena != nullptr) {
+        auto object = (mp_fill_object*)arena->allocate(sizeof(mp_fill_object));
+        object->type = mp_fill_code;
+        return object;
+      }
+      return (mp_fill_object*)mp_new_graphic_object(mp, mp_fill_code);
+    };
+
+  auto copypath = [&newknot](mp_gr_knot knot)
     {
       mp_gr_knot p, current, ret;
 
@@ -426,7 +697,7 @@ mp_graphic_object* Font::copyEdgeBody(mp_graphic_object* body) {
 
       if (knot == nullptr) return ret;
 
-      ret = (mp_gr_knot)mp_xmalloc(mp, 1, sizeof(struct mp_gr_knot_data)); //new mp_gr_knot_data();
+      ret = newknot(); //new mp_gr_knot_data();
 
       ret->x_coord = knot->x_coord;
       ret->y_coord = knot->y_coord;
@@ -443,7 +714,7 @@ mp_graphic_object* Font::copyEdgeBody(mp_graphic_object* body) {
       while (p != knot) {
 
 
-        mp_gr_knot tmp = (mp_gr_knot)mp_xmalloc(mp, 1, sizeof(struct mp_gr_knot_data)); // new mp_gr_knot_data();
+        mp_gr_knot tmp = newknot(); // new mp_gr_knot_data();
 
         tmp->left_x = p->left_x;
         tmp->left_y = p->left_y;
@@ -482,7 +753,7 @@ mp_graphic_object* Font::copyEdgeBody(mp_graphic_object* body) {
         mp_fill_object* fillobject = (mp_fill_object*)body;
         mp_gr_knot newpath = copypath(fillobject->path_p);
 
-        mp_fill_object* nextObject = (mp_fill_object*)mp_new_graphic_object(mp, mp_fill_code); // new mp_fill_object;
+        mp_fill_object* nextObject = newfillobject(); // new mp_fill_object;
         nextObject->type = mp_fill_code;
         nextObject->path_p = newpath;
         nextObject->next = nullptr;
@@ -513,7 +784,7 @@ mp_graphic_object* Font::copyEdgeBody(mp_graphic_object* body) {
         mp_stroked_object* fillobject = (mp_stroked_object*)body;
         mp_gr_knot newpath = copypath(fillobject->path_p);
 
-        mp_fill_object* nextObject = (mp_fill_object*)mp_new_graphic_object(mp, mp_fill_code); // new mp_fill_object;
+        mp_fill_object* nextObject = newfillobject(); // new mp_fill_object;
         nextObject->type = mp_fill_code;
         nextObject->path_p = newpath;
         nextObject->next = nullptr;
@@ -558,6 +829,58 @@ QString Font::getLog()
   return ret.trimmed();
 }
 
+QByteArray Font::sourceFingerprint()
+{
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+
+  hash.addData(m_initCommand);
+
+  QDir dir(m_currentDir);
+
+  for (auto& entry : dir.entryInfoList({ "*.mp" }, QDir::Files, QDir::Name)) {
+    QFile file(entry.absoluteFilePath());
+    if (file.open(QIODevice::ReadOnly)) {
+      hash.addData(entry.fileName().toUtf8());
+      hash.addData(file.readAll());
+    }
+  }
+
+  return hash.result();
+}
+
+QByteArray Font::glyphSourceDigest(const QString& name)
+{
+  std::lock_guard<std::mutex> guard(poolMutex);
+
+  if (!executedSources.contains(name)) {
+    return {};
+  }
+
+  return FontSnapshot::dependencyDigest(name, executedSources, sourceDigests);
+}
+
+QByteArray Font::snapshotFingerprint(const QString& glyphsCode)
+{
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+
+  hash.addData(m_initCommand);
+
+  QDir dir(m_currentDir);
+
+  for (auto& entry : dir.entryInfoList({ "*.mp" }, QDir::Files, QDir::Name)) {
+    if (entry.fileName() == "glyphs.mp") continue;
+    QFile file(entry.absoluteFilePath());
+    if (file.open(QIODevice::ReadOnly)) {
+      hash.addData(entry.fileName().toUtf8());
+      hash.addData(file.readAll());
+    }
+  }
+
+  hash.addData(glyphsCode.toUtf8());
+
+  return hash.result();
+}
+
 void Font::readAxes() {
 
   axes.clear();
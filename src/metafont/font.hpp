@@ -24,6 +24,8 @@
 #include <QVector>
 #include <QHash>
 #include "OtLayout.h"
+#include <mutex>
+#include <condition_variable>
 
 
 
@@ -31,6 +33,8 @@
 class OtLayout;
 class GlyphVis;
 class Glyph;
+class OutlineArena;
+class FontSnapshot;
 typedef struct MP_instance* MP;
 struct mp_edge_object;
 typedef struct mp_graphic_object mp_graphic_object;
@@ -60,12 +64,42 @@ public:
 	QString currentDir() {
 		return m_currentDir;
 	}
-	QString executeMetaPost(QString command);
+	// Executes the command on the main instance. It is replayed by the instances of the pool before their next use and by
+	// the instances created afterwards, which only replay the last command of a replay key.
+	QString executeMetaPost(QString command, const QString& replayKey = QString());
+	QString executeMetaPost(MP instance, QString command);
 	mp_edge_object* getEdges();
+	mp_edge_object* getEdges(MP instance);
 	mp_edge_object* getEdge(int charCode);
+	mp_edge_object* getEdge(MP instance, int charCode);
 	void generateAlternate(QString macroname, GlyphParameters params, QString sourceCode = "");
-	mp_graphic_object* copyEdgeBody(mp_graphic_object* source);
+	void generateAlternate(MP instance, QString macroname, GlyphParameters params, QString sourceCode = "");
+
+	struct AlternateRequest {
+		QString macroname;
+		GlyphParameters params;
+		QString sourceCode;
+	};
+	// Generates all the alternates in a single MetaPost execution. The edges are returned in the order of the requests,
+	// nullptr when nothing was generated, and are owned by the instance until its next execution.
+	QVector<mp_edge_object*> generateAlternates(const QVector<AlternateRequest>& requests);
+	QVector<mp_edge_object*> generateAlternates(MP instance, const QVector<AlternateRequest>& requests);
+
+	// Pool of independent MetaPost instances loaded with the same font job as mp.
+	// Each instance is used by one thread at a time through acquireInstance/releaseInstance.
+	// The commands executed on mp after the font job, such as the generated ayas and the edited glyphs, are replayed by
+	// each instance when it is acquired.
+	bool initMetaPostPool(int size);
+	void clearMetaPostPool();
+	int metaPostPoolSize();
+	MP acquireInstance();
+	void releaseInstance(MP instance);
+	// Copies are allocated from the arena when one is given and must not be freed with mp_gr_toss_object
+	mp_graphic_object* copyEdgeBody(mp_graphic_object* source, OutlineArena* arena = nullptr);
 	QString getLog();
+	QByteArray sourceFingerprint();
+	// Digest of the source of the glyph as executed by mp, with the glyphs whose macros it calls. Thread safe.
+	QByteArray glyphSourceDigest(const QString& name);
 	//TODO protected:
 	MP mp = nullptr;
 
@@ -77,8 +111,34 @@ public:
 
 private:
 	void readAxes();
+	MP newInstance();
+	QString alternateSource(MP instance, QString macroname, GlyphParameters params, QString sourceCode);
+	void recordReplayCommand(const QString& command, const QString& replayKey);
+	// Fingerprint of what the font job reads apart from the restorable glyphs (see FontSnapshot)
+	QByteArray snapshotFingerprint(const QString& glyphsCode);
+	FontSnapshot* snapshot = nullptr;
 	QString m_path;
 	QString m_fontName;
 	QString m_currentDir;
+	QByteArray m_initCommand;
+	std::string m_jobName;
+
+	QVector<MP> poolInstances;
+	QVector<MP> freeInstances;
+	QHash<QString, QString> poolSources;
+	// Commands executed on mp after the font job, a command replaced by a later one with the same key is empty
+	struct ReplayCommand {
+		QString key;
+		QString command;
+	};
+	QVector<ReplayCommand> replayCommands;
+	QHash<QString, int> replayIndexes;
+	// Number of the replay commands executed by each instance of the pool
+	QHash<MP, int> replayPositions;
+	// Sources of the glyphs loaded by the font job or edited since then, by name
+	QHash<QString, QString> executedSources;
+	QHash<QString, QByteArray> sourceDigests;
+	std::mutex poolMutex;
+	std::condition_variable poolCondition;
 };
 #endif // FONT_H
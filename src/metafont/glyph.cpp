@@ -25,6 +25,7 @@
 #include "qpainter.h"
 #include "GlyphParser/glyphdriver.h"
 #include "qcoreevent.h"
+#include "qregularexpression.h"
 #include  <cmath>
 
 #include "metafont.h"
@@ -82,18 +83,26 @@ Glyph::Glyph(QString code, Font* parent) : QObject((QObject*)parent) {
   this->font = parent;
   m_unicode = -1;
   m_charcode = -1;
-
-  this->setSource(code);
+  isParsed = false;
 
   m_undoStack = new QUndoStack(this);
 
   QVariant defaultValue = QVariant::fromValue(AxisType{ 0.0 });
 
+  isSetSource = true;
   for (auto axisName : this->axisNames) {
     QObject::setProperty(axisName.toLocal8Bit(), defaultValue);
   }
+  isSetSource = false;
 
-
+  // The source is only parsed when its structure is needed (see ensureParsed), the header gives what the font needs
+  if (parseHeader(code)) {
+    m_source = code;
+    isDirty = false;
+  }
+  else {
+    this->setSource(code);
+  }
 }
 
 Glyph::~Glyph() {
@@ -106,10 +115,48 @@ QString  Glyph::beginMacroName() {
   return m_beginmacroname;
 }
 
+bool Glyph::parseHeader(const QString& code) {
+
+  static const QString number = R"(\s*([-+]?(?:[0-9]*\.[0-9]+|[0-9]+))\s*)";
+  static const QRegularExpression re(R"(^\s*(beginchar|defchar)\s*\(\s*([a-zA-Z_][a-zA-Z.0-9/:_\[\]]*)\s*,)" + number + "," + number + "," + number + "," + number + R"(\)\s*;)");
+
+  auto match = re.match(code);
+
+  if (!match.hasMatch()) return false;
+
+  m_beginmacroname = match.captured(1);
+  m_name = match.captured(2);
+  m_unicode = (int)match.captured(3).toDouble();
+  m_charcode = m_unicode;
+  m_width = (int)match.captured(4).toDouble();
+  m_height = (int)match.captured(5).toDouble();
+  m_depth = (int)match.captured(6).toDouble();
+
+  font->glyphperName.insert(m_name, this);
+
+  return true;
+}
+
+void Glyph::ensureParsed() {
+  if (!isParsed) {
+    parseSource(m_source);
+  }
+}
+
 void Glyph::setSource(QString source, bool structureChanged) {
 
+  parseSource(source);
+
+  //auto gg = receivers(SIGNAL(valueChanged(QString)));
+
+  emit valueChanged("source", structureChanged);
+}
+
+void Glyph::parseSource(QString source) {
+
+  isParsed = true;
   isSetSource = true;
-  blockSignals(true);
+  bool wasBlocked = blockSignals(true);
   isDirty = true;
 
 
@@ -150,11 +197,7 @@ void Glyph::setSource(QString source, bool structureChanged) {
 
   isSetSource = false;
 
-  blockSignals(false);
-
-  //auto gg = receivers(SIGNAL(valueChanged(QString)));
-
-  emit valueChanged("source", structureChanged);
+  blockSignals(wasBlocked);
 }
 QString Glyph::source() {
 
@@ -346,6 +389,7 @@ QString Glyph::source() {
   return m_source;
 }
 void Glyph::setName(QString name) {
+  ensureParsed();
 
   if (name == m_name)
     return;
@@ -363,6 +407,7 @@ QString Glyph::name() const {
   return m_name;
 }
 void Glyph::setUnicode(int unicode) {
+  ensureParsed();
   if (unicode != m_unicode) {
     m_unicode = unicode;
     m_charcode = unicode;
@@ -385,27 +430,33 @@ int Glyph::charcode() {
 
 
 void Glyph::setWidth(double width) {
+  ensureParsed();
   m_width = width;
   isDirty = true;
   emit valueChanged("width");
 }
 double Glyph::width() const {
+  // Given by the header, parsed or not
   return m_width;
 }
 void Glyph::setHeight(double height) {
+  ensureParsed();
   m_height = height;
   isDirty = true;
   emit valueChanged("height");
 }
 double Glyph::height() const {
+  // Given by the header, parsed or not
   return m_height;
 }
 void Glyph::setDepth(double depth) {
+  ensureParsed();
   m_depth = depth;
   isDirty = true;
   emit valueChanged("depth");
 }
 double Glyph::depth() const {
+  // Given by the header, parsed or not
   return m_depth;
 }
 double Glyph::axis(QString name) {
@@ -414,6 +465,7 @@ double Glyph::axis(QString name) {
   return oldValue.value;
 }
 void Glyph::setImage(Glyph::ImageInfo image) {
+  ensureParsed();
   ImageInfo old = m_image;
   m_image = image;
   isDirty = true;
@@ -425,9 +477,11 @@ void Glyph::setImage(Glyph::ImageInfo image) {
   }
 }
 Glyph::ImageInfo Glyph::image() const {
+  const_cast<Glyph*>(this)->ensureParsed();
   return m_image;
 }
 void Glyph::setComponents(QHashGlyphComponentInfo components) {
+  ensureParsed();
 
   isDirty = true;
 
@@ -450,26 +504,32 @@ void Glyph::setComponents(QHashGlyphComponentInfo components) {
 
 }
 Glyph::QHashGlyphComponentInfo Glyph::components() const {
+  const_cast<Glyph*>(this)->ensureParsed();
   return m_components;
 }
 void Glyph::setBody(QString body, bool autoParam) {
+  ensureParsed();
 
   m_body = body;
   isDirty = true;
   emit valueChanged("body");
 }
 QString Glyph::body() const {
+  const_cast<Glyph*>(this)->ensureParsed();
   return m_body;
 }
 void Glyph::setVerbatim(QString verbatim) {
+  ensureParsed();
   m_verbatim = verbatim;
   isDirty = true;
   emit valueChanged("verbatim");
 }
 QString Glyph::verbatim()const {
+  const_cast<Glyph*>(this)->ensureParsed();
   return m_verbatim;
 }
 void Glyph::setComponent(QString name, double x, double y, double t1, double t2, double t3, double t4) {
+  ensureParsed();
   isDirty = true;
 
   ComponentInfo component;
@@ -499,6 +559,7 @@ void Glyph::setParameter(QString name, MFExpr* exp, bool isEquation, bool isInCo
   setParameter(name, exp, isEquation, isInControllePath, QString());
 }
 void Glyph::setParameter(QString name, MFExpr* exp, bool isEquation, bool isInControllePath, QString affects) {
+  ensureParsed();
   Param param = {};
 
   param.name = name;
@@ -560,7 +621,7 @@ mp_edge_object* Glyph::getEdge()
   QString data = paramsString % source();
 
   try {
-    font->executeMetaPost(data);
+    font->executeMetaPost(data, name());
   }
   catch (QString err) {
     return nullptr;
@@ -623,6 +684,7 @@ bool Glyph::event(QEvent* e) {
   if (e->type() == QEvent::DynamicPropertyChange) {
     QDynamicPropertyChangeEvent* pe = static_cast<QDynamicPropertyChangeEvent*>(e);
     if (!isSetSource) {
+      ensureParsed();
       isDirty = true;
       emit valueChanged(pe->propertyName());
     }
@@ -669,6 +731,7 @@ QPainterPath Glyph::getPathFromEdge(mp_edge_object* h) {
   return localpath;
 }
 bool Glyph::setProperty(const char* name, const QVariant& value, bool updateParam) {
+  ensureParsed();
   if (updateParam) {
     auto param = this->params.find(name);
     if (param != this->params.end()) {
@@ -261,6 +261,9 @@ public:
 	mp_edge_object* getEdge();
 	QUndoStack* undoStack() const;
 
+	// Parses the source if it was not yet, needed before accessing params, dependents, m_components and controlledPaths
+	void ensureParsed();
+
 
 	std::map<QString, Param> params;
 	QMap<QString, Param*> dependents;
@@ -303,6 +306,8 @@ private slots:
 private:
 
 	QPainterPath getPathFromEdge(mp_edge_object* h);
+	bool parseHeader(const QString& code);
+	void parseSource(QString source);
 	//QPainterPath mp_dump_solved_path(mp_gr_knot h);
 
 	QString m_source;
@@ -318,6 +323,7 @@ private:
 	mp_edge_object* edge;
 
 	bool isSetSource;
+	bool isParsed;
 	QUndoStack* m_undoStack;
 	QString m_beginmacroname;
 
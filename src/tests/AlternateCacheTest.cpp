@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#include <QtTest>
+
+#include "AlternateCache.h"
+#include "GlyphVis.h"
+
+/*
+  Least recently used order and statistics of the cache of the temporary alternates.
+*/
+class AlternateCacheTest : public QObject {
+  Q_OBJECT
+
+private slots:
+  void insert();
+  void trim();
+  void peek();
+  void noBudget();
+  void remapGlyphCodes();
+
+private:
+  static GlyphParameters parameters(double lefttatweel) {
+    return { .lefttatweel = lefttatweel };
+  }
+
+  static size_t glyphSize() {
+    GlyphVis glyph;
+    return AlternateCache::estimateSize(&glyph);
+  }
+};
+
+void AlternateCacheTest::insert() {
+  AlternateCache cache;
+
+  auto glyph = new GlyphVis();
+
+  auto inserted = cache.insert(10, parameters(1), glyph);
+
+  QCOMPARE(inserted.first, glyph);
+  QVERIFY(inserted.second);
+
+  QCOMPARE(cache.find(10, parameters(1)), glyph);
+  // 0.0 and -0.0 are the same parameters
+  QVERIFY(cache.contains(10, { .lefttatweel = 1, .righttatweel = -0.0 }));
+  QVERIFY(cache.find(10, parameters(2)) == nullptr);
+  QVERIFY(cache.find(11, parameters(1)) == nullptr);
+
+  // The cache keeps its glyph
+  GlyphVis other;
+  inserted = cache.insert(10, parameters(1), &other);
+
+  QCOMPARE(inserted.first, glyph);
+  QVERIFY(!inserted.second);
+
+  cache.insert(10, parameters(2), new GlyphVis(), true);
+
+  auto stats = cache.stats();
+
+  QCOMPARE(stats.hits, (uint64_t)1);
+  QCOMPARE(stats.misses, (uint64_t)1);
+  QCOMPARE(stats.prefetched, (uint64_t)1);
+  QCOMPARE(stats.entries, (size_t)2);
+  QCOMPARE(stats.bytes, 2 * glyphSize());
+}
+
+void AlternateCacheTest::trim() {
+  AlternateCache cache(3 * glyphSize());
+
+  for (int i = 1; i <= 3; i++) {
+    cache.insert(i, parameters(0), new GlyphVis());
+  }
+
+  QCOMPARE(cache.trim(), (size_t)0);
+
+  // The glyph 1 becomes the most recently used, the glyph 2 the least
+  QVERIFY(cache.find(1, parameters(0)) != nullptr);
+
+  // Eviction only happens on trim
+  cache.insert(4, parameters(0), new GlyphVis());
+  cache.insert(5, parameters(0), new GlyphVis());
+
+  QCOMPARE(cache.size(), (size_t)5);
+  QCOMPARE(cache.trim(), (size_t)2);
+  QCOMPARE(cache.size(), (size_t)3);
+  QCOMPARE(cache.bytes(), 3 * glyphSize());
+
+  QVERIFY(!cache.contains(2, parameters(0)));
+  QVERIFY(!cache.contains(3, parameters(0)));
+  QVERIFY(cache.contains(1, parameters(0)));
+  QVERIFY(cache.contains(4, parameters(0)));
+  QVERIFY(cache.contains(5, parameters(0)));
+
+  QCOMPARE(cache.stats().evictions, (uint64_t)2);
+
+  cache.resetStats();
+
+  QCOMPARE(cache.stats().evictions, (uint64_t)0);
+  QCOMPARE(cache.stats().entries, (size_t)3);
+}
+
+void AlternateCacheTest::peek() {
+  AlternateCache cache(2 * glyphSize());
+
+  auto glyph = new GlyphVis();
+
+  cache.insert(1, parameters(0), glyph);
+  cache.insert(2, parameters(0), new GlyphVis());
+
+  // peek neither promotes the glyph nor counts a hit
+  QCOMPARE(cache.peek(1, parameters(0)), glyph);
+  QVERIFY(cache.peek(3, parameters(0)) == nullptr);
+  QCOMPARE(cache.stats().hits, (uint64_t)0);
+
+  cache.insert(3, parameters(0), new GlyphVis());
+  cache.trim();
+
+  QVERIFY(cache.peek(1, parameters(0)) == nullptr);
+  QVERIFY(cache.peek(2, parameters(0)) != nullptr);
+}
+
+void AlternateCacheTest::noBudget() {
+  AlternateCache cache;
+
+  for (int i = 0; i < 100; i++) {
+    cache.insert(i, parameters(0), new GlyphVis());
+  }
+
+  QCOMPARE(cache.trim(), (size_t)0);
+  QCOMPARE(cache.size(), (size_t)100);
+
+  cache.clear();
+
+  QCOMPARE(cache.size(), (size_t)0);
+  QCOMPARE(cache.bytes(), (size_t)0);
+}
+
+void AlternateCacheTest::remapGlyphCodes() {
+  AlternateCache cache;
+
+  auto glyph1 = new GlyphVis();
+  auto glyph2 = new GlyphVis();
+
+  cache.insert(1, parameters(0), glyph1);
+  cache.insert(2, parameters(0), glyph2);
+
+  cache.remapGlyphCodes([](int code) { return code + 100; });
+
+  QVERIFY(!cache.contains(1, parameters(0)));
+  QCOMPARE(cache.peek(101, parameters(0)), glyph1);
+  QCOMPARE(cache.peek(102, parameters(0)), glyph2);
+
+  // The order is kept : glyph2 is the most recently used
+  QVector<int> codes;
+  cache.forEach([&](int glyphCode, const GlyphParameters&, GlyphVis*) { codes.append(glyphCode); });
+
+  QCOMPARE(codes, QVector<int>({ 102, 101 }));
+}
+
+QTEST_APPLESS_MAIN(AlternateCacheTest)
+
+#include "AlternateCacheTest.moc"
@@ -0,0 +1,343 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QCryptographicHash>
+
+#include "AlternateStore.h"
+#include "metafont.h"
+
+/*
+  Round trip of the alternates through the alternate store : an alternate inserted in the store is rebuilt from its
+  record by the next runs.
+*/
+class AlternateStoreTest : public QObject {
+  Q_OBJECT
+
+private slots:
+  void initTestCase();
+  void cleanupTestCase();
+  void key();
+  void insert();
+  void reopen();
+  void fingerprintChanged();
+  void interruptedRecord();
+  void lockedFile();
+
+private:
+  mp_edge_object* newEdge(double width);
+  static void freeEdge(mp_edge_object* edge);
+  static bool equal(mp_edge_object* e1, mp_edge_object* e2);
+  static QByteArray fingerprint(const char* sources);
+
+  MP mp = nullptr;
+  QTemporaryDir dir;
+};
+
+void AlternateStoreTest::initTestCase() {
+  // Same options as Font::newInstance
+  MP_options* options = mp_options();
+  options->noninteractive = 1;
+  options->command_line = NULL;
+  options->ini_version = true;
+  options->math_mode = mp_math_double_mode;
+  options->job_name = (char*)"AlternateStoreTest";
+
+  mp = mp_initialize(options);
+
+  free(options);
+
+  QVERIFY(mp != nullptr);
+}
+
+void AlternateStoreTest::cleanupTestCase() {
+  if (mp != nullptr) {
+    mp_finish(mp);
+  }
+}
+
+QByteArray AlternateStoreTest::fingerprint(const char* sources) {
+  return QCryptographicHash::hash(sources, QCryptographicHash::Sha1);
+}
+
+// A glyph of two anchors and two closed paths of 3 knots
+mp_edge_object* AlternateStoreTest::newEdge(double width) {
+
+  auto edge = (mp_edge_object*)mp_xmalloc(mp, 1, sizeof(mp_edge_object));
+  memset(edge, 0, sizeof(mp_edge_object));
+
+  edge->charname = (char*)"behshape.isol";
+  edge->originalglyph = (char*)"behshape.isol";
+  edge->charcode = 66;
+  edge->glyphtype = 2;
+  edge->minx = -12.5;
+  edge->miny = -150.25;
+  edge->maxx = width;
+  edge->maxy = 310;
+  edge->width = width;
+  edge->height = 310;
+  edge->depth = 150.25;
+  edge->lefttatweel = 1.5;
+  edge->charlt = 3;
+  edge->charrt = 4;
+  edge->xleftanchor = 10;
+  edge->yleftanchor = 20;
+  edge->xrightanchor = width - 10;
+  edge->yrightanchor = 20;
+  edge->xpart = 0.25;
+  edge->ypart = -0.25;
+
+  edge->numAnchors = 2;
+  edge->anchors[0] = { (char*)"top", 1, 120, 400 };
+  edge->anchors[1] = { (char*)"bottom", 2, 120, -200 };
+
+  mp_graphic_object* last = nullptr;
+
+  for (int i = 0; i < 2; i++) {
+    auto object = (mp_fill_object*)mp_new_graphic_object(mp, mp_fill_code);
+
+    object->color_model = i == 0 ? mp_no_model : mp_rgb_model;
+    object->color = { 0.5, 0.25, 0.125, 0 };
+
+    mp_gr_knot first = nullptr;
+    mp_gr_knot current = nullptr;
+
+    for (int k = 0; k < 3; k++) {
+      auto knot = (mp_gr_knot)mp_xmalloc(mp, 1, sizeof(struct mp_gr_knot_data));
+      memset(knot, 0, sizeof(struct mp_gr_knot_data));
+      knot->x_coord = width * k / 3 + i;
+      knot->y_coord = 100.0 * k / 7;
+      knot->left_x = knot->x_coord - 1.0 / 3;
+      knot->left_y = knot->y_coord - 2;
+      knot->right_x = knot->x_coord + 1.0 / 3;
+      knot->right_y = knot->y_coord + 2;
+      knot->data.types.left_type = mp_explicit;
+
+      if (current == nullptr) {
+        first = knot;
+      }
+      else {
+        current->next = knot;
+      }
+      current = knot;
+    }
+
+    current->next = first;
+    object->path_p = first;
+
+    if (last == nullptr) {
+      edge->body = (mp_graphic_object*)object;
+    }
+    else {
+      last->next = (mp_graphic_object*)object;
+    }
+    last = (mp_graphic_object*)object;
+  }
+
+  return edge;
+}
+
+void AlternateStoreTest::freeEdge(mp_edge_object* edge) {
+  mp_graphic_object* p = edge->body;
+  while (p != nullptr) {
+    mp_graphic_object* q = p->next;
+    mp_gr_toss_object(p);
+    p = q;
+  }
+  mp_xfree(edge);
+}
+
+// Compares what the store keeps of an edge
+bool AlternateStoreTest::equal(mp_edge_object* e1, mp_edge_object* e2) {
+
+  if (e1 == nullptr || e2 == nullptr) return false;
+
+  if (QByteArray(e1->charname) != QByteArray(e2->charname) || QByteArray(e1->originalglyph) != QByteArray(e2->originalglyph)
+    || (e1->coloredglyph == nullptr) != (e2->coloredglyph == nullptr)) return false;
+
+  if (e1->charcode != e2->charcode || e1->glyphtype != e2->glyphtype
+    || e1->minx != e2->minx || e1->miny != e2->miny || e1->maxx != e2->maxx || e1->maxy != e2->maxy
+    || e1->width != e2->width || e1->height != e2->height || e1->depth != e2->depth || e1->ital_corr != e2->ital_corr
+    || e1->lefttatweel != e2->lefttatweel || e1->charlt != e2->charlt || e1->charrt != e2->charrt
+    || e1->xleftanchor != e2->xleftanchor || e1->yleftanchor != e2->yleftanchor
+    || e1->xrightanchor != e2->xrightanchor || e1->yrightanchor != e2->yrightanchor
+    || e1->xpart != e2->xpart || e1->ypart != e2->ypart) return false;
+
+  if (e1->numAnchors != e2->numAnchors) return false;
+
+  for (int i = 0; i < e1->numAnchors; i++) {
+    auto& a1 = e1->anchors[i];
+    auto& a2 = e2->anchors[i];
+    if (QByteArray(a1.anchorName) != QByteArray(a2.anchorName) || a1.type != a2.type || a1.x != a2.x || a1.y != a2.y) return false;
+  }
+
+  auto b1 = e1->body;
+  auto b2 = e2->body;
+
+  for (; b1 != nullptr && b2 != nullptr; b1 = b1->next, b2 = b2->next) {
+    auto o1 = (mp_fill_object*)b1;
+    auto o2 = (mp_fill_object*)b2;
+
+    if (b2->type != mp_fill_code || o1->color_model != o2->color_model) return false;
+
+    if (o1->color.a_val != o2->color.a_val || o1->color.b_val != o2->color.b_val
+      || o1->color.c_val != o2->color.c_val || o1->color.d_val != o2->color.d_val) return false;
+
+    auto k1 = o1->path_p;
+    auto k2 = o2->path_p;
+
+    do {
+      if (k1->x_coord != k2->x_coord || k1->y_coord != k2->y_coord || k1->left_x != k2->left_x || k1->left_y != k2->left_y
+        || k1->right_x != k2->right_x || k1->right_y != k2->right_y || k1->data.types.left_type != k2->data.types.left_type) return false;
+      k1 = k1->next;
+      k2 = k2->next;
+    } while (k1 != o1->path_p && k2 != o2->path_p);
+
+    if (k1 != o1->path_p || k2 != o2->path_p) return false;
+  }
+
+  return b1 == nullptr && b2 == nullptr;
+}
+
+void AlternateStoreTest::key() {
+  GlyphParameters parameters{ .lefttatweel = 1.5, .righttatweel = -0.5 };
+
+  auto key = AlternateStore::key("behshape.isol", parameters, "", fingerprint("glyph 1"));
+
+  QCOMPARE(AlternateStore::key("behshape.isol", parameters, "", fingerprint("glyph 1")), key);
+  QVERIFY(AlternateStore::key("behshape.isol", parameters, "", fingerprint("glyph 2")) != key);
+  QVERIFY(AlternateStore::key("behshape.isol", parameters, "beginchar", fingerprint("glyph 1")) != key);
+
+  parameters.scalex = 1;
+
+  QVERIFY(AlternateStore::key("behshape.isol", parameters, "", fingerprint("glyph 1")) != key);
+}
+
+void AlternateStoreTest::insert() {
+  AlternateStore store(mp);
+
+  QVERIFY(store.open(dir.filePath("insert.alt"), fingerprint("sources")));
+  QVERIFY(store.find("alternate") == nullptr);
+
+  auto edge = newEdge(500);
+
+  auto stored = store.insert("alternate", edge);
+
+  QVERIFY(stored != nullptr && stored != edge);
+  QVERIFY(equal(stored, edge));
+  QCOMPARE(store.find("alternate"), stored);
+  QCOMPARE(store.insert("alternate", edge), stored);
+
+  freeEdge(edge);
+}
+
+void AlternateStoreTest::reopen() {
+  QString fileName = dir.filePath("reopen.alt");
+
+  auto edge1 = newEdge(500);
+  auto edge2 = newEdge(700.125);
+
+  {
+    AlternateStore store(mp);
+    QVERIFY(store.open(fileName, fingerprint("sources")));
+    QVERIFY(store.insert("alternate1", edge1) != nullptr);
+    QVERIFY(store.insert("alternate2", edge2) != nullptr);
+  }
+
+  AlternateStore store(mp);
+
+  QVERIFY(store.open(fileName, fingerprint("sources")));
+  QVERIFY(equal(store.find("alternate1"), edge1));
+  QVERIFY(equal(store.find("alternate2"), edge2));
+  QVERIFY(store.find("alternate3") == nullptr);
+
+  freeEdge(edge1);
+  freeEdge(edge2);
+}
+
+void AlternateStoreTest::fingerprintChanged() {
+  QString fileName = dir.filePath("fingerprint.alt");
+
+  auto edge = newEdge(500);
+
+  {
+    AlternateStore store(mp);
+    QVERIFY(store.open(fileName, fingerprint("sources")));
+    QVERIFY(store.insert("alternate", edge) != nullptr);
+  }
+
+  AlternateStore store(mp);
+
+  QVERIFY(store.open(fileName, fingerprint("edited sources")));
+  QVERIFY(store.find("alternate") == nullptr);
+
+  freeEdge(edge);
+}
+
+void AlternateStoreTest::interruptedRecord() {
+  QString fileName = dir.filePath("interrupted.alt");
+
+  auto edge1 = newEdge(500);
+  auto edge2 = newEdge(700);
+
+  qint64 size;
+
+  {
+    AlternateStore store(mp);
+    QVERIFY(store.open(fileName, fingerprint("sources")));
+    QVERIFY(store.insert("alternate1", edge1) != nullptr);
+    size = QFileInfo(fileName).size();
+    QVERIFY(store.insert("alternate2", edge2) != nullptr);
+  }
+
+  QFile file(fileName);
+  QVERIFY(file.resize(file.size() - 3));
+
+  {
+    AlternateStore store(mp);
+    QVERIFY(store.open(fileName, fingerprint("sources")));
+    QVERIFY(equal(store.find("alternate1"), edge1));
+    QVERIFY(store.find("alternate2") == nullptr);
+  }
+
+  QCOMPARE(QFileInfo(fileName).size(), size);
+
+  freeEdge(edge1);
+  freeEdge(edge2);
+}
+
+void AlternateStoreTest::lockedFile() {
+  QString fileName = dir.filePath("locked.alt");
+
+  AlternateStore store1(mp);
+  AlternateStore store2(mp);
+
+  QVERIFY(store1.open(fileName, fingerprint("sources")));
+  QVERIFY(!store2.open(fileName, fingerprint("sources")));
+  QVERIFY(!store2.isOpen());
+
+  store1.close();
+
+  QVERIFY(store2.open(fileName, fingerprint("sources")));
+}
+
+QTEST_APPLESS_MAIN(AlternateStoreTest)
+
+#include "AlternateStoreTest.moc"
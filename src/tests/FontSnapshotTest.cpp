@@ -0,0 +1,339 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#include <QtTest>
+
+#include "FontSnapshot.h"
+#include "metafont.h"
+
+/*
+  Round trip of the edges through the records of the font snapshot, and invalidation of the glyphs by the glyphs they
+  call.
+*/
+class FontSnapshotTest : public QObject {
+  Q_OBJECT
+
+private slots:
+  void initTestCase();
+  void cleanupTestCase();
+  void glyphName();
+  void dependencyDigest();
+  void serialize();
+  void truncatedPayload();
+
+private:
+  char* newString(const char* value);
+  mp_gr_knot newKnots(int nbKnots, double x);
+  mp_edge_object* newEdge();
+  static bool equalKnots(mp_gr_knot k1, mp_gr_knot k2);
+  static bool equal(mp_edge_object* e1, mp_edge_object* e2);
+
+  MP mp = nullptr;
+};
+
+void FontSnapshotTest::initTestCase() {
+  // Same options as Font::newInstance
+  MP_options* options = mp_options();
+  options->noninteractive = 1;
+  options->command_line = NULL;
+  options->ini_version = true;
+  options->math_mode = mp_math_double_mode;
+  options->job_name = (char*)"FontSnapshotTest";
+
+  mp = mp_initialize(options);
+
+  free(options);
+
+  QVERIFY(mp != nullptr);
+}
+
+void FontSnapshotTest::cleanupTestCase() {
+  if (mp != nullptr) {
+    mp_finish(mp);
+  }
+}
+
+// Strings freed with the edge are allocated by MetaPost
+char* FontSnapshotTest::newString(const char* value) {
+  auto size = strlen(value) + 1;
+  auto ret = (char*)mp_xmalloc(mp, size, 1);
+  memcpy(ret, value, size);
+  return ret;
+}
+
+mp_gr_knot FontSnapshotTest::newKnots(int nbKnots, double x) {
+
+  mp_gr_knot first = nullptr;
+  mp_gr_knot current = nullptr;
+
+  for (int k = 0; k < nbKnots; k++) {
+    auto knot = (mp_gr_knot)mp_xmalloc(mp, 1, sizeof(struct mp_gr_knot_data));
+    memset(knot, 0, sizeof(struct mp_gr_knot_data));
+    knot->x_coord = x + 10.0 * k / 3;
+    knot->y_coord = -100.0 * k / 7;
+    knot->left_x = knot->x_coord - 0.5;
+    knot->left_y = knot->y_coord - 2;
+    knot->right_x = knot->x_coord + 0.5;
+    knot->right_y = knot->y_coord + 2;
+    knot->data.types.left_type = mp_explicit;
+    knot->data.types.right_type = k == nbKnots - 1 ? mp_endpoint : mp_explicit;
+    knot->originator = k % 2;
+
+    if (current == nullptr) {
+      first = knot;
+    }
+    else {
+      current->next = knot;
+    }
+    current = knot;
+  }
+
+  current->next = first;
+
+  return first;
+}
+
+// A glyph with a filled and a stroked path inside bounds
+mp_edge_object* FontSnapshotTest::newEdge() {
+
+  auto edge = (mp_edge_object*)mp_xmalloc(mp, 1, sizeof(mp_edge_object));
+  memset(edge, 0, sizeof(mp_edge_object));
+
+  edge->parent = mp;
+  edge->charname = (char*)"kaf.fina";
+  edge->originalglyph = (char*)"kaf.fina";
+  edge->coloredglyph = (char*)"kaf.fina.colored";
+  edge->glyphtype = 1;
+  edge->minx = -12.5;
+  edge->miny = -150.25;
+  edge->maxx = 512;
+  edge->maxy = 710;
+  edge->width = 500.125;
+  edge->height = 710;
+  edge->depth = 150.25;
+  edge->lefttatweel = 2.5;
+  edge->charlt = 3;
+  edge->charrt = 4;
+  edge->xleftanchor = 10;
+  edge->yleftanchor = 20;
+  edge->xrightanchor = 490;
+  edge->yrightanchor = 20;
+  edge->xpart = 0.25;
+  edge->ypart = -0.25;
+
+  edge->numAnchors = 2;
+  edge->anchors[0] = { newString("top"), 1, 120, 800 };
+  edge->anchors[1] = { newString("bottom"), 2, 120, -200 };
+
+  auto bounds = (mp_bounds_object*)mp_new_graphic_object(mp, mp_start_bounds_code);
+  bounds->path_p = newKnots(4, 0);
+
+  auto fill = (mp_fill_object*)mp_new_graphic_object(mp, mp_fill_code);
+  fill->color_model = mp_rgb_model;
+  fill->color = { 0.5, 0.25, 0.125, 0 };
+  fill->ljoin = 1;
+  fill->miterlim = 10;
+  fill->path_p = newKnots(3, 100);
+
+  auto stroked = (mp_stroked_object*)mp_new_graphic_object(mp, mp_stroked_code);
+  stroked->pre_script = newString("pre");
+  stroked->color_model = mp_no_model;
+  stroked->ljoin = 2;
+  stroked->lcap = 1;
+  stroked->miterlim = 4;
+  stroked->path_p = newKnots(2, 200);
+  stroked->pen_p = newKnots(1, 0);
+
+  auto stopBounds = mp_new_graphic_object(mp, mp_stop_bounds_code);
+
+  edge->body = (mp_graphic_object*)bounds;
+  bounds->next = (mp_graphic_object*)fill;
+  fill->next = (mp_graphic_object*)stroked;
+  stroked->next = stopBounds;
+
+  return edge;
+}
+
+bool FontSnapshotTest::equalKnots(mp_gr_knot k1, mp_gr_knot k2) {
+  if (k1 == nullptr || k2 == nullptr) return k1 == k2;
+
+  auto p1 = k1;
+  auto p2 = k2;
+
+  do {
+    if (p1->x_coord != p2->x_coord || p1->y_coord != p2->y_coord || p1->left_x != p2->left_x || p1->left_y != p2->left_y
+      || p1->right_x != p2->right_x || p1->right_y != p2->right_y || p1->data.types.left_type != p2->data.types.left_type
+      || p1->data.types.right_type != p2->data.types.right_type || p1->originator != p2->originator) return false;
+    p1 = p1->next;
+    p2 = p2->next;
+  } while (p1 != k1 && p2 != k2);
+
+  return p1 == k1 && p2 == k2;
+}
+
+static bool equalStrings(const char* s1, const char* s2) {
+  return (s1 == nullptr) == (s2 == nullptr) && (s1 == nullptr || strcmp(s1, s2) == 0);
+}
+
+bool FontSnapshotTest::equal(mp_edge_object* e1, mp_edge_object* e2) {
+
+  if (e1 == nullptr || e2 == nullptr) return false;
+
+  if (!equalStrings(e1->charname, e2->charname) || !equalStrings(e1->originalglyph, e2->originalglyph)
+    || !equalStrings(e1->coloredglyph, e2->coloredglyph)) return false;
+
+  if (e1->glyphtype != e2->glyphtype
+    || e1->minx != e2->minx || e1->miny != e2->miny || e1->maxx != e2->maxx || e1->maxy != e2->maxy
+    || e1->width != e2->width || e1->height != e2->height || e1->depth != e2->depth || e1->ital_corr != e2->ital_corr
+    || e1->lefttatweel != e2->lefttatweel || e1->charlt != e2->charlt || e1->charrt != e2->charrt
+    || e1->xleftanchor != e2->xleftanchor || e1->yleftanchor != e2->yleftanchor
+    || e1->xrightanchor != e2->xrightanchor || e1->yrightanchor != e2->yrightanchor
+    || e1->xpart != e2->xpart || e1->ypart != e2->ypart) return false;
+
+  if (e1->numAnchors != e2->numAnchors) return false;
+
+  for (int i = 0; i < e1->numAnchors; i++) {
+    auto& a1 = e1->anchors[i];
+    auto& a2 = e2->anchors[i];
+    if (!equalStrings(a1.anchorName, a2.anchorName) || a1.type != a2.type || a1.x != a2.x || a1.y != a2.y) return false;
+  }
+
+  auto b1 = e1->body;
+  auto b2 = e2->body;
+
+  for (; b1 != nullptr && b2 != nullptr; b1 = b1->next, b2 = b2->next) {
+
+    if (b1->type != b2->type) return false;
+
+    switch (b1->type) {
+    case mp_fill_code: {
+      auto o1 = (mp_fill_object*)b1;
+      auto o2 = (mp_fill_object*)b2;
+      if (!equalStrings(o1->pre_script, o2->pre_script) || !equalStrings(o1->post_script, o2->post_script)
+        || o1->color_model != o2->color_model || o1->color.a_val != o2->color.a_val || o1->color.b_val != o2->color.b_val
+        || o1->color.c_val != o2->color.c_val || o1->color.d_val != o2->color.d_val
+        || o1->ljoin != o2->ljoin || o1->miterlim != o2->miterlim
+        || !equalKnots(o1->path_p, o2->path_p) || !equalKnots(o1->htap_p, o2->htap_p) || !equalKnots(o1->pen_p, o2->pen_p)) return false;
+      break;
+    }
+    case mp_stroked_code: {
+      auto o1 = (mp_stroked_object*)b1;
+      auto o2 = (mp_stroked_object*)b2;
+      if (!equalStrings(o1->pre_script, o2->pre_script) || !equalStrings(o1->post_script, o2->post_script)
+        || o1->color_model != o2->color_model || o1->color.a_val != o2->color.a_val || o1->color.b_val != o2->color.b_val
+        || o1->color.c_val != o2->color.c_val || o1->color.d_val != o2->color.d_val
+        || o1->ljoin != o2->ljoin || o1->lcap != o2->lcap || o1->miterlim != o2->miterlim
+        || !equalKnots(o1->path_p, o2->path_p) || !equalKnots(o1->pen_p, o2->pen_p)) return false;
+      break;
+    }
+    case mp_start_bounds_code:
+      if (!equalKnots(((mp_bounds_object*)b1)->path_p, ((mp_bounds_object*)b2)->path_p)) return false;
+      break;
+    default:
+      break;
+    }
+  }
+
+  return b1 == nullptr && b2 == nullptr;
+}
+
+void FontSnapshotTest::glyphName() {
+  QCOMPARE(FontSnapshot::glyphName("defchar(kaf.fina, 0, 500, 700, 150);"), QString("kaf.fina"));
+  QCOMPARE(FontSnapshot::glyphName("beginchar( alef ,1,200,700,0);"), QString("alef"));
+  QVERIFY(FontSnapshot::glyphName("defchar(\"kaf\", 0, 500, 700, 150);").isEmpty());
+
+  QVERIFY(FontSnapshot::isRestorable("defchar(kaf.fina, 0, 500, 700, 150);"));
+  QVERIFY(!FontSnapshot::isRestorable("beginchar(alef, 1, 200, 700, 0);"));
+  QVERIFY(!FontSnapshot::isRestorable("defchar(kaf.fina, 0, 500, 700, 150); savepicture;"));
+}
+
+void FontSnapshotTest::dependencyDigest() {
+  QHash<QString, QString> sources{
+    { "alef", "defchar(alef, 1, 200, 700, 0); fill alef$;" },
+    { "lam", "defchar(lam, 2, 200, 700, 0); draw lam_(1, 2) shifted alef $;" },
+    { "kaf", "defchar(kaf, 3, 200, 700, 0); fill kaf$ beh;" },
+    { "beh", "defchar(beh, 4, 200, 700, 0); fill kaf$ lam$;" },
+  };
+
+  auto computeDigests = [&]() {
+    QHash<QString, QByteArray> digests;
+    QHash<QString, QByteArray> result;
+    for (auto& name : sources.keys()) {
+      result.insert(name, FontSnapshot::dependencyDigest(name, sources, digests));
+    }
+    return result;
+  };
+
+  auto before = computeDigests();
+
+  // lam calls alef, beh calls kaf and lam, kaf only names beh
+  sources["alef"] += " ";
+
+  auto after = computeDigests();
+
+  QVERIFY(after["alef"] != before["alef"]);
+  QVERIFY(after["lam"] != before["lam"]);
+  QVERIFY(after["beh"] != before["beh"]);
+  QCOMPARE(after["kaf"], before["kaf"]);
+
+  // Cycles are followed once
+  sources["kaf"] = "defchar(kaf, 3, 200, 700, 0); fill beh$;";
+
+  auto cycle = computeDigests();
+
+  QVERIFY(cycle["kaf"] != after["kaf"]);
+  QVERIFY(cycle["beh"] != after["beh"]);
+  QCOMPARE(cycle["lam"], after["lam"]);
+}
+
+void FontSnapshotTest::serialize() {
+  auto edge = newEdge();
+
+  QByteArray payload;
+
+  QVERIFY(FontSnapshot::serialize(edge, payload));
+
+  FontSnapshot snapshot;
+
+  auto restored = snapshot.deserialize(mp, payload.constData(), payload.size());
+
+  QVERIFY(restored != nullptr);
+  QVERIFY(equal(restored, edge));
+
+  mp_gr_toss_objects_extended(restored);
+  mp_gr_toss_objects_extended(edge);
+}
+
+void FontSnapshotTest::truncatedPayload() {
+  auto edge = newEdge();
+
+  QByteArray payload;
+
+  QVERIFY(FontSnapshot::serialize(edge, payload));
+
+  FontSnapshot snapshot;
+
+  QVERIFY(snapshot.deserialize(mp, payload.constData(), payload.size() - 1) == nullptr);
+
+  mp_gr_toss_objects_extended(edge);
+}
+
+QTEST_APPLESS_MAIN(FontSnapshotTest)
+
+#include "FontSnapshotTest.moc"
@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#include <QtTest>
+#include <QTemporaryDir>
+
+#include "JustificationStore.h"
+
+/*
+  Round trip of the records of the justification store through their encoding and through the file.
+*/
+class JustificationStoreTest : public QObject {
+  Q_OBJECT
+
+private slots:
+  void serialize();
+  void truncatedPayload();
+  void open();
+  void interruptedRecord();
+  void compact();
+  void lockedFile();
+
+private:
+  using Record = JustificationStore::Record;
+
+  static Record record(double xScale);
+  static bool equal(const Record& r1, const Record& r2);
+  static void append(const QString& fileName, const QString& key, const Record& record);
+
+  QTemporaryDir dir;
+};
+
+JustificationStoreTest::Record JustificationStoreTest::record(double xScale) {
+  Record record;
+
+  record.fingerprint = 0x0123456789abcdefULL;
+  record.glyphs = { 3, 7, 12, 65535 };
+
+  auto& result = record.result;
+
+  result.sclxAxis = 0.5;
+  result.globalFeatures = { { "cv01", 2 } };
+  result.fontFeatures[3] = { { "cv02", 1 }, { "cv11", -1 } };
+  result.fontFeatures[8] = {};
+  result.simpleSpacing = 112.25;
+  result.ayaSpacing = 1.0 / 3;
+  result.xScale = xScale;
+
+  return record;
+}
+
+static bool equalFeatures(const std::vector<TextFontFeatures>& f1, const std::vector<TextFontFeatures>& f2) {
+  if (f1.size() != f2.size()) return false;
+  for (int i = 0; i < f1.size(); i++) {
+    if (f1[i].name != f2[i].name || f1[i].value != f2[i].value) return false;
+  }
+  return true;
+}
+
+bool JustificationStoreTest::equal(const Record& r1, const Record& r2) {
+  auto& result1 = r1.result;
+  auto& result2 = r2.result;
+
+  if (r1.fingerprint != r2.fingerprint || r1.glyphs != r2.glyphs) return false;
+
+  if (result1.sclxAxis != result2.sclxAxis || result1.simpleSpacing != result2.simpleSpacing
+    || result1.ayaSpacing != result2.ayaSpacing || result1.xScale != result2.xScale) return false;
+
+  if (!equalFeatures(result1.globalFeatures, result2.globalFeatures)) return false;
+
+  if (result1.fontFeatures.size() != result2.fontFeatures.size()) return false;
+
+  for (auto& charFeatures : result1.fontFeatures) {
+    auto find = result2.fontFeatures.find(charFeatures.first);
+    if (find == result2.fontFeatures.end() || !equalFeatures(charFeatures.second, find->second)) return false;
+  }
+
+  return true;
+}
+
+// Appends the record the way JustificationStore::insert does
+void JustificationStoreTest::append(const QString& fileName, const QString& key, const Record& record) {
+  QFile file(fileName);
+  QVERIFY(file.open(QIODevice::Append));
+
+  QByteArray payload = JustificationStore::serialize(key, record);
+  quint32 payloadSize = payload.size();
+
+  file.write((const char*)&payloadSize, sizeof(quint32));
+  file.write(payload);
+}
+
+void JustificationStoreTest::serialize() {
+  QString key = JustificationStore::key("بِسْمِ ٱللَّهِ", 17000, 100, 1, 2);
+
+  auto payload = JustificationStore::serialize(key, record(0.75));
+
+  QString readKey;
+  Record readRecord;
+
+  QVERIFY(JustificationStore::deserialize(payload, readKey, readRecord));
+  QCOMPARE(readKey, key);
+  QVERIFY(equal(readRecord, record(0.75)));
+}
+
+void JustificationStoreTest::truncatedPayload() {
+  auto payload = JustificationStore::serialize("key", record(1));
+
+  QString key;
+  Record readRecord;
+
+  QVERIFY(!JustificationStore::deserialize(payload.left(payload.size() - 1), key, readRecord));
+}
+
+void JustificationStoreTest::open() {
+  QString fileName = dir.filePath("open.jst");
+
+  JustificationStore store;
+
+  QVERIFY(store.open(fileName));
+  QVERIFY(store.records.isEmpty());
+  store.close();
+
+  append(fileName, "line1", record(1));
+  append(fileName, "line2", record(2));
+  append(fileName, "line1", record(3));
+
+  QVERIFY(store.open(fileName));
+  QCOMPARE(store.records.size(), 2);
+  QCOMPARE(store.replaced, 1);
+  QVERIFY(equal(store.records.value("line1"), record(3)));
+  QVERIFY(equal(store.records.value("line2"), record(2)));
+}
+
+void JustificationStoreTest::interruptedRecord() {
+  QString fileName = dir.filePath("interrupted.jst");
+
+  JustificationStore store;
+
+  QVERIFY(store.open(fileName));
+  store.close();
+
+  append(fileName, "line1", record(1));
+
+  auto size = QFileInfo(fileName).size();
+
+  append(fileName, "line2", record(2));
+
+  QFile file(fileName);
+  QVERIFY(file.resize(file.size() - 3));
+
+  QVERIFY(store.open(fileName));
+  QCOMPARE(store.records.size(), 1);
+  QVERIFY(equal(store.records.value("line1"), record(1)));
+  store.close();
+
+  QCOMPARE(QFileInfo(fileName).size(), size);
+}
+
+void JustificationStoreTest::compact() {
+  QString fileName = dir.filePath("compact.jst");
+
+  JustificationStore store;
+
+  QVERIFY(store.open(fileName));
+  store.close();
+
+  auto headerSize = QFileInfo(fileName).size();
+
+  for (int i = 1; i <= 4; i++) {
+    append(fileName, "line1", record(i));
+  }
+  append(fileName, "line2", record(5));
+
+  // 3 replaced records for 2 records : the file is rewritten with the last ones
+  QVERIFY(store.open(fileName));
+  QCOMPARE(store.replaced, 0);
+  store.close();
+
+  auto recordSize = [](const QString& key, const Record& record) {
+    return (qint64)sizeof(quint32) + JustificationStore::serialize(key, record).size();
+  };
+
+  QCOMPARE(QFileInfo(fileName).size(), headerSize + recordSize("line1", record(4)) + recordSize("line2", record(5)));
+
+  QVERIFY(store.open(fileName));
+  QCOMPARE(store.records.size(), 2);
+  QVERIFY(equal(store.records.value("line1"), record(4)));
+  QVERIFY(equal(store.records.value("line2"), record(5)));
+}
+
+void JustificationStoreTest::lockedFile() {
+  QString fileName = dir.filePath("locked.jst");
+
+  JustificationStore store1;
+  JustificationStore store2;
+
+  QVERIFY(store1.open(fileName));
+  QVERIFY(!store2.open(fileName));
+  QVERIFY(!store2.isOpen());
+
+  store1.close();
+
+  QVERIFY(store2.open(fileName));
+}
+
+QTEST_APPLESS_MAIN(JustificationStoreTest)
+
+#include "JustificationStoreTest.moc"
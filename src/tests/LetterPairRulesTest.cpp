@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2015-2020 Amine Anane. http: //digitalkhatt/license
+ * This file is part of DigitalKhatt.
+ *
+ * DigitalKhatt is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * DigitalKhatt is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with DigitalKhatt. If not, see
+ * <https: //www.gnu.org/licenses />.
+*/
+
+#include <QtTest>
+#include <QRegularExpression>
+#include <QRandomGenerator>
+
+#include "LetterPairRules.h"
+
+using namespace std;
+
+/*
+  Checks the letter pair rules of the justification against the regular expressions they replace : the same rule must
+  match at the same position of every subword.
+*/
+class LetterPairRulesTest : public QObject {
+  Q_OBJECT
+
+private slots:
+  void initTestCase();
+  void kashidas();
+  void simpleJust();
+
+private:
+  QStringList subwords;
+};
+
+static const QString rightNoJoinLetters = "آاٱأإدذرزوؤءة";
+static const QString dualJoinLetters = "بتثجحخسشصضطظعغفقكلمنهيئى";
+
+// The patterns of just_features.cpp before the letter pair rules
+static const QString rightKashExp = QString("بتثنيئ") + "جحخ" + "سش" + "صض" + "طظ" + "عغ" + "فق" + "م" + "ه";
+static const QString leftKashNoReh = QString("ئبتثني") + "جحخ" + "طظ" + "عغ" + "فق" + "ةلم";
+static const QString mediLeftAsendant = "ل";
+static const QString finalAscendant = "آادذٱأإكلهة";
+
+static const QString rightKash = QString(dualJoinLetters).remove(QRegularExpression("[لك]"));
+static const QString leftKashidaMedi = (dualJoinLetters + QString(rightNoJoinLetters).remove("ء")).remove(QRegularExpression("[وهصضطظ]")).remove("ه");
+
+static const QString altFinPat = "^.*([بتثفكنصضسشقيئى])$";
+static const QString finalKashidaEndWord = QString("^.*([%1][آاٱأإملهة])$").arg(rightKash);
+static const QString finalKashida = QString("^.*([%1][دذآاٱأإملهة])$").arg(rightKash);
+static const QString hahKashida = QString("^.*([%1][%2]).*$|^.*([%1][هة])$").arg("جحخ").arg(leftKashidaMedi);
+static const QString behBehPat = "^.+([بتثنيسشصض][بتثنيم]).+$";
+static const QString rehPat = QString(".*([%1][رز])").arg(rightKash);
+static const QString otherPat = QString(".*([%1](?:[%2]|[%3]))").arg(rightKash).arg(mediLeftAsendant).arg(leftKashidaMedi);
+static const QString kafPat = "^.*([ك].).*$";
+
+static vector<QRegularExpression> kashidaRegExprs(const QStringList& patterns) {
+  vector<QRegularExpression> regExprs;
+  for (auto& pattern : patterns) {
+    regExprs.push_back(QRegularExpression(pattern));
+  }
+  return regExprs;
+}
+
+void LetterPairRulesTest::initTestCase() {
+
+  QString letters = dualJoinLetters + rightNoJoinLetters;
+
+  // Every subword of up to 3 letters
+  subwords << "";
+  int first = 0;
+  for (int length = 1; length <= 3; length++) {
+    int last = subwords.size();
+    for (int i = first; i < last; i++) {
+      for (auto letter : letters) {
+        subwords << subwords[i] + letter;
+      }
+    }
+    first = last;
+  }
+
+  // Longer subwords, half of their letters taken from the letters of the kashidas
+  QString kashidaLetters = rightKashExp + "رزلكم";
+  QRandomGenerator random(2024);
+  for (int i = 0; i < 50000; i++) {
+    QString subword;
+    int length = random.bounded(4, 10);
+    for (int j = 0; j < length; j++) {
+      auto& from = random.bounded(2) == 0 ? letters : kashidaLetters;
+      subword += from[random.bounded(from.size())];
+    }
+    subwords << subword;
+  }
+}
+
+void LetterPairRulesTest::kashidas() {
+
+  struct KashidaRules {
+    const char* name;
+    const vector<LetterPairRule>& rules;
+    vector<QRegularExpression> regExprs;
+  };
+
+  vector<KashidaRules> kashidaRules{
+    { "Beh", behRules, kashidaRegExprs({ "^.+(?<k1>[بتثنيسشصض][بتثنيم]).+$" }) },
+    { "FinaAscendant", finaAscendantRules, kashidaRegExprs({ QString("^.*(?<k1>[%1][%2])$").arg(rightKashExp).arg(finalAscendant) }) },
+    { "OtherKashidas", otherKashidasRules, kashidaRegExprs({
+      QString(".*(?<k1>[%1][رز])").arg(rightKashExp),
+      QString(".*(?<k1>[%1](?:[%2]|[%3]))").arg(rightKashExp).arg(mediLeftAsendant).arg(leftKashNoReh),
+    }) },
+    { "Kaf", kafRules, kashidaRegExprs({ "^.*(?<k1>[ك].).*$" }) },
+    { "SecondKashidaNotSameSubWord", secondKashidaNotSameSubWordRules, kashidaRegExprs({
+      "^.+(?<k1>[بتثنيسشصض][بتثنيم]).+$",
+      QString("^.*(?<k1>[%1][آادذٱأإكلهة])$").arg(rightKashExp),
+      QString(".*(?<k1>[%1][رز])").arg(rightKashExp),
+      QString(".*(?<k1>[%1](?:[%2]|[%3]))").arg(rightKashExp).arg(mediLeftAsendant).arg(leftKashNoReh),
+    }) },
+    { "SecondKashidaSameSubWord", secondKashidaSameSubWordRules, kashidaRegExprs({
+      "^.+(?<k1>[بتثنيسشصض][بتثنيم]).+",
+      QString("(?<k1>[%1][آادذٱأإكلهة])$").arg(rightKashExp),
+      QString("(?<k1>[%1][رز])").arg(rightKashExp),
+      QString("(?<k1>[%1](?:[%2]|[%3]))").arg(rightKashExp).arg(mediLeftAsendant).arg(leftKashNoReh),
+    }) },
+  };
+
+  for (auto& kashida : kashidaRules) {
+    for (auto& subword : subwords) {
+
+      vector<pair<int, int>> expected;
+      for (int i = 0; i < kashida.regExprs.size(); i++) {
+        auto matches = kashida.regExprs[i].globalMatch(subword);
+        while (matches.hasNext()) {
+          expected.push_back({ i + 1, (int)matches.next().capturedStart("k1") });
+        }
+      }
+
+      vector<pair<int, int>> actual;
+      for (auto& match : matchAllLetterPairs(subword, kashida.rules)) {
+        actual.push_back({ match.rule, match.position });
+      }
+
+      QVERIFY2(actual == expected, qPrintable(QString("%1 : %2").arg(kashida.name).arg(subword)));
+    }
+  }
+}
+
+void LetterPairRulesTest::simpleJust() {
+
+  struct SimpleJustRules {
+    const char* name;
+    const vector<LetterPairRule>& rules;
+    QRegularExpression regExpr;
+  };
+
+  vector<SimpleJustRules> simpleJustTypes{
+    { "altFina", altFinaRules, QRegularExpression(altFinPat) },
+    { "hahFinaAscenKashida", hahFinaAscenKashidaRules, QRegularExpression(hahKashida + "|" + finalKashidaEndWord) },
+    { "simpleJust", simpleJustRules, QRegularExpression(altFinPat + "|" + hahKashida + "|" + finalKashida + "|" + behBehPat + "|" + rehPat + "|" + otherPat + "|" + kafPat) },
+  };
+
+  for (auto& type : simpleJustTypes) {
+    for (auto& subword : subwords) {
+
+      // The alternative matching the subword is its last captured group
+      LetterPairMatch expected;
+      auto match = type.regExpr.match(subword);
+      if (match.hasMatch()) {
+        expected.rule = match.lastCapturedIndex();
+        expected.position = match.capturedStart(expected.rule);
+      }
+
+      auto actual = matchLetterPairs(subword, type.rules);
+
+      QVERIFY2(actual.rule == expected.rule && actual.position == expected.position, qPrintable(QString("%1 : %2").arg(type.name).arg(subword)));
+    }
+  }
+}
+
+QTEST_APPLESS_MAIN(LetterPairRulesTest)
+
+#include "LetterPairRulesTest.moc"
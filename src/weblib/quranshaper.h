@@ -186,24 +186,16 @@ public:
     if (!mp) {
       std::cout << "cannot initilize mp";
     }
-    mp_run_data* run = mp_rundata(mp);
+    mp_edge_object* p = mp_find_edge_by_name(mp, glyphName.c_str());
 
-    mp_edge_object* p = run->edges;
+    if (p != NULL) {
+      mp_graphic_object* body = p->body;
 
-    while (p != NULL) {
-      if (p->charname == glyphName) {
-        mp_graphic_object* body = p->body;
-
-        if (body) {
-          edgetoHTML5Path(body, ctx);
-        }
-
-        return;
-      }
-      else {
-        p = p->next;
+      if (body) {
+        edgetoHTML5Path(body, ctx);
       }
 
+      return;
     }
 
     std::cout << "no char";
@@ -561,40 +553,34 @@ private:
       std::cout << "cannot initilize mp";
       return "error";
     }
-    mp_run_data* run = mp_rundata(mp);
+    mp_edge_object* p = mp_find_edge_by_name(mp, glyphName.c_str());
 
-    mp_edge_object* p = run->edges;
+    if (p != NULL) {
+      std::stringstream ret;
+      ret << "function(ctx) {\n";
+      mp_graphic_object* body = p->body;
 
-    while (p != NULL) {
-      if (p->charname == glyphName) {
-        std::stringstream ret;
-        ret << "function(ctx) {\n";
-        mp_graphic_object* body = p->body;
-
-        if (body) {
+      if (body) {
 
-          ret << "\tctx.beginPath();\n";
-          do {
-            switch (body->type)
-            {
-            case mp_fill_code: {
-              filltoHTML5Path(((mp_fill_object*)body)->path_p, ret);
+        ret << "\tctx.beginPath();\n";
+        do {
+          switch (body->type)
+          {
+          case mp_fill_code: {
+            filltoHTML5Path(((mp_fill_object*)body)->path_p, ret);
 
-              break;
-            }
-            default:
-              break;
-            }
+            break;
+          }
+          default:
+            break;
+          }
 
-          } while (body = body->next);
+        } while (body = body->next);
 
-          ret << "\tctx.fill();\n";
-        }
-        ret << "}";
-        return ret.str();
+        ret << "\tctx.fill();\n";
       }
-
-      p = p->next;
+      ret << "}";
+      return ret.str();
     }
 
     std::cout << "no char";